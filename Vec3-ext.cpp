@@ -89,3 +89,26 @@ Float Vec3Extra::angleAxis2x1(const Vec3 &axis, const Vec3 &far1, const Vec3 &fa
   return Vec3::radToDeg(std::asin(nearRight*farUp));
 }
 
+
+bool Vec3Extra::dihedral(const Vec3 &x1, const Vec3 &x2, const Vec3 &x3, const Vec3 &x4, Float &phi, std::array<Vec3,4> *dphi) {
+  // Bekker's formulation: F=x1-x2, G=x2-x3, H=x4-x3, A=FxG, B=HxG
+  auto F = x1 - x2;
+  auto G = x2 - x3;
+  auto H = x4 - x3;
+  auto A = F.cross(G);
+  auto B = H.cross(G);
+  auto lA2 = A.len2(), lB2 = B.len2(), lG = G.len();
+  if (lA2 == 0 || lB2 == 0 || lG == 0)
+    return false; // collinear atoms
+  phi = std::atan2(B.cross(A)*G/lG, A*B);
+  if (dphi) {
+    auto gA = A*(lG/lA2);
+    auto gB = B*(lG/lB2);
+    auto gJ = A*((F*G)/(lA2*lG)) - B*((H*G)/(lB2*lG));
+    (*dphi)[0] = -gA;
+    (*dphi)[1] = gA + gJ;
+    (*dphi)[2] = -(gB + gJ);
+    (*dphi)[3] = gB;
+  }
+  return true;
+}
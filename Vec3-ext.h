@@ -3,6 +3,8 @@
 #include "Vec3.h"
 #include "Mat3.h"
 
+#include <array>
+
 // Vec3Extra implements some functions that are too complex or advanced to be included in Vec3
 
 class Vec3Extra {
@@ -13,4 +15,6 @@ public:
   // angle calculation (like in a Ramachandran plot, but with a degree of non-planarity present)
   static Float angleAxis1x1(const Vec3 &axis, const Vec3 &far, const Vec3 &near);
   static Float angleAxis2x1(const Vec3 &axis, const Vec3 &far1, const Vec3 &far2, const Vec3 &near);
+  // dihedral angle x1-x2-x3-x4 in radians and its derivatives by the four positions, fails when the angle is undefined
+  static bool dihedral(const Vec3 &x1, const Vec3 &x2, const Vec3 &x3, const Vec3 &x4, Float &phi, std::array<Vec3,4> *dphi);
 }; // Vec3Extra
@@ -204,7 +204,7 @@ var actions = {
 					var atom = new Atom(elt, [randCoord(), randCoord(), randCoord()]);
 					molecule.addAtom(atom);
 				}
-				if (minDist <= molecule.minDistBetweenAtoms() && molecule.maxDistBetweenAtoms() <= maxDist) {
+				if (!molecule.hasClash(minDist) && molecule.maxDistBetweenAtoms() <= maxDist) {
 					print("adding the configuration with dists in "+molecule.minDistBetweenAtoms()+".."+molecule.maxDistBetweenAtoms());
 					mm.push(molecule);
 				}
@@ -219,26 +219,23 @@ var actions = {
 		crystalCubic: function(elt, len, cnt) {
 			var engine = require("calc-nwchem").create();
 			var db = actions.db.open();
-			var molecule = new Molecule;
-			for (var a = 0; a < cnt[0]; a++)
-				for (var b = 0; b < cnt[1]; b++)
-					for (var c = 0; c < cnt[2]; c++)
-						molecule.addAtom(new Atom(elt, [a*len[0], b*len[1], c*len[2]]));
+			var cell = new Molecule;
+			cell.addAtom(new Atom(elt, [0, 0, 0]));
+			cell.setLattice([[len[0], 0, 0], [0, len[1], 0], [0, 0, len[2]]]);
+			var molecule = cell.supercell(cnt[0], cnt[1], cnt[2]);
 			this._fromMoleculeObject_(db, molecule, "crystal cubic: len="+len+" cnt="+cnt);
 			db.close();
 		},
 		crystalCcp: function(elt, len, cnt) { // cubic close-packed
 			var engine = require("calc-nwchem").create();
 			var db = actions.db.open();
-			var molecule = new Molecule;
-			for (var a = 0; a < cnt[0]; a++)
-				for (var b = 0; b < cnt[1]; b++)
-					for (var c = 0; c < cnt[2]; c++) {
-						molecule.addAtom(new Atom(elt, [a*len[0], b*len[1], c*len[2]]));
-						molecule.addAtom(new Atom(elt, [a*len[0] + 0,        b*len[1] + len[1]/2, c*len[2] + len[2]/2]));
-						molecule.addAtom(new Atom(elt, [a*len[0] + len[0]/2, b*len[1] + 0,        c*len[2] + len[2]/2]));
-						molecule.addAtom(new Atom(elt, [a*len[0] + len[0]/2, b*len[1] + len[1]/2, c*len[2] + 0]));
-					}
+			var cell = new Molecule;
+			cell.addAtom(new Atom(elt, [0,        0,        0]));
+			cell.addAtom(new Atom(elt, [0,        len[1]/2, len[2]/2]));
+			cell.addAtom(new Atom(elt, [len[0]/2, 0,        len[2]/2]));
+			cell.addAtom(new Atom(elt, [len[0]/2, len[1]/2, 0]));
+			cell.setLattice([[len[0], 0, 0], [0, len[1], 0], [0, 0, len[2]]]);
+			var molecule = cell.supercell(cnt[0], cnt[1], cnt[2]);
 			this._fromMoleculeObject_(db, molecule, "crystal ccp: len="+len+" cnt="+cnt);
 			db.close();
 		},
@@ -419,9 +416,7 @@ function main(args) {
 					atoms.push([elt, [x,y,z]]);
 					return false; // continue
 				});
-				var atomArgs = [];
-				for (var i = 0; i < atoms.length; i++)
-					atomArgs.push(argsMapper.computeArguments(i, atoms));
+				var atomArgs = argsMapper.computeArgumentsForAll(atoms);
 				json.push([atomArgs, energyValue]);
 			});
 			// write the file
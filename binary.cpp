@@ -211,6 +211,12 @@ void xnewo(js_State *J, Binary *b) {
   });
 }
 
+void xnewoView(js_State *J, Binary *b) { // b is owned by some other object
+  js_getglobal(J, TAG_Binary);
+  js_getproperty(J, -1, "prototype");
+  js_newuserdata(J, TAG_Binary, b, nullptr/*finalize*/);
+}
+
 void init(js_State *J) {
   JsSupport::beginDefineClass(J, TAG_Binary, [](js_State *J) {
     AssertNargsRange(0,1)
@@ -239,17 +245,20 @@ void init(js_State *J) {
     }, 0)
     ADD_METHOD_CPP(Binary, resize, {
       AssertNargs(1)
+      AssertResizable("Binary.resize")
       GetArg(Binary, 0)->resize(GetArgUInt32(1));
       ReturnVoid(J);
     }, 1)
     ADD_METHOD_CPP(Binary, clear, {
       AssertNargs(0)
+      AssertResizable("Binary.clear")
       GetArg(Binary, 0)->clear();
       ReturnVoid(J);
     }, 0)
     // appendXx methods
     ADD_METHOD_CPP(Binary, append, {
       AssertNargs(1)
+      AssertResizable("Binary.append")
       auto b = GetArg(Binary, 0);
       auto b1 = GetArg(Binary, 1);
       b->insert(b->end(), b1->begin(), b1->end());
@@ -257,6 +266,7 @@ void init(js_State *J) {
     }, 1)
     ADD_METHOD_CPP(Binary, appendRange, { // CAVEAT doesn't check argument #2 (offBegin) and argument #3 (offEnd) for the range to be in the argument 
       AssertNargs(3)
+      AssertResizable("Binary.appendRange")
       auto b = GetArg(Binary, 0);
       auto b1 = GetArg(Binary, 1);
       b->insert(b->end(), b1->begin()+GetArgUInt32(2), b1->begin()+GetArgUInt32(3));
@@ -264,11 +274,13 @@ void init(js_State *J) {
     }, 3)
     ADD_METHOD_CPP(Binary, appendByte, { // appends the 'int' value as bytes
       AssertNargs(1)
+      AssertResizable("Binary.appendByte")
       GetArg(Binary, 0)->push_back((uint8_t)GetArgUInt32(1));
       ReturnVoid(J);
     }, 1)
     ADD_METHOD_CPP(Binary, appendString, {
       AssertNargs(1)
+      AssertResizable("Binary.appendString")
       auto b = GetArg(Binary, 0);
       auto str = GetArgString(1);
       b->insert(b->end(), str.begin(), str.end());
@@ -276,47 +288,56 @@ void init(js_State *J) {
     }, 1)
     ADD_METHOD_CPP(Binary, appendInt, { // appends the 'int' value as bytes
       AssertNargs(1)
+      AssertResizable("Binary.appendInt")
       Append(*GetArg(Binary, 0), GetArgInt32(1));
       ReturnVoid(J);
     }, 1)
     ADD_METHOD_CPP(Binary, appendUInt, { // appends the 'unsigned' value as bytes
       AssertNargs(1)
+      AssertResizable("Binary.appendUInt")
       Append(*GetArg(Binary, 0), GetArgUInt32(1));
       ReturnVoid(J);
     }, 1)
     ADD_METHOD_CPP(Binary, appendFloat4, { // appends the 'float' value as bytes
       AssertNargs(1)
+      AssertResizable("Binary.appendFloat4")
       Append(*GetArg(Binary, 0), (float)GetArgFloat(1));
       ReturnVoid(J);
     }, 1)
     ADD_METHOD_CPP(Binary, appendFloat8, { // appends the 'double' value as bytes
       AssertNargs(1)
+      AssertResizable("Binary.appendFloat8")
       Append(*GetArg(Binary, 0), (double)GetArgFloat(1));
       ReturnVoid(J);
     }, 1)
     // putXx methods
     ADD_METHOD_CPP(Binary, putByte, {
       AssertNargs(2)
+      AssertWritable("Binary.putByte")
       Put(J, *GetArg(Binary, 0), GetArgUInt32(1), (uint8_t)GetArgUInt32(2));
       ReturnVoid(J);
     }, 2)
     ADD_METHOD_CPP(Binary, putInt, {
       AssertNargs(2)
+      AssertWritable("Binary.putInt")
       Put(J, *GetArg(Binary, 0), GetArgUInt32(1), GetArgInt32(2));
       ReturnVoid(J);
     }, 2)
     ADD_METHOD_CPP(Binary, putUInt, {
       AssertNargs(2)
+      AssertWritable("Binary.putUInt")
       Put(J, *GetArg(Binary, 0), GetArgUInt32(1), GetArgUInt32(2));
       ReturnVoid(J);
     }, 2)
     ADD_METHOD_CPP(Binary, putFloat4, {
       AssertNargs(2)
+      AssertWritable("Binary.putFloat4")
       Put(J, *GetArg(Binary, 0), GetArgUInt32(1), (float)GetArgFloat(2));
       ReturnVoid(J);
     }, 2)
     ADD_METHOD_CPP(Binary, putFloat8, {
       AssertNargs(2)
+      AssertWritable("Binary.putFloat8")
       Put(J, *GetArg(Binary, 0), GetArgUInt32(1), (double)GetArgFloat(2));
       ReturnVoid(J);
     }, 2)
@@ -356,6 +377,7 @@ void init(js_State *J) {
     // sort
     ADD_METHOD_CPP(Binary, sortAreasByFloat4Field, {
       AssertNargs(3)
+      AssertWritable("Binary.sortAreasByFloat4Field")
       Sort<float>(J,
         *GetArg(Binary, 0),
         GetArgUInt32(1), // areaSize
@@ -366,6 +388,7 @@ void init(js_State *J) {
     }, 3)
     ADD_METHOD_CPP(Binary, sortAreasByFloat8Field, {
       AssertNargs(3)
+      AssertWritable("Binary.sortAreasByFloat8Field")
       Sort<double>(J,
         *GetArg(Binary, 0),
         GetArgUInt32(1), // areaSize
@@ -439,6 +462,7 @@ void init(js_State *J) {
     }, 4)
     ADD_METHOD_CPP(Binary, mulScalarPlusVec3Float4, {
       AssertNargs(4)
+      AssertWritable("Binary.mulScalarPlusVec3Float4")
       MulScalarPlusVec3<float>(J,
         *GetArg(Binary, 0),
         GetArgUInt32(1),                                  // leading
@@ -450,6 +474,7 @@ void init(js_State *J) {
     }, 4)
     ADD_METHOD_CPP(Binary, mulScalarPlusVec3Float8, {
       AssertNargs(4)
+      AssertWritable("Binary.mulScalarPlusVec3Float8")
       MulScalarPlusVec3<double>(J,
         *GetArg(Binary, 0),
         GetArgUInt32(1), // leading
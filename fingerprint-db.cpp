@@ -0,0 +1,159 @@
+#include "fingerprint-db.h"
+#include "thread-pool.h"
+#include "util.h"
+
+#include <algorithm>
+
+/// local helpers
+
+typedef std::pair<double,unsigned> Hit; // similarity, entry
+
+static bool isBetter(const Hit &h1, const Hit &h2) { // ties go to the lower index so that results don't depend on the number of threads
+  return h1.first > h2.first || (h1.first == h2.first && h1.second < h2.second);
+}
+
+static unsigned popcount(const FingerprintDb::Fingerprint &fp) {
+  unsigned cnt = 0;
+  for (auto w : fp)
+    cnt += __builtin_popcountll(w);
+  return cnt;
+}
+
+struct Scan {
+  const uint64_t *qfp;       // query fingerprint
+  unsigned        qpop;      // its bit count
+  const uint64_t *bits;      // fingerprints of the entries
+  const unsigned *popcounts;
+  unsigned        k;
+}; // Scan
+
+// keeps the k best hits of the entries eb..ee-1 in the heap with the worst one on the top,
+// the fixed-length inner loop is unrolled by the compiler into the popcount instructions
+static inline __attribute__((always_inline)) void scanRange(const Scan &s, unsigned eb, unsigned ee, std::vector<Hit> &top) {
+  for (unsigned e = eb; e < ee; e++) {
+    auto pop = s.popcounts[e];
+    // the similarity can't exceed min(pop,qpop)/max(pop,qpop), skip entries that can't make it into the top
+    if (top.size() == s.k && (pop == 0 && s.qpop == 0 ? 0. : double(std::min(pop, s.qpop))/std::max(pop, s.qpop)) <= top.front().first)
+      continue;
+    auto fp = s.bits + size_t(e)*FingerprintDb::NUM_WORDS;
+    unsigned common = 0;
+    for (unsigned w = 0; w < FingerprintDb::NUM_WORDS; w++)
+      common += __builtin_popcountll(s.qfp[w] & fp[w]);
+    auto uni = s.qpop + pop - common;
+    Hit hit(uni ? double(common)/uni : 0., e);
+    if (top.size() < s.k) {
+      top.push_back(hit);
+      std::push_heap(top.begin(), top.end(), isBetter);
+    } else if (isBetter(hit, top.front())) {
+      std::pop_heap(top.begin(), top.end(), isBetter);
+      top.back() = hit;
+      std::push_heap(top.begin(), top.end(), isBetter);
+    }
+  }
+}
+
+static void scanRangeGeneric(const Scan &s, unsigned eb, unsigned ee, std::vector<Hit> &top) {
+  scanRange(s, eb, ee, top);
+}
+
+#if defined(__x86_64__)
+__attribute__((target("popcnt")))
+static void scanRangePopcnt(const Scan &s, unsigned eb, unsigned ee, std::vector<Hit> &top) { // the build doesn't assume the popcnt instruction
+  scanRange(s, eb, ee, top);
+}
+#endif
+
+static void scan(const Scan &s, unsigned eb, unsigned ee, std::vector<Hit> &top) {
+#if defined(__x86_64__)
+  static const bool havePopcnt = __builtin_cpu_supports("popcnt");
+  if (havePopcnt) {
+    scanRangePopcnt(s, eb, ee, top);
+    return;
+  }
+#endif
+  scanRangeGeneric(s, eb, ee, top);
+}
+
+/// FingerprintDb
+
+FingerprintDb::FingerprintDb() {
+}
+
+unsigned FingerprintDb::add(const Molecule *m, const std::string &id) {
+  Fingerprint fp;
+  computeFingerprint(m, fp);
+  bits.insert(bits.end(), fp.begin(), fp.end());
+  popcounts.push_back(popcount(fp));
+  ids.push_back(id);
+  return ids.size() - 1;
+}
+
+std::vector<std::pair<unsigned,double>> FingerprintDb::searchTopK(const Molecule *m, unsigned k, unsigned nthreads) const {
+  Fingerprint fp;
+  computeFingerprint(m, fp);
+  return searchTopK(fp, k, nthreads);
+}
+
+std::vector<std::pair<unsigned,double>> FingerprintDb::searchTopK(const Fingerprint &fp, unsigned k, unsigned nthreads) const {
+  enum {CHUNK = 16384}; // entries per task
+  std::vector<std::pair<unsigned,double>> res;
+  unsigned n = size();
+  if (k == 0 || n == 0)
+    return res;
+
+  // chunks are scanned in parallel, each keeps its own best hits
+  Scan s = {fp.data(), popcount(fp), bits.data(), popcounts.data(), k};
+  unsigned nchunks = (n + CHUNK - 1)/CHUNK;
+  std::vector<std::vector<Hit>> tops(nchunks);
+  ThreadPool::get().parallelFor(nchunks, nthreads, [&s,&tops,n](unsigned ch) {
+    tops[ch].reserve(std::min<unsigned>(s.k, CHUNK));
+    scan(s, ch*CHUNK, std::min<unsigned>(n, (ch + 1)*CHUNK), tops[ch]);
+  });
+
+  // merge
+  std::vector<Hit> all;
+  for (auto &top : tops)
+    all.insert(all.end(), top.begin(), top.end());
+  auto cnt = std::min<size_t>(k, all.size());
+  std::partial_sort(all.begin(), all.begin() + cnt, all.end(), isBetter);
+  for (unsigned i = 0; i < cnt; i++)
+    res.push_back({all[i].second, all[i].first});
+  return res;
+}
+
+void FingerprintDb::computeFingerprint(const Molecule *m, Fingerprint &fp) {
+  auto &graph = m->getBondGraph();
+  auto n = m->numAtoms();
+  std::vector<uint64_t> c(n), nc(n), buf;
+  fp.fill(0);
+  auto setBit = [&fp](uint64_t h) {
+    h %= NUM_BITS;
+    fp[h/64] |= uint64_t(1) << (h%64);
+  };
+
+  // atoms themselves, then their neighborhoods growing by one bond on every iteration
+  for (unsigned a = 0; a < n; a++)
+    setBit(c[a] = Util::mix64((uint64_t(m->elements[a]) << 32) + graph.degree(a) + 1));
+  for (unsigned r = 1; r <= RADIUS; r++) {
+    for (unsigned a = 0; a < n; a++) {
+      buf.clear();
+      for (auto nb : graph.neighbors(a))
+        buf.push_back(c[nb]);
+      std::sort(buf.begin(), buf.end());
+      auto h = Util::mix64(c[a] + r);
+      for (auto nbc : buf)
+        h = Util::mix64(h ^ nbc);
+      setBit(nc[a] = h);
+    }
+    c.swap(nc);
+  }
+}
+
+double FingerprintDb::tanimoto(const Fingerprint &fp1, const Fingerprint &fp2) {
+  unsigned common = 0, uni = 0;
+  for (unsigned w = 0; w < NUM_WORDS; w++) {
+    common += __builtin_popcountll(fp1[w] & fp2[w]);
+    uni += __builtin_popcountll(fp1[w] | fp2[w]);
+  }
+  return uni ? double(common)/uni : 0.;
+}
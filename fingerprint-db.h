@@ -0,0 +1,34 @@
+#pragma once
+
+#include "molecule.h"
+
+#include <string>
+#include <vector>
+#include <array>
+#include <utility>
+#include <cstdint>
+
+//
+// FingerprintDb: fixed-length bit fingerprints of molecules stored contiguously for the similarity search,
+//                bits are set by the hashes of the bonded neighborhoods of all atoms up to RADIUS bonds away (ECFP-like)
+//
+
+class FingerprintDb {
+public:
+  enum {NUM_BITS = 1024, NUM_WORDS = NUM_BITS/64, RADIUS = 2};
+  typedef std::array<uint64_t, NUM_WORDS> Fingerprint;
+private: // data
+  std::vector<uint64_t>    bits;      // NUM_WORDS per entry
+  std::vector<unsigned>    popcounts; // per entry
+  std::vector<std::string> ids;
+public: // constr/iface
+  FingerprintDb();
+  unsigned add(const Molecule *m, const std::string &id); // returns the index of the entry
+  size_t size() const {return ids.size();}
+  const std::string& getId(unsigned e) const {return ids[e];}
+  // k entries most similar to m by the Tanimoto (Jaccard) coefficient, the best first, nthreads=0 uses all CPUs
+  std::vector<std::pair<unsigned,double>> searchTopK(const Molecule *m, unsigned k, unsigned nthreads) const;
+  std::vector<std::pair<unsigned,double>> searchTopK(const Fingerprint &fp, unsigned k, unsigned nthreads) const;
+  static void computeFingerprint(const Molecule *m, Fingerprint &fp);
+  static double tanimoto(const Fingerprint &fp1, const Fingerprint &fp2);
+}; // FingerprintDb
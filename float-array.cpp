@@ -117,6 +117,18 @@ static void xnewo(js_State *J, FloatArray<Float> *d) {
  });
 }
 
+std::vector<double>* xnewoEmpty8(js_State *J) { // new owned empty array, the caller fills it through the returned pointer while it's on the stack
+  auto d = new FloatArray<double>;
+  xnewo(J, d);
+  return d;
+}
+
+void xnewoView8(js_State *J, std::vector<double> *d) { // d is owned by some other object, FloatArray adds no data members to std::vector
+  js_getglobal(J, tag<double>());
+  js_getproperty(J, -1, "prototype");
+  js_newuserdata(J, tag<double>(), (FloatArray<double>*)d, nullptr/*finalize*/);
+}
+
 template<typename Float>
 void init(js_State *J) {
   JsSupport::beginDefineClass(J, tag<Float>(), [](js_State *J) {
@@ -148,16 +160,19 @@ void init(js_State *J) {
     }, 0)
     ADD_METHOD_CPPc(cls<Float>(), resize, {
       AssertNargs(1)
+      AssertResizable("FloatArray.resize")
       GetArgExt(FloatArray<Float>, tag<Float>(), 0)->resize(GetArgUInt32(1));
       ReturnVoid(J);
     }, 1)
     ADD_METHOD_CPPc(cls<Float>(), append, {
       AssertNargs(1)
+      AssertResizable("FloatArray.append")
       GetArgExt(FloatArray<Float>, tag<Float>(), 0)->push_back(GetArgFloat(1));
       ReturnVoid(J);
     }, 1)
     ADD_METHOD_CPPc(cls<Float>(), append2, {
       AssertNargs(2)
+      AssertResizable("FloatArray.append2")
       auto a = GetArgExt(FloatArray<Float>, tag<Float>(), 0);
       a->push_back(GetArgFloat(1));
       a->push_back(GetArgFloat(2));
@@ -165,6 +180,7 @@ void init(js_State *J) {
     }, 2)
     ADD_METHOD_CPPc(cls<Float>(), append3, {
       AssertNargs(3)
+      AssertResizable("FloatArray.append3")
       auto a = GetArgExt(FloatArray<Float>, tag<Float>(), 0);
       a->push_back(GetArgFloat(1));
       a->push_back(GetArgFloat(2));
@@ -173,6 +189,7 @@ void init(js_State *J) {
     }, 3)
     ADD_METHOD_CPPc(cls<Float>(), append4, {
       AssertNargs(4)
+      AssertResizable("FloatArray.append4")
       auto a = GetArgExt(FloatArray<Float>, tag<Float>(), 0);
       a->push_back(GetArgFloat(1));
       a->push_back(GetArgFloat(2));
@@ -186,21 +203,25 @@ void init(js_State *J) {
     }, 1)
     ADD_METHOD_CPPc(cls<Float>(), set, {
       AssertNargs(2)
+      AssertWritable("FloatArray.set")
       (*GetArgExt(FloatArray<Float>, tag<Float>(), 0))[GetArgUInt32(1)] = GetArgFloat(2);
       ReturnVoid(J);
     }, 2)
     ADD_METHOD_CPPc(cls<Float>(), muln, {
       AssertNargs(1)
+      AssertWritable("FloatArray.muln")
       GetArgExt(FloatArray<Float>, tag<Float>(), 0)->muln(GetArgFloat(1));
       ReturnVoid(J);
     }, 1)
     ADD_METHOD_CPPc(cls<Float>(), divn, {
       AssertNargs(1)
+      AssertWritable("FloatArray.divn")
       GetArgExt(FloatArray<Float>, tag<Float>(), 0)->divn(GetArgFloat(1));
       ReturnVoid(J);
     }, 1)
     ADD_METHOD_CPPc(cls<Float>(), mulMat3PlusVec3, {
       AssertNargs(2)
+      AssertWritable("FloatArray.mulMat3PlusVec3")
       GetArgExt(FloatArray<Float>, tag<Float>(), 0)->mulMat3PlusVec3(CastGetArgMat3x3(1), CastGetArgVec3(2));
       ReturnVoid(J);
     }, 2)
@@ -210,6 +231,7 @@ void init(js_State *J) {
     }, 2)
     ADD_METHOD_CPPc(cls<Float>(), mulScalarPlusVec3, {
       AssertNargs(2)
+      AssertWritable("FloatArray.mulScalarPlusVec3")
       GetArgExt(FloatArray<Float>, tag<Float>(), 0)->mulScalarPlusVec3(CastGetArgVec3(1), CastGetArgVec3(2));
       ReturnVoid(J);
     }, 2)
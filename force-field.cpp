@@ -0,0 +1,284 @@
+#include "force-field.h"
+#include "neighbor-grid.h"
+#include "Vec3-ext.h"
+#include "xerror.h"
+
+#include <cmath>
+#include <algorithm>
+
+/// parameters
+
+namespace {
+
+struct ElementParams {
+  Float x; // UFF van der Waals distance (the LJ minimum)
+  Float D; // UFF well depth
+}; // ElementParams
+
+const std::vector<ElementParams>& elementParams() { // by element, from Rappe et al., J. Am. Chem. Soc. 114, 10024 (1992), zeros for the unsupported elements
+  static const std::vector<ElementParams> table = []() {
+    std::vector<ElementParams> t(Xe+1, ElementParams{0, 0});
+    t[H]  = {2.886, 0.044}; t[He] = {2.362, 0.056};
+    t[Li] = {2.451, 0.025}; t[Be] = {2.745, 0.085}; t[B]  = {4.083, 0.180}; t[C]  = {3.851, 0.105};
+    t[N]  = {3.660, 0.069}; t[O]  = {3.500, 0.060}; t[F]  = {3.364, 0.050}; t[Ne] = {3.243, 0.042};
+    t[Na] = {2.983, 0.030}; t[Mg] = {3.021, 0.111}; t[Al] = {4.499, 0.505}; t[Si] = {4.295, 0.402};
+    t[P]  = {4.147, 0.305}; t[S]  = {4.035, 0.274}; t[Cl] = {3.947, 0.227}; t[Ar] = {3.868, 0.185};
+    t[K]  = {3.812, 0.035}; t[Ca] = {3.399, 0.238}; t[Sc] = {3.295, 0.019}; t[Ti] = {3.175, 0.017};
+    t[V]  = {3.144, 0.016}; t[Cr] = {3.023, 0.015}; t[Mn] = {2.961, 0.013}; t[Fe] = {2.912, 0.013};
+    t[Co] = {2.872, 0.014}; t[Ni] = {2.834, 0.015}; t[Cu] = {3.495, 0.005}; t[Zn] = {2.763, 0.124};
+    t[Ga] = {4.383, 0.415}; t[Ge] = {4.280, 0.379}; t[As] = {4.230, 0.309}; t[Se] = {4.205, 0.291};
+    t[Br] = {4.189, 0.251}; t[Kr] = {4.141, 0.220}; t[I]  = {4.500, 0.339}; t[Xe] = {4.404, 0.332};
+    return t;
+  }();
+  return table;
+}
+
+const Float kBond     = 350;     // kcal/mol/A^2: E = k*(r-r0)^2
+const Float kAngle    = 50;      // kcal/mol/rad^2: E = k*(theta-theta0)^2
+const Float Vsp3sp3   = 2.119;   // torsion barriers per bond, kcal/mol
+const Float Vsp2sp2   = 5.0;
+const Float Vsp2sp3   = 1.0;
+const Float kCoulomb  = 332.0637; // kcal/mol*A/e^2
+
+unsigned numLonePairs(Element elt) { // of the neutral atom
+  switch (elt) {
+  case N: case P: case As:       return 1;
+  case O: case S: case Se:       return 2;
+  case F: case Cl: case Br: case I: return 3;
+  default:                       return 0;
+  }
+}
+
+unsigned hybridization(Element elt, unsigned degree) { // 1=sp, 2=sp2, 3=sp3, from the steric number
+  auto steric = degree + numLonePairs(elt);
+  return steric <= 2 ? 1 : steric == 3 ? 2 : 3;
+}
+
+Float equilibriumAngle(Element elt, unsigned hyb) { // degrees
+  if (hyb == 3)
+    switch (elt) { // lone pairs compress the angle
+    case N:  return 106.7;
+    case O:  return 104.51;
+    case P:  return 93.8;
+    case S:  return 92.1;
+    case As: return 92.1;
+    case Se: return 90.6;
+    default: return 109.47;
+    }
+  return hyb == 2 ? 120 : 180;
+}
+
+}
+
+/// ForceField
+
+ForceField::ForceField(const Molecule &m, const Params &newParams)
+: numAtoms(m.numAtoms()), params(newParams) {
+  if (m.isPeriodic())
+    ERROR("ForceField: periodic molecules aren't supported")
+  if (!params.charges.empty() && params.charges.size() != numAtoms)
+    ERROR("ForceField: charges array has " << params.charges.size() << " elements, expected " << numAtoms)
+  if (!(params.cutoff > 0))
+    ERROR("ForceField: cutoff should be positive, got " << params.cutoff)
+
+  auto &table = elementParams();
+  for (auto e : m.elements) {
+    if (e >= table.size() || table[e].x == 0)
+      ERROR("ForceField: no parameters for the element #" << unsigned(e))
+    elements.push_back(Element(e));
+  }
+
+  auto &graph = m.getBondGraph();
+  std::vector<unsigned> hyb(numAtoms);
+  for (unsigned a = 0; a < numAtoms; a++)
+    hyb[a] = hybridization(elements[a], graph.degree(a));
+  auto setScale = [this](unsigned a1, unsigned a2, Float scale) {
+    auto it = pairScales.emplace(pairKey(a1, a2), scale).first;
+    it->second = std::min(it->second, scale); // small rings: the closest relation wins
+  };
+
+  // bonds
+  for (unsigned a1 = 0; a1 < numAtoms; a1++)
+    for (auto a2 : graph.neighbors(a1))
+      if (a1 < a2) {
+        bonds.push_back(Bond{a1, a2, Atom::atomBondAvgDistance(elements[a1], elements[a2]), kBond});
+        setScale(a1, a2, 0);
+      }
+
+  // angles
+  for (unsigned a2 = 0; a2 < numAtoms; a2++) {
+    auto nbrs = graph.neighbors(a2);
+    auto theta0 = Vec3::degToRad(equilibriumAngle(elements[a2], hyb[a2]));
+    for (auto i1 = nbrs.begin(); i1 != nbrs.end(); i1++)
+      for (auto i3 = i1+1; i3 != nbrs.end(); i3++) {
+        angles.push_back(Angle{*i1, a2, *i3, theta0, kAngle});
+        setScale(*i1, *i3, 0);
+      }
+  }
+
+  // torsions about the bonds between the sp2/sp3 atoms, the barrier is shared among the torsions of the bond
+  for (auto &b : bonds) {
+    auto h2 = hyb[b.a1], h3 = hyb[b.a2];
+    auto d2 = graph.degree(b.a1), d3 = graph.degree(b.a2);
+    if (d2 < 2 || d3 < 2)
+      continue;
+    Float V;
+    unsigned n;
+    Float phi0;
+    if (h2 == 3 && h3 == 3)
+      {V = Vsp3sp3; n = 3; phi0 = 180;}
+    else if (h2 == 2 && h3 == 2)
+      {V = Vsp2sp2; n = 2; phi0 = 180;}
+    else if ((h2 == 2 && h3 == 3) || (h2 == 3 && h3 == 2))
+      {V = Vsp2sp3; n = 6; phi0 = 0;}
+    else
+      continue; // sp atoms don't have the torsion term
+    V /= (d2-1)*(d3-1);
+    auto cosNphi0 = std::round(std::cos(n*Vec3::degToRad(phi0))); // +1 or -1
+    for (auto a1 : graph.neighbors(b.a1))
+      if (a1 != b.a2)
+        for (auto a4 : graph.neighbors(b.a2))
+          if (a4 != b.a1 && a4 != a1) { // 3-rings have no torsions
+            torsions.push_back(Torsion{a1, b.a1, b.a2, a4, V, n, cosNphi0});
+            setScale(a1, a4, params.scale14);
+          }
+  }
+}
+
+ForceField::Energy ForceField::compute(const Vec3 *pos, Vec3 *grad) const {
+  return compute(pos, findPairs(pos, params.cutoff), grad);
+}
+
+ForceField::Energy ForceField::compute(const Vec3 *pos, const PairList &pairs, Vec3 *grad) const {
+  if (grad)
+    std::fill(grad, grad + numAtoms, Vec3(0,0,0));
+  Energy e;
+  e.bond = computeBonds(pos, grad);
+  e.angle = computeAngles(pos, grad);
+  e.torsion = computeTorsions(pos, grad);
+  computeNonBonded(pos, pairs, grad, e.vdw, e.coulomb);
+  return e;
+}
+
+ForceField::Energy ForceField::compute(const Molecule &m, std::vector<Vec3> *grad) const {
+  if (m.numAtoms() != numAtoms)
+    ERROR("ForceField: the molecule has " << m.numAtoms() << " atoms, the force field was created for " << numAtoms << " atoms")
+  if (m.isPeriodic())
+    ERROR("ForceField: periodic molecules aren't supported")
+  if (grad)
+    grad->resize(numAtoms);
+  return compute(m.positions().begin(), grad ? grad->data() : nullptr);
+}
+
+ForceField::PairList ForceField::findPairs(const Vec3 *pos, Float range) const {
+  PairList pairs;
+  if (numAtoms < 2)
+    return pairs;
+  auto &table = elementParams();
+  bool withCharges = !params.charges.empty();
+  NeighborGrid grid(std::vector<Vec3>(pos, pos + numAtoms), range);
+  grid.forEachPairWithin(range, [&](unsigned a1, unsigned a2, Float) {
+    Float scale = 1;
+    auto it = pairScales.find(pairKey(a1, a2));
+    if (it != pairScales.end()) {
+      scale = it->second;
+      if (scale == 0)
+        return;
+    }
+    auto &p1 = table[elements[a1]], &p2 = table[elements[a2]];
+    pairs.push_back(Pair{a1, a2,
+                         (p1.x + p2.x)*(p1.x + p2.x)/4,
+                         scale*std::sqrt(p1.D*p2.D),
+                         withCharges ? scale*kCoulomb*params.charges[a1]*params.charges[a2]/params.dielectric : 0});
+  });
+  return pairs;
+}
+
+/// internals
+
+Float ForceField::computeBonds(const Vec3 *pos, Vec3 *grad) const {
+  Float E = 0;
+  for (auto &b : bonds) {
+    auto r = pos[b.a2] - pos[b.a1];
+    auto d = r.len();
+    auto dr = d - b.r0;
+    E += b.k*dr*dr;
+    if (grad && d > 0) {
+      auto g = r*(2*b.k*dr/d);
+      grad[b.a1] -= g;
+      grad[b.a2] += g;
+    }
+  }
+  return E;
+}
+
+Float ForceField::computeAngles(const Vec3 *pos, Vec3 *grad) const {
+  Float E = 0;
+  for (auto &a : angles) {
+    auto u = pos[a.a1] - pos[a.a2];
+    auto v = pos[a.a3] - pos[a.a2];
+    auto lu = u.len(), lv = v.len();
+    if (lu == 0 || lv == 0)
+      continue;
+    auto c = std::max(Float(-1), std::min(Float(1), u*v/(lu*lv)));
+    auto theta = std::acos(c);
+    auto dtheta = theta - a.theta0;
+    E += a.k*dtheta*dtheta;
+    if (grad) {
+      // dtheta/dx = -1/sin(theta) * dcos/dx
+      auto s = std::max(std::sqrt(1 - c*c), Float(1e-8));
+      auto f = -2*a.k*dtheta/s;
+      auto g1 = (v/(lu*lv) - u*(c/(lu*lu)))*f;
+      auto g3 = (u/(lu*lv) - v*(c/(lv*lv)))*f;
+      grad[a.a1] += g1;
+      grad[a.a3] += g3;
+      grad[a.a2] -= g1 + g3;
+    }
+  }
+  return E;
+}
+
+Float ForceField::computeTorsions(const Vec3 *pos, Vec3 *grad) const {
+  Float E = 0;
+  std::array<Vec3,4> dphi;
+  for (auto &t : torsions) {
+    Float phi;
+    if (!Vec3Extra::dihedral(pos[t.a1], pos[t.a2], pos[t.a3], pos[t.a4], phi, grad ? &dphi : nullptr))
+      continue; // collinear atoms: the angle is undefined
+    E += t.V/2*(1 - t.cosNphi0*std::cos(t.n*phi));
+    if (grad) {
+      auto dEdphi = t.V/2*t.cosNphi0*t.n*std::sin(t.n*phi);
+      grad[t.a1] += dphi[0]*dEdphi;
+      grad[t.a2] += dphi[1]*dEdphi;
+      grad[t.a3] += dphi[2]*dEdphi;
+      grad[t.a4] += dphi[3]*dEdphi;
+    }
+  }
+  return E;
+}
+
+void ForceField::computeNonBonded(const Vec3 *pos, const PairList &pairs, Vec3 *grad, Float &vdw, Float &coulomb) const {
+  vdw = 0;
+  coulomb = 0;
+  auto cutoff2 = params.cutoff*params.cutoff;
+  for (auto &p : pairs) {
+    auto r = pos[p.a2] - pos[p.a1];
+    auto dist2 = r.len2();
+    if (dist2 > cutoff2 || dist2 == 0)
+      continue;
+    auto s6 = p.rm2/dist2;
+    s6 = s6*s6*s6;
+    vdw += p.eps*(s6*s6 - 2*s6);
+    auto dEdr_r = 12*p.eps*(s6 - s6*s6)/dist2; // dE/dr / r
+    if (p.qq != 0) {
+      auto Ec = p.qq/std::sqrt(dist2);
+      coulomb += Ec;
+      dEdr_r -= Ec/dist2;
+    }
+    if (grad) {
+      auto g = r*dEdr_r;
+      grad[p.a1] -= g;
+      grad[p.a2] += g;
+    }
+  }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "molecule.h"
+#include "Vec3.h"
+
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <cstdint>
+
+//
+// ForceField: classical molecular mechanics energy and its analytic gradient for fast screening
+//             Terms: bond stretch, angle bend and torsion over the bond graph, Lennard-Jones and Coulomb between non-bonded atoms.
+//             Parameters are generic per element: UFF van der Waals radii and well depths, bond lengths from Atom::atomBondAvgDistance,
+//             equilibrium angles from the degree of the central atom. Energies are in kcal/mol, distances in Angstroms.
+//             The topology is taken from the molecule when the force field is created, coordinates are passed on every evaluation.
+//             Periodic molecules aren't supported: distances aren't minimum images.
+//
+
+class ForceField {
+public:
+  struct Params {
+    Float               cutoff;     // non-bonded interactions beyond it are ignored
+    Float               dielectric;
+    Float               scale14;    // non-bonded interactions of atoms separated by 3 bonds are scaled by it, 1-2 and 1-3 are excluded
+    std::vector<Float>  charges;    // partial charges by atom, no Coulomb term when empty
+    Params() : cutoff(10), dielectric(1), scale14(0.5) { }
+  }; // Params
+  struct Energy {
+    Float bond, angle, torsion, vdw, coulomb;
+    Float total() const {return bond + angle + torsion + vdw + coulomb;}
+  }; // Energy
+  struct Pair { // non-bonded pair with its parameters, the 1-4 scale is applied to them
+    unsigned a1, a2;
+    Float    rm2;        // squared LJ minimum distance
+    Float    eps;        // LJ well depth
+    Float    qq;         // Coulomb factor: E = qq/r
+  }; // Pair
+  typedef std::vector<Pair> PairList;
+private:
+  struct Bond {
+    unsigned a1, a2;
+    Float    r0, k;
+  }; // Bond
+  struct Angle {
+    unsigned a1, a2, a3; // a2 is the central atom
+    Float    theta0, k;  // theta0 in radians
+  }; // Angle
+  struct Torsion {
+    unsigned a1, a2, a3, a4;
+    Float    V;          // E = V/2*(1 - cos(n*phi0)*cos(n*phi))
+    unsigned n;
+    Float    cosNphi0;
+  }; // Torsion
+  unsigned                     numAtoms;
+  Params                       params;
+  std::vector<Element>         elements;
+  std::vector<Bond>            bonds;
+  std::vector<Angle>           angles;
+  std::vector<Torsion>         torsions;
+  std::unordered_map<uint64_t,Float> pairScales; // non-bonded scale for 1-2, 1-3 and 1-4 pairs by pairKey()
+public: // constr/iface
+  ForceField(const Molecule &m, const Params &newParams = Params());
+  unsigned getNumAtoms() const {return numAtoms;}
+  unsigned numBonds() const {return bonds.size();}
+  unsigned numAngles() const {return angles.size();}
+  unsigned numTorsions() const {return torsions.size();}
+  Energy compute(const Vec3 *pos, Vec3 *grad) const; // pos has numAtoms elements, grad is zeroed and filled when it isn't null
+  Energy compute(const Molecule &m, std::vector<Vec3> *grad = nullptr) const; // m should have the same atoms as the one the force field was created from
+  PairList findPairs(const Vec3 *pos, Float range) const; // non-excluded pairs closer than range, found with a cell list
+  Energy compute(const Vec3 *pos, const PairList &pairs, Vec3 *grad) const; // non-bonded terms only over pairs within the cutoff: the Verlet list
+                                                                           // found with range=cutoff+skin stays valid until some atom moves by skin/2
+  Float getCutoff() const {return params.cutoff;}
+private: // internals
+  static uint64_t pairKey(unsigned a1, unsigned a2) {return a1 < a2 ? uint64_t(a1) << 32 | a2 : uint64_t(a2) << 32 | a1;}
+  Float computeBonds(const Vec3 *pos, Vec3 *grad) const;
+  Float computeAngles(const Vec3 *pos, Vec3 *grad) const;
+  Float computeTorsions(const Vec3 *pos, Vec3 *grad) const;
+  void computeNonBonded(const Vec3 *pos, const PairList &pairs, Vec3 *grad, Float &vdw, Float &coulomb) const;
+}; // ForceField
@@ -11,8 +11,8 @@
 #include <bitmap_image.hpp>
 #include <picosha2.h>
 
-static const char *TAG_Image         = "Image";
-static const char *TAG_ImageDrawer   = "ImageDrawer";
+const char *TAG_Image         = "Image"; // non-static: used externally
+const char *TAG_ImageDrawer   = "ImageDrawer"; // non-static: used externally
 extern const char *TAG_FloatArray4; // allow to access the arguments of this type
 extern const char *TAG_FloatArray8; // allow to access the arguments of this type
 extern const char *TAG_Binary;
@@ -9,7 +9,9 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <sys/types.h>
+#if defined(__FreeBSD__)
 #include <sys/sysctl.h>
+#endif
 #include <sys/socket.h> // for SocketApi
 #include <sys/select.h> // for SocketApi
 #include <sys/un.h>     // for SocketApi
@@ -39,10 +41,23 @@
 #include "molecule.h"
 #include "temp-file.h"
 #include "structure-db.h"
+#include "fingerprint-db.h"
+#include "substructure.h"
+#include "peptide-builder.h"
+#include "torsion-tree.h"
+#include "force-field.h"
+#include "optimizer.h"
+#include "molecular-dynamics.h"
+#include "trajectory.h"
+#include "neighbor-grid.h"
+#include "lattice.h"
+#include "xyz-reader.h"
+#include "thread-pool.h"
 #include "tm.h"
 #include "process.h"
 #include "web-io.h"
 #include "op-rmsd.h"
+#include "op-symmetry-functions.h"
 #include "periodic-table-data.h"
 #include "Vec3.h"
 #include "Vec3-ext.h"
@@ -56,8 +71,26 @@ static const char *TAG_Molecule    = "Molecule";
 static const char *TAG_Atom        = "Atom";
 static const char *TAG_TempFile    = "TempFile";
 static const char *TAG_StructureDb = "StructureDb";
+static const char *TAG_FingerprintDb = "FingerprintDb";
+static const char *TAG_Substructure = "Substructure";
+static const char *TAG_PeptideBuilder = "PeptideBuilder";
+static const char *TAG_TorsionTree = "TorsionTree";
+static const char *TAG_ForceField = "ForceField";
+static const char *TAG_MolecularDynamics = "MolecularDynamics";
+static const char *TAG_TrajectoryWriter = "TrajectoryWriter";
+static const char *TAG_TrajectoryReader = "TrajectoryReader";
+static const char *TAG_NeighborGrid = "NeighborGrid";
 
 extern const char *TAG_Binary;
+extern const char *TAG_FloatArray8;
+extern const char *TAG_FloatArray4;
+extern const char *TAG_LAVectorF;
+extern const char *TAG_LAMatrixF;
+extern const char *TAG_LAVectorD;
+extern const char *TAG_LAMatrixD;
+extern const char *TAG_NeuralNetwork;
+extern const char *TAG_Image;
+extern const char *TAG_ImageDrawer;
 
 // helper macros
 #define DbgPrintStackLevel(loc)  std::cout << "DBG JS Stack: @" << loc << " level=" << js_gettop(J) << std::endl
@@ -76,6 +109,7 @@ extern const char *TAG_Binary;
 #define GetArgStringArrayZ(n)       objToTypedArray<std::string,true>(J, n, __func__)
 #define GetArgUnsignedArrayArray(n) objToTypedArray<std::vector<unsigned>>(J, n, __func__)
 #define GetArgFloatArrayArray(n)    objToTypedArray<std::vector<double>>(J, n, __func__)
+#define GetArgFloatArrayArrayZ(n)   objToTypedArray<std::vector<double>,true>(J, n, __func__)
 #define GetArgStringArrayArray(n)   objToTypedArray<std::vector<std::string>>(J, n, __func__)
 #define GetArgMatNxX(n,N)        objToMatNxX<N>(J, n)
 #define GetArgElement(n)         Element(PeriodicTableData::get().elementFromSymbol(GetArgString(n)))
@@ -96,6 +130,7 @@ namespace JsBinding {
 namespace JsBinary {
   extern void init(js_State *J);
   extern void xnewo(js_State *J, Binary *b);
+  extern void xnewoView(js_State *J, Binary *b);
 }
 namespace JsImage {
   extern void init(js_State *J);
@@ -106,9 +141,13 @@ namespace JsImageDrawer {
 namespace JsFloatArray {
   extern void initFloat4(js_State *J);
   extern void initFloat8(js_State *J);
+  extern void xnewoView8(js_State *J, std::vector<double> *d);
+  extern std::vector<double>* xnewoEmpty8(js_State *J);
 }
 namespace JsLinearAlgebra {
   extern void init(js_State *J);
+  extern void xnewo(js_State *J, LAVectorD *v);
+  extern void xnewo(js_State *J, LAMatrixD *m);
 }
 namespace JsNeuralNetwork {
   extern void init(js_State *J);
@@ -123,6 +162,11 @@ static void moleculeFinalize(js_State *J, void *p) {
   delete (Molecule*)p;
 }
 
+static void setViewOwner(js_State *J, int ownerIdx) { // the view object on top references its owner to keep it from being garbage collected
+  js_copy(J, ownerIdx);
+  js_defproperty(J, -2, "owner", JS_READONLY | JS_DONTENUM | JS_DONTCONF);
+}
+
 static void atomFinalize(js_State *J, void *p) {
   auto a = (Atom*)p;
   // delete only unattached atoms, otherwise they are deteled by their Molecule object
@@ -341,7 +385,7 @@ static void init(js_State *J) {
     ADD_METHOD_CPP(Atom, str, {
       AssertNargs(0)
       auto a = GetArg(Atom, 0);
-      Return(J, str(boost::format("atom{%1% elt=%2% pos=%3%}") % a % a->elt % a->pos));
+      Return(J, str(boost::format("atom{%1% elt=%2% pos=%3%}") % a % a->elt % a->pos()));
     }, 0)
     ADD_METHOD_CPP(Atom, isEqual, {
       AssertNargs(1)
@@ -353,11 +397,11 @@ static void init(js_State *J) {
     }, 0)
     ADD_METHOD_CPP(Atom, getPos, {
       AssertNargs(0)
-      Return(J, GetArg(Atom, 0)->pos);
+      Return(J, GetArg(Atom, 0)->pos());
     }, 0)
     ADD_METHOD_CPP(Atom, setPos, {
       AssertNargs(1)
-      GetArg(Atom, 0)->pos = GetArgVec3(1);
+      GetArg(Atom, 0)->pos() = GetArgVec3(1);
       ReturnVoid(J);
     }, 1)
     ADD_METHOD_CPP(Atom, getName, {
@@ -392,6 +436,26 @@ static void init(js_State *J) {
       AssertNargs(1)
       Return(J, GetArg(Atom, 0)->hasBond(GetArg(Atom, 1)));
     }, 1)
+    ADD_METHOD_CPP(Atom, link, { // (other): adds the bond, both atoms should be in the same molecule
+      AssertNargs(1)
+      auto a1 = GetArg(Atom, 0);
+      auto a2 = GetArg(Atom, 1);
+      if (a1 == a2 || !a1->molecule || a1->molecule != a2->molecule)
+        js_typeerror(J, "Atom.link: atoms should be different atoms of the same molecule");
+      if (a1->hasBond(a2))
+        js_typeerror(J, "Atom.link: atoms are already bonded");
+      a1->link(a2);
+      ReturnVoid(J);
+    }, 1)
+    ADD_METHOD_CPP(Atom, unlink, { // (other): removes the bond
+      AssertNargs(1)
+      auto a1 = GetArg(Atom, 0);
+      auto a2 = GetArg(Atom, 1);
+      if (!a1->hasBond(a2))
+        js_typeerror(J, "Atom.unlink: atoms aren't bonded");
+      a1->unlink(a2);
+      ReturnVoid(J);
+    }, 1)
     ADD_METHOD_CPP(Atom, getOtherBondOf3, {
       AssertNargs(2)
       ReturnObj(GetArg(Atom, 0)->getOtherBondOf3(GetArg(Atom,1), GetArg(Atom,2)));
@@ -441,6 +505,55 @@ static void init(js_State *J) {
 
 } // JsAtom
 
+namespace JsNeighborGrid {
+
+static void xnewo(js_State *J, NeighborGrid *g) {
+  js_getglobal(J, TAG_NeighborGrid);
+  js_getproperty(J, -1, "prototype");
+  js_newuserdata(J, TAG_NeighborGrid, g, [](js_State *J, void *p) {
+    delete (NeighborGrid*)p;
+  });
+}
+
+static void init(js_State *J) {
+  JsSupport::beginDefineClass(J, TAG_NeighborGrid, [](js_State *J) {
+    AssertNargs(2)
+    ReturnObj(new NeighborGrid(GetArg(Molecule, 1)->getAtomPositions(), GetArgFloat(2)));
+  });
+  { // methods
+    ADD_METHOD_CPP(NeighborGrid, str, {
+      AssertNargs(0)
+      auto g = GetArg(NeighborGrid, 0);
+      Return(J, str(boost::format("neighbor-grid{points=%1% cells=%2% cellSize=%3%}") % g->numPoints() % g->numCells() % g->getCellSize()));
+    }, 0)
+    ADD_METHOD_CPP(NeighborGrid, numPoints, {
+      AssertNargs(0)
+      Return(J, GetArg(NeighborGrid, 0)->numPoints());
+    }, 0)
+    ADD_METHOD_CPP(NeighborGrid, findWithin, { // (pos, radius) -> sorted atom indexes
+      AssertNargs(2)
+      Return(J, GetArg(NeighborGrid, 0)->findWithin(GetArgVec3(1), GetArgFloat(2)));
+    }, 2)
+    ADD_METHOD_CPP(NeighborGrid, findNeighbors, { // (atomIdx, radius) -> sorted atom indexes, excluding the atom itself
+      AssertNargs(2)
+      auto g = GetArg(NeighborGrid, 0);
+      auto idx = GetArgUInt32(1);
+      if (idx >= g->numPoints())
+        JS_ERROR("atom index " << idx << " is out of range, the grid has " << g->numPoints() << " points")
+      auto res = g->findWithin(g->getPoint(idx), GetArgFloat(2));
+      res.erase(std::find(res.begin(), res.end(), idx));
+      Return(J, res);
+    }, 2)
+    ADD_METHOD_CPP(NeighborGrid, findPairs, { // (radius) -> sorted [idx1,idx2] pairs with idx1<idx2
+      AssertNargs(1)
+      Return(J, GetArg(NeighborGrid, 0)->findPairsWithin(GetArgFloat(1)));
+    }, 1)
+  }
+  JsSupport::endDefineClass(J);
+}
+
+} // JsNeighborGrid
+
 namespace JsMolecule {
 
 namespace helpers {
@@ -507,6 +620,43 @@ static void pushAaBackboneAsJsObjectZ(js_State *J, const Molecule::AaBackbone &a
     js_pushnull(J); // null is returned when it is not found
 }
 
+static void pushUnsignedsAsBinary(js_State *J, const std::vector<unsigned> &v) { // 'unsigned' values as bytes, like Binary.appendUInt
+  JsBinary::xnewo(J, Util::createContainerFromBufferOfDifferentType<std::vector<unsigned>, Binary>(v));
+}
+
+static std::vector<unsigned> readUnsignedsFromBinary(js_State *J, int argno, const char *fname) {
+  auto b = (Binary*)js_touserdata(J, argno, TAG_Binary);
+  if (b->size() % sizeof(unsigned) != 0)
+    JS_ERROR(fname << ": Binary size " << b->size() << " isn't a multiple of " << sizeof(unsigned))
+  std::unique_ptr<std::vector<unsigned>> v(Util::createContainerFromBufferOfDifferentType<Binary, std::vector<unsigned>>(*b));
+  return *v;
+}
+
+static double rmsd(js_State *J, const Molecule &m1, const Molecule &m2) { // Op::rmsd over the coords arrays
+  if (m1.coords.size() != m2.coords.size())
+    JS_ERROR("Molecule.rmsd: molecules have different numbers of atoms: " << m1.numAtoms() << " and " << m2.numAtoms())
+  std::valarray<double> v1(m1.coords.data(), m1.coords.size());
+  std::valarray<double> v2(m2.coords.data(), m2.coords.size());
+  return Op::rmsd(v1, v2);
+}
+
+static std::array<Vec3,3> readLattice(js_State *J, int argno) { // [a, b, c]: the lattice vectors
+  auto m = GetArgMat3x3(argno);
+  return {{m[0], m[1], m[2]}};
+}
+
+static std::vector<std::string> listElements(const Molecule &m) {
+  std::array<bool,256> seen;
+  seen.fill(false);
+  std::vector<std::string> res;
+  for (auto e : m.elements)
+    if (!seen[e]) {
+      seen[e] = true;
+      res.push_back(PeriodicTableData::get()(e).symbol);
+    }
+  return res;
+}
+
 static std::vector<Molecule::AaBackbone>* readAaBackboneArray(js_State *J, int argno) {
   std::unique_ptr<std::vector<Molecule::AaBackbone>> aaBackboneArray(new std::vector<Molecule::AaBackbone>);
   {
@@ -557,6 +707,61 @@ static void init(js_State *J) {
       AssertNargs(1)
       ReturnObjExt(Atom, GetArg(Molecule, 0)->getAtom(GetArgUInt32(1)));
     }, 1)
+    ADD_METHOD_CPP(Molecule, getCoordsView, { // FloatArray8 sharing the coordinates with the molecule: x,y,z for each atom, it can't be resized
+      AssertNargs(0)
+      JsFloatArray::xnewoView8(J, &GetArg(Molecule, 0)->coords);
+      JsSupport::restrictView(J, -1, JsSupport::VIEW_FIXED_SIZE);
+      setViewOwner(J, 0);
+    }, 0)
+    ADD_METHOD_CPP(Molecule, getElementsView, { // Binary sharing the elements with the molecule: one byte per atom, read-only
+      AssertNargs(0)
+      JsBinary::xnewoView(J, &GetArg(Molecule, 0)->elements);
+      JsSupport::restrictView(J, -1, JsSupport::VIEW_FIXED_SIZE | JsSupport::VIEW_READ_ONLY); // atoms keep their own elements
+      setViewOwner(J, 0);
+    }, 0)
+    ADD_METHOD_CPP(Molecule, getCoords, { // FloatArray8 with the copy of the coordinates: x,y,z for each atom
+      AssertNargs(0)
+      *JsFloatArray::xnewoEmpty8(J) = GetArg(Molecule, 0)->coords;
+    }, 0)
+    ADD_METHOD_CPP(Molecule, setCoords, { // accepts FloatArray8 or an array of numbers: x,y,z for each atom
+      AssertNargs(1)
+      if (js_isuserdata(J, 1, TAG_FloatArray8))
+        GetArg(Molecule, 0)->setCoords(*(std::vector<double>*)js_touserdata(J, 1, TAG_FloatArray8));
+      else
+        GetArg(Molecule, 0)->setCoords(GetArgFloatArray(1));
+      ReturnVoid(J);
+    }, 1)
+    ADD_METHOD_CPP(Molecule, getElements, { // Binary with the copy of the elements: one byte per atom
+      AssertNargs(0)
+      JsBinary::xnewo(J, new Binary(GetArg(Molecule, 0)->elements));
+    }, 0)
+    ADD_METHOD_CPP(Molecule, setElements, { // Binary: one byte per atom
+      AssertNargs(1)
+      GetArg(Molecule, 0)->setElements(*GetArg(Binary, 1));
+      ReturnVoid(J);
+    }, 1)
+    ADD_METHOD_CPP(Molecule, getChains, { // Binary: one 'unsigned' per atom, see Binary.getUInt
+      AssertNargs(0)
+      helpers::pushUnsignedsAsBinary(J, GetArg(Molecule, 0)->getChains());
+    }, 0)
+    ADD_METHOD_CPP(Molecule, setChains, {
+      AssertNargs(1)
+      GetArg(Molecule, 0)->setChains(helpers::readUnsignedsFromBinary(J, 1, "Molecule.setChains"));
+      ReturnVoid(J);
+    }, 1)
+    ADD_METHOD_CPP(Molecule, getGroups, { // Binary: one 'unsigned' per atom
+      AssertNargs(0)
+      helpers::pushUnsignedsAsBinary(J, GetArg(Molecule, 0)->getGroups());
+    }, 0)
+    ADD_METHOD_CPP(Molecule, setGroups, {
+      AssertNargs(1)
+      GetArg(Molecule, 0)->setGroups(helpers::readUnsignedsFromBinary(J, 1, "Molecule.setGroups"));
+      ReturnVoid(J);
+    }, 1)
+    ADD_METHOD_CPP(Molecule, getBondPairs, { // Binary: two 'unsigned' atom indexes per bond, the lower one first
+      AssertNargs(0)
+      helpers::pushUnsignedsAsBinary(J, GetArg(Molecule, 0)->getBondPairs());
+    }, 0)
     ADD_METHOD_CPP(Molecule, getAtoms, {
       AssertNargs(0)
       auto m = GetArg(Molecule, 0);
@@ -593,27 +798,69 @@ static void init(js_State *J) {
       for (unsigned a1 = 0, ae = atoms.size(); a1<ae; a1++) {
         auto atom1 = atoms[a1];
         for (unsigned a2 = a1+1; a2<ae; a2++) {
-	  double d = (atoms[a2]->pos - atom1->pos).len();
+	  double d = (atoms[a2]->pos() - atom1->pos()).len();
           if (d < dist)
 	    dist = d;
         }
       }
       Return(J, dist);
     }, 0)
-    ADD_METHOD_CPP(Molecule, maxDistBetweenAtoms, {
+    ADD_METHOD_CPP(Molecule, maxDistBetweenAtoms, { // same as diameter
       AssertNargs(0)
-      auto &atoms = GetArg(Molecule, 0)->atoms;
-      double dist = 0;
-      for (unsigned a1 = 0, ae = atoms.size(); a1<ae; a1++) {
-        auto atom1 = atoms[a1];
-        for (unsigned a2 = a1+1; a2<ae; a2++) {
-	  double d = (atoms[a2]->pos - atom1->pos).len();
-          if (d > dist)
-	    dist = d;
-        }
-      }
-      Return(J, dist);
+      Return(J, GetArg(Molecule, 0)->diameter());
+    }, 0)
+    ADD_METHOD_CPP(Molecule, hasClash, { // (minDist[, other]): whether any two atoms are closer than minDist
+      AssertNargsRange(1,2)
+      if (js_isundefined(J, 2))
+        Return(J, GetArg(Molecule, 0)->hasClash(GetArgFloat(1)));
+      else
+        Return(J, GetArg(Molecule, 0)->hasClash(*GetArg(Molecule, 2), GetArgFloat(1)));
+    }, 2)
+    ADD_METHOD_CPP(Molecule, getLattice, { // -> [a, b, c] lattice vectors, or undefined when the molecule isn't periodic
+      AssertNargs(0)
+      auto lattice = GetArg(Molecule, 0)->getLattice();
+      if (lattice)
+        Return(J, lattice->getVectors());
+      else
+        ReturnVoid(J);
+    }, 0)
+    ADD_METHOD_CPP(Molecule, setLattice, { // ([a, b, c]) makes the molecule periodic, undefined makes it non-periodic, bonds aren't re-detected
+      AssertNargs(1)
+      if (js_isundefined(J, 1))
+        GetArg(Molecule, 0)->clearLattice();
+      else
+        GetArg(Molecule, 0)->setLattice(helpers::readLattice(J, 1));
+      ReturnVoid(J);
+    }, 1)
+    ADD_METHOD_CPP(Molecule, isPeriodic, {
+      AssertNargs(0)
+      Return(J, GetArg(Molecule, 0)->isPeriodic());
+    }, 0)
+    ADD_METHOD_CPP(Molecule, distance, { // (atomIdx1, atomIdx2) the minimum-image distance when periodic
+      AssertNargs(2)
+      auto m = GetArg(Molecule, 0);
+      auto i1 = GetArgUInt32(1);
+      auto i2 = GetArgUInt32(2);
+      if (i1 >= m->numAtoms() || i2 >= m->numAtoms())
+        js_typeerror(J, "Molecule.distance: atom index is out of range");
+      Return(J, m->distance(i1, i2));
+    }, 2)
+    ADD_METHOD_CPP(Molecule, wrapAtoms, { // moves all atoms into the cell
+      AssertNargs(0)
+      GetArg(Molecule, 0)->wrapAtoms();
+      ReturnVoid(J);
     }, 0)
+    ADD_METHOD_CPP(Molecule, supercell, { // (na, nb, nc) -> the periodic molecule with na*nb*nc copies of the cell, bonds aren't detected
+      AssertNargs(3)
+      ReturnObj(GetArg(Molecule, 0)->supercell({{GetArgUInt32(1), GetArgUInt32(2), GetArgUInt32(3)}}));
+    }, 3)
+    ADD_METHOD_CPP(Molecule, findContacts, { // (cutoff[, other]) -> Binary: two 'unsigned' atom indexes per contact, see Binary.getUInt
+      AssertNargsRange(1,2)
+      if (js_isundefined(J, 2))
+        helpers::pushUnsignedsAsBinary(J, GetArg(Molecule, 0)->findContacts(GetArgFloat(1)));
+      else
+        helpers::pushUnsignedsAsBinary(J, GetArg(Molecule, 0)->findContacts(*GetArg(Molecule, 2), GetArgFloat(1)));
+    }, 2)
     ADD_METHOD_CPP(Molecule, appendAminoAcid, {
       AssertNargs(2)
       Molecule aa(*GetArg(Molecule, 1)); // copy because it will be altered
@@ -648,6 +895,22 @@ static void init(js_State *J) {
       GetArg(Molecule, 0)->detectBonds();
       ReturnVoid(J);
     }, 0)
+    ADD_METHOD_CPP(Molecule, updateBonds, { // (atom indexes) re-detects the bonds of these atoms only
+      AssertNargs(1)
+      auto m = GetArg(Molecule, 0);
+      std::vector<Atom*> touched;
+      for (auto idx : GetArgUnsignedArray(1)) {
+        if (idx >= m->numAtoms())
+          JS_ERROR("atom index " << idx << " is out of range, the molecule has " << m->numAtoms() << " atoms")
+        touched.push_back(m->atoms[idx]);
+      }
+      m->updateBonds(touched);
+      ReturnVoid(J);
+    }, 1)
+    ADD_METHOD_CPP(Molecule, buildNeighborGrid, {
+      AssertNargs(1)
+      ReturnObjExt(NeighborGrid, GetArg(Molecule, 0)->buildNeighborGrid(GetArgFloat(1)));
+    }, 1)
     ADD_METHOD_CPP(Molecule, isEqual, {
       AssertNargs(1)
       Return(J, GetArg(Molecule, 0)->isEqual(*GetArg(Molecule, 1)));
@@ -694,6 +957,33 @@ static void init(js_State *J) {
         }
       }
     }, 1)
+    ADD_METHOD_CPP(Molecule, findConvexHullVertices, {
+      AssertNargs(0)
+      Return(J, GetArg(Molecule, 0)->findConvexHullVertices());
+    }, 0)
+    ADD_METHOD_CPP(Molecule, findFurthestAtoms, { // -> [idx1,idx2]
+      AssertNargs(0)
+      Return(J, GetArg(Molecule, 0)->findFurthestAtoms());
+    }, 0)
+    ADD_METHOD_CPP(Molecule, diameter, {
+      AssertNargs(0)
+      Return(J, GetArg(Molecule, 0)->diameter());
+    }, 0)
+    ADD_METHOD_CPP(Molecule, minWidth, {
+      AssertNargs(0)
+      Return(J, GetArg(Molecule, 0)->minWidth());
+    }, 0)
+    ADD_METHOD_CPP(Molecule, orientedBoundingBox, { // -> {center, axes, extents}
+      AssertNargs(0)
+      auto box = GetArg(Molecule, 0)->orientedBoundingBox();
+      js_newobject(J);
+      Push(J, box.center);
+      js_setproperty(J, -2, "center");
+      Push(J, box.axes);
+      js_setproperty(J, -2, "axes");
+      Push(J, box.extents);
+      js_setproperty(J, -2, "extents");
+    }, 0)
     ADD_METHOD_CPP(Molecule, centerOfMass, {
       AssertNargs(0)
       Return(J, GetArg(Molecule, 0)->centerOfMass());
@@ -735,6 +1025,16 @@ static void init(js_State *J) {
         js_setindex(J, -2, idx++);
       }
     }, 0)
+    ADD_METHOD_CPP(Molecule, findAaBackbonesSorted, { // from the N-term to the C-term
+      AssertNargs(0)
+      // return array
+      js_newarray(J);
+      unsigned idx = 0;
+      for (auto &aaBackbone : GetArg(Molecule, 0)->findAaBackbonesSorted()) {
+        helpers::pushAaBackboneAsJsObject(J, aaBackbone);
+        js_setindex(J, -2, idx++);
+      }
+    }, 0)
     ADD_METHOD_CPP(Molecule, getAminoAcidSingleAngle, {
       AssertNargs(3)
       Return(J, GetArg(Molecule, 0)->getAminoAcidSingleAngle(
@@ -793,21 +1093,18 @@ static void init(js_State *J) {
     //  auto aaBackbonesBinary = Util::createContainerFromBufferOfDifferentType<std::vector<Molecule::AaBackbone>, Binary>(GetArg(Molecule, 0)->findAaBackbones());
     //  Return(Binary, aaBackbonesBinary);
     //}, 0)
-    ADD_METHOD_JS(Molecule, extractCoords, function(m) {
-      var res = [];
-      var atoms = this.getAtoms();
-      for (var i = 0; i < atoms.length; i++)
-        res.push(atoms[i].getPos());
-      return res;
-    });
-    ADD_METHOD_JS(Molecule, rmsd, function(othr) {return Vec3.rmsd(this.extractCoords(), othr.extractCoords())})
-    ADD_METHOD_JS(Molecule, allElements, function() {
-      var mm = {};
-      var atoms = this.getAtoms();
-      for (var i = 0; i < atoms.length; i++)
-        mm[atoms[i].getElement()] = 1;
-      return Object.keys(mm);
-    })
+    ADD_METHOD_CPP(Molecule, extractCoords, {
+      AssertNargs(0)
+      Return(J, GetArg(Molecule, 0)->getAtomPositions());
+    }, 0)
+    ADD_METHOD_CPP(Molecule, rmsd, {
+      AssertNargs(1)
+      Return(J, helpers::rmsd(J, *GetArg(Molecule, 0), *GetArg(Molecule, 1)));
+    }, 1)
+    ADD_METHOD_CPP(Molecule, allElements, { // element symbols present, in the order of their first appearance
+      AssertNargs(0)
+      Return(J, helpers::listElements(*GetArg(Molecule, 0)));
+    }, 0)
   }
   JsSupport::endDefineClass(J);
 }
@@ -824,10 +1121,94 @@ static void fromXyzMany(js_State *J) {
   returnArrayOfUserData<std::vector<Molecule*>, void(*)(js_State*,Molecule*)>(J, Molecule::readXyzFileMany(GetArgString(1)), TAG_Molecule, moleculeFinalize, JsMolecule::xnewo);
 }
 
+// streaming xyz readers: fn is called for each frame, returning false from it stops the reading, the number of frames read is returned
+static bool callFrameCallback(js_State *J, unsigned nargs, bool &failed) { // the callback and its arguments are on the stack, returns true when reading should stop
+  if (js_pcall(J, nargs)) {
+    failed = true; // the exception is on the stack
+    return true;
+  }
+  bool stop = js_isboolean(J, -1) && !js_toboolean(J, -1);
+  js_pop(J, 1);
+  return stop;
+}
+
+static void forEachXyzFrame(js_State *J) { // (fname, detectBonds, fn(molecule, frameIdx))
+  AssertNargs(3)
+  if (!js_iscallable(J, 3))
+    js_typeerror(J, "forEachXyzFrame: callback should be callable");
+  bool failed = false;
+  unsigned idx = 0;
+  { // C++ objects are released before the exception is rethrown
+    XyzFrameReader reader(GetArgString(1));
+    XyzFrame frame;
+    auto doDetectBonds = GetArgBoolean(2);
+    while (reader.next(frame)) {
+      js_copy(J, 3);
+      js_pushundefined(J);
+      JsMolecule::xnewo(J, Molecule::createFromXyzFrame(frame, doDetectBonds));
+      js_pushnumber(J, idx++);
+      if (callFrameCallback(J, 2, failed))
+        break;
+    }
+  }
+  if (failed)
+    js_throw(J);
+  Return(J, idx);
+}
+
+static void forEachXyzFrameCoords(js_State *J) { // (fname, fn(coords, descr, frameIdx)): coords is the same FloatArray8 object refilled for every frame
+  AssertNargs(2)
+  if (!js_iscallable(J, 2))
+    js_typeerror(J, "forEachXyzFrameCoords: callback should be callable");
+  auto coords = JsFloatArray::xnewoEmpty8(J);
+  int coordsIdx = js_gettop(J) - 1;
+  bool failed = false;
+  unsigned idx = 0;
+  { // C++ objects are released before the exception is rethrown
+    XyzFrameReader reader(GetArgString(1));
+    XyzFrame frame;
+    while (reader.next(frame)) {
+      coords->swap(frame.coords); // no copying, the previous frame's buffer is reused by the reader
+      js_copy(J, 2);
+      js_pushundefined(J);
+      js_copy(J, coordsIdx);
+      js_pushstring(J, frame.descr.c_str());
+      js_pushnumber(J, idx++);
+      if (callFrameCallback(J, 3, failed))
+        break;
+    }
+  }
+  if (failed)
+    js_throw(J);
+  Return(J, idx);
+}
+
+static std::vector<const Molecule*> objToMoleculeArray(js_State *J, int idx, const char *fname) {
+  if (!js_isarray(J, idx))
+    js_typeerror(J, "not an array in arg#%d of the function '%s'", idx, fname);
+  std::vector<const Molecule*> v;
+  for (unsigned i = 0, len = js_getlength(J, idx); i < len; i++) {
+    js_getindex(J, idx, i);
+    v.push_back((const Molecule*)js_touserdata(J, -1, TAG_Molecule));
+    js_pop(J, 1);
+  }
+  return v;
+}
+
+static void rmsdMatrix(js_State *J) { // (molecules, nthreads): symmetric matrix of RMSDs after the superposition
+  AssertNargs(2)
+  JsLinearAlgebra::xnewo(J, Op::rmsdMatrix(objToMoleculeArray(J, 1, __func__), GetArgUInt32(2)));
+}
+
+static void rmsdOneToMany(js_State *J) { // (molecule, molecules, nthreads): vector of RMSDs
+  AssertNargs(3)
+  JsLinearAlgebra::xnewo(J, Op::rmsdOneToMany(GetArg(Molecule, 1), objToMoleculeArray(J, 2, __func__), GetArgUInt32(3)));
+}
+
 static void listNeighborsHierarchically(js_State *J) {
   AssertNargs(4)
   auto atoms = Molecule::listNeighborsHierarchically(GetArg(Atom, 1), GetArgBoolean(2), GetArgZ(Atom, 3), GetArgZ(Atom, 4));
-  returnArrayOfUserData<std::vector<Atom*>, void(*)(js_State*,Atom*)>(J, Util::containerToVec(atoms), TAG_Atom, atomFinalize, JsAtom::xnewo);
+  returnArrayOfUserData<std::vector<Atom*>, void(*)(js_State*,Atom*)>(J, atoms, TAG_Atom, atomFinalize, JsAtom::xnewo);
 }
 
 #if defined(USE_OPENBABEL)
@@ -936,10 +1317,13 @@ static void init(js_State *J) {
       auto sdb = GetArg(StructureDb, 0);
       Return(J, str(boost::format("structure-db{size=%1%}") % sdb->size()));
     }, 0)
+    ADD_METHOD_CPP(StructureDb, size, {
+      AssertNargs(0)
+      Return(J, (unsigned)GetArg(StructureDb, 0)->size());
+    }, 0)
     ADD_METHOD_CPP(StructureDb, add, {
       AssertNargs(2)
-      GetArg(StructureDb, 0)->add(GetArg(Molecule, 1), GetArgString(2));
-      ReturnVoid(J);
+      Return(J, GetArg(StructureDb, 0)->add(GetArg(Molecule, 1), GetArgString(2)));
     }, 2)
     ADD_METHOD_CPP(StructureDb, find, {
       AssertNargs(1)
@@ -948,78 +1332,686 @@ static void init(js_State *J) {
     ADD_METHOD_CPP(StructureDb, moleculeSignature, {
       AssertNargs(1)
       /*XXX StructureDb::moleculeSignature is static, and "this" argument isn't used*/
-      auto signature = StructureDb::computeMoleculeSignature(GetArg(Molecule, 1));
-      std::ostringstream ss;
-      ss << signature;
-      Return(J, ss.str());
+      Return(J, str(boost::format("%|016x|") % StructureDb::computeMoleculeSignature(GetArg(Molecule, 1))));
+    }, 1)
+    ADD_METHOD_CPP(StructureDb, findSubstructure, {
+      AssertNargs(2)
+      Return(J, GetArg(StructureDb, 0)->findSubstructure(*GetArg(Substructure, 1), GetArgUInt32(2)));
+    }, 2)
+    ADD_METHOD_CPP(StructureDb, save, {
+      AssertNargs(1)
+      GetArg(StructureDb, 0)->save(GetArgString(1));
+      ReturnVoid(J);
     }, 1)
   }
   JsSupport::endDefineClass(J);
+  // static functions
+  js_getglobal(J, TAG_StructureDb);
+  ADD_NS_FUNCTION_CPPnew(StructureDb, open, {
+    AssertNargs(1)
+    ReturnObj(StructureDb::open(GetArgString(1)));
+  }, 1)
+  js_pop(J, 1);
 }
 
 } // JsStructureDb
 
-//
-// exported functions
-//
+namespace JsFingerprintDb {
 
-namespace helpers {
-  static void applyAttrs(std::ostream &os, const std::vector<std::string> &attrs) {
-    for (auto &attr : attrs) {
-      if (attr == "clr.fg.black")        os << rang::fg::black;
-      else if (attr == "clr.fg.red")     os << rang::fg::red;
-      else if (attr == "clr.fg.green")   os << rang::fg::green;
-      else if (attr == "clr.fg.yellow")  os << rang::fg::yellow;
-      else if (attr == "clr.fg.blue")    os << rang::fg::blue;
-      else if (attr == "clr.fg.magenta") os << rang::fg::magenta;
-      else if (attr == "clr.fg.cyan")    os << rang::fg::cyan;
-      else if (attr == "clr.fg.gray")    os << rang::fg::gray;
-      else if (attr == "clr.fg.reset")   os << rang::fg::reset;
-      else if (attr == "clr.bg.black")   os << rang::bg::black;
-      else if (attr == "clr.bg.red")     os << rang::bg::red;
-      else if (attr == "clr.bg.green")   os << rang::bg::green;
-      else if (attr == "clr.bg.yellow")  os << rang::bg::yellow;
-      else if (attr == "clr.bg.blue")    os << rang::bg::blue;
-      else if (attr == "clr.bg.magenta") os << rang::bg::magenta;
-      else if (attr == "clr.bg.cyan")    os << rang::bg::cyan;
-      else if (attr == "clr.bg.gray")    os << rang::bg::gray;
-      else if (attr == "clr.bg.reset")   os << rang::bg::reset;
-      else
-        ERROR("unknown attr supplied: " << attr)
-    }
-  }
+static void xnewo(js_State *J, FingerprintDb *f) {
+  js_getglobal(J, TAG_FingerprintDb);
+  js_getproperty(J, -1, "prototype");
+  js_newuserdata(J, TAG_FingerprintDb, f, [](js_State *J, void *p) {
+    delete (FingerprintDb*)p;
+  });
 }
 
-static void print(js_State *J) {
-  AssertNargs(1)
-  std::cout << GetArgString(1) << std::endl;
-  ReturnVoid(J);
+static void init(js_State *J) {
+  JsSupport::beginDefineClass(J, TAG_FingerprintDb, [](js_State *J) {
+    AssertNargs(0)
+    ReturnObj(new FingerprintDb);
+  });
+  { // methods
+    ADD_METHOD_CPP(FingerprintDb, str, {
+      AssertNargs(0)
+      Return(J, str(boost::format("fingerprint-db{size=%1%}") % GetArg(FingerprintDb, 0)->size()));
+    }, 0)
+    ADD_METHOD_CPP(FingerprintDb, toString, {
+      AssertNargs(0)
+      Return(J, str(boost::format("fingerprint-db{size=%1%}") % GetArg(FingerprintDb, 0)->size()));
+    }, 0)
+    ADD_METHOD_CPP(FingerprintDb, size, {
+      AssertNargs(0)
+      Return(J, (unsigned)GetArg(FingerprintDb, 0)->size());
+    }, 0)
+    ADD_METHOD_CPP(FingerprintDb, add, {
+      AssertNargs(2)
+      Return(J, GetArg(FingerprintDb, 0)->add(GetArg(Molecule, 1), GetArgString(2)));
+    }, 2)
+    ADD_METHOD_CPP(FingerprintDb, search, { // returns [[id, similarity], ...], the most similar first
+      AssertNargs(3)
+      auto fdb = GetArg(FingerprintDb, 0);
+      js_newarray(J);
+      unsigned idx = 0;
+      for (auto &hit : fdb->searchTopK(GetArg(Molecule, 1), GetArgUInt32(2), GetArgUInt32(3))) {
+        Push(J, std::make_pair(fdb->getId(hit.first), hit.second));
+        js_setindex(J, -2, idx++);
+      }
+    }, 3)
+  }
+  JsSupport::endDefineClass(J);
+  // static functions
+  js_getglobal(J, TAG_FingerprintDb);
+  ADD_NS_FUNCTION_CPPnew(FingerprintDb, tanimoto, {
+    AssertNargs(2)
+    FingerprintDb::Fingerprint fp1;
+    FingerprintDb::Fingerprint fp2;
+    FingerprintDb::computeFingerprint(GetArg(Molecule, 1), fp1);
+    FingerprintDb::computeFingerprint(GetArg(Molecule, 2), fp2);
+    Return(J, FingerprintDb::tanimoto(fp1, fp2));
+  }, 2)
+  js_pop(J, 1);
 }
 
-static void printn(js_State *J) {
-  AssertNargs(1)
-  std::cout << GetArgString(1);
-  ReturnVoid(J);
-}
+} // JsFingerprintDb
 
-static void printa(js_State *J) {
-  AssertNargs(2)
-  helpers::applyAttrs(std::cout, GetArgStringArray(1));
-  std::cout << GetArgString(2) << rang::fg::reset << rang::bg::reset << std::endl;
-  ReturnVoid(J);
-}
+namespace JsSubstructure {
 
-static void printna(js_State *J) {
-  AssertNargs(2)
-  helpers::applyAttrs(std::cout, GetArgStringArray(1));
-  std::cout << GetArgString(2);
-  ReturnVoid(J);
+static void xnewo(js_State *J, Substructure *s) {
+  js_getglobal(J, TAG_Substructure);
+  js_getproperty(J, -1, "prototype");
+  js_newuserdata(J, TAG_Substructure, s, [](js_State *J, void *p) {
+    delete (Substructure*)p;
+  });
 }
 
-static void flush(js_State *J) {
-  AssertNargs(0)
-  std::cout.flush();
-}
+static void init(js_State *J) {
+  JsSupport::beginDefineClass(J, TAG_Substructure, [](js_State *J) {
+    AssertNargs(1)
+    ReturnObj(new Substructure(GetArg(Molecule, 1)));
+  });
+  { // methods
+    ADD_METHOD_CPP(Substructure, str, {
+      AssertNargs(0)
+      Return(J, str(boost::format("substructure{numAtoms=%1%}") % GetArg(Substructure, 0)->numAtoms()));
+    }, 0)
+    ADD_METHOD_CPP(Substructure, toString, {
+      AssertNargs(0)
+      Return(J, str(boost::format("substructure{numAtoms=%1%}") % GetArg(Substructure, 0)->numAtoms()));
+    }, 0)
+    ADD_METHOD_CPP(Substructure, setElement, { // "*" matches any element
+      AssertNargs(2)
+      auto s = GetArg(Substructure, 0);
+      auto a = GetArgUInt32(1);
+      auto sym = GetArgString(2);
+      if (a >= s->numAtoms())
+        JS_ERROR("atom index " << a << " is out of range, the pattern has " << s->numAtoms() << " atoms")
+      s->setElement(a, sym == "*" ? 0 : (uint8_t)PeriodicTableData::get().elementFromSymbol(sym));
+      ReturnVoid(J);
+    }, 2)
+    ADD_METHOD_CPP(Substructure, setDegree, { // -1 is any degree
+      AssertNargs(2)
+      auto s = GetArg(Substructure, 0);
+      auto a = GetArgUInt32(1);
+      if (a >= s->numAtoms())
+        JS_ERROR("atom index " << a << " is out of range, the pattern has " << s->numAtoms() << " atoms")
+      s->setDegree(a, GetArgInt32(2));
+      ReturnVoid(J);
+    }, 2)
+    ADD_METHOD_CPP(Substructure, setRing, { // -1 is any, 0 is not in a ring, 1 is in a ring
+      AssertNargs(2)
+      auto s = GetArg(Substructure, 0);
+      auto a = GetArgUInt32(1);
+      if (a >= s->numAtoms())
+        JS_ERROR("atom index " << a << " is out of range, the pattern has " << s->numAtoms() << " atoms")
+      s->setRing(a, GetArgInt32(2));
+      ReturnVoid(J);
+    }, 2)
+    ADD_METHOD_CPP(Substructure, findMatches, { // returns arrays of atom indexes of the molecule in the order of pattern atoms
+      AssertNargs(3)
+      Return(J, GetArg(Substructure, 0)->findMatches(GetArg(Molecule, 1), GetArgUInt32(2), GetArgBoolean(3)));
+    }, 3)
+    ADD_METHOD_CPP(Substructure, matches, {
+      AssertNargs(1)
+      Return(J, !GetArg(Substructure, 0)->findMatches(GetArg(Molecule, 1), 1, false).empty());
+    }, 1)
+  }
+  JsSupport::endDefineClass(J);
+}
+
+} // JsSubstructure
+
+namespace JsPeptideBuilder {
+
+static void xnewo(js_State *J, PeptideBuilder *b) {
+  js_getglobal(J, TAG_PeptideBuilder);
+  js_getproperty(J, -1, "prototype");
+  js_newuserdata(J, TAG_PeptideBuilder, b, [](js_State *J, void *p) {
+    delete (PeptideBuilder*)p;
+  });
+}
+
+static void init(js_State *J) {
+  JsSupport::beginDefineClass(J, TAG_PeptideBuilder, [](js_State *J) {
+    AssertNargs(0)
+    ReturnObj(new PeptideBuilder);
+  });
+  { // methods
+    ADD_METHOD_CPP(PeptideBuilder, str, {
+      AssertNargs(0)
+      Return(J, str(boost::format("peptide-builder{numResidues=%1%}") % GetArg(PeptideBuilder, 0)->size()));
+    }, 0)
+    ADD_METHOD_CPP(PeptideBuilder, toString, {
+      AssertNargs(0)
+      Return(J, str(boost::format("peptide-builder{numResidues=%1%}") % GetArg(PeptideBuilder, 0)->size()));
+    }, 0)
+    ADD_METHOD_CPP(PeptideBuilder, setResidue, { // (code, amino acid molecule) the molecule is copied
+      AssertNargs(2)
+      auto code = GetArgString(1);
+      if (code.size() != 1)
+        JS_ERROR("amino acid code should be a single character, got '" << code << "'")
+      GetArg(PeptideBuilder, 0)->setResidue(code[0], *GetArg(Molecule, 2));
+      ReturnVoid(J);
+    }, 2)
+    ADD_METHOD_CPP(PeptideBuilder, hasResidue, {
+      AssertNargs(1)
+      auto code = GetArgString(1);
+      Return(J, code.size() == 1 && GetArg(PeptideBuilder, 0)->hasResidue(code[0]));
+    }, 1)
+    ADD_METHOD_CPP(PeptideBuilder, append, { // (code, angles) angles are optional
+      AssertNargs(2)
+      auto code = GetArgString(1);
+      if (code.size() != 1)
+        JS_ERROR("amino acid code should be a single character, got '" << code << "'")
+      GetArg(PeptideBuilder, 0)->append(code[0], GetArgFloatArrayZ(2));
+      ReturnVoid(J);
+    }, 2)
+    ADD_METHOD_CPP(PeptideBuilder, appendSequence, { // (codes, angles) angles are optional, one array per junction
+      AssertNargs(2)
+      GetArg(PeptideBuilder, 0)->appendSequence(GetArgString(1), GetArgFloatArrayArrayZ(2));
+      ReturnVoid(J);
+    }, 2)
+    ADD_METHOD_CPP(PeptideBuilder, size, {
+      AssertNargs(0)
+      Return(J, GetArg(PeptideBuilder, 0)->size());
+    }, 0)
+    ADD_METHOD_CPP(PeptideBuilder, takeMolecule, { // returns the chain, the builder begins a new one
+      AssertNargs(0)
+      ReturnObjExt(Molecule, GetArg(PeptideBuilder, 0)->takeMolecule());
+    }, 0)
+  }
+  JsSupport::endDefineClass(J);
+}
+
+} // JsPeptideBuilder
+
+namespace JsTorsionTree {
+
+static void xnewo(js_State *J, TorsionTree *t) {
+  js_getglobal(J, TAG_TorsionTree);
+  js_getproperty(J, -1, "prototype");
+  js_newuserdata(J, TAG_TorsionTree, t, [](js_State *J, void *p) {
+    delete (TorsionTree*)p;
+  });
+}
+
+static void init(js_State *J) {
+  JsSupport::beginDefineClass(J, TAG_TorsionTree, [](js_State *J) { // (molecule, aaBackbones) aaBackbones are sorted, see Molecule.findAaBackbonesSorted
+    AssertNargs(2)
+    ReturnObj(new TorsionTree(GetArg(Molecule, 1), *std::unique_ptr<std::vector<Molecule::AaBackbone>>(JsMolecule::helpers::readAaBackboneArray(J, 2/*argno*/))));
+    setViewOwner(J, 1); // the tree refers to the molecule
+  });
+  { // methods
+    ADD_METHOD_CPP(TorsionTree, str, {
+      AssertNargs(0)
+      auto t = GetArg(TorsionTree, 0);
+      Return(J, str(boost::format("torsion-tree{numJunctions=%1% numSegments=%2%}") % t->numJunctions() % t->numSegments()));
+    }, 0)
+    ADD_METHOD_CPP(TorsionTree, toString, {
+      AssertNargs(0)
+      auto t = GetArg(TorsionTree, 0);
+      Return(J, str(boost::format("torsion-tree{numJunctions=%1% numSegments=%2%}") % t->numJunctions() % t->numSegments()));
+    }, 0)
+    ADD_METHOD_CPP(TorsionTree, numJunctions, {
+      AssertNargs(0)
+      Return(J, GetArg(TorsionTree, 0)->numJunctions());
+    }, 0)
+    ADD_METHOD_CPP(TorsionTree, isRotatable, { // (junctionIdx, angleId)
+      AssertNargs(2)
+      Return(J, GetArg(TorsionTree, 0)->isRotatable(GetArgUInt32(1), (Molecule::AaAngles::Type)GetArgUInt32(2)));
+    }, 2)
+    ADD_METHOD_CPP(TorsionTree, getAngle, { // (junctionIdx, angleId)
+      AssertNargs(2)
+      Return(J, GetArg(TorsionTree, 0)->getAngle(GetArgUInt32(1), (Molecule::AaAngles::Type)GetArgUInt32(2)));
+    }, 2)
+    ADD_METHOD_CPP(TorsionTree, setAngle, { // (junctionIdx, angleId, newAngle) returns the prior angle, positions change on apply()
+      AssertNargs(3)
+      Return(J, GetArg(TorsionTree, 0)->setAngle(GetArgUInt32(1), (Molecule::AaAngles::Type)GetArgUInt32(2), GetArgFloat(3)));
+    }, 3)
+    ADD_METHOD_CPP(TorsionTree, setAngles, { // (junctionIdx, [omega, phi, psi])
+      AssertNargs(2)
+      GetArg(TorsionTree, 0)->setAngles(GetArgUInt32(1), GetArgFloatArray(2));
+      ReturnVoid(J);
+    }, 2)
+    ADD_METHOD_CPP(TorsionTree, apply, { // writes the changed positions into the molecule
+      AssertNargs(0)
+      GetArg(TorsionTree, 0)->apply();
+      ReturnVoid(J);
+    }, 0)
+  }
+  JsSupport::endDefineClass(J);
+}
+
+} // JsTorsionTree
+
+namespace JsForceField {
+
+static void xnewo(js_State *J, ForceField *ff) {
+  js_getglobal(J, TAG_ForceField);
+  js_getproperty(J, -1, "prototype");
+  js_newuserdata(J, TAG_ForceField, ff, [](js_State *J, void *p) {
+    delete (ForceField*)p;
+  });
+}
+
+static ForceField::Params readParams(js_State *J, int idx) { // {cutoff, dielectric, scale14, charges}, all are optional
+  ForceField::Params params;
+  if (!js_isobject(J, idx))
+    js_typeerror(J, "ForceField: params isn't an object");
+  js_pushiterator(J, idx, 1/*own*/);
+  const char *key;
+  while ((key = js_nextiterator(J, -1))) {
+    std::string k = key;
+    js_getproperty(J, idx, key);
+    if (k == "cutoff")
+      params.cutoff = js_tonumber(J, -1);
+    else if (k == "dielectric")
+      params.dielectric = js_tonumber(J, -1);
+    else if (k == "scale14")
+      params.scale14 = js_tonumber(J, -1);
+    else if (k == "charges")
+      params.charges = objToTypedArray<double, false>(J, js_gettop(J)-1, "ForceField");
+    else
+      js_typeerror(J, "ForceField: unknown parameter '%s'", key);
+    js_pop(J, 1);
+  }
+  js_pop(J, 1);
+  return params;
+}
+
+static void init(js_State *J) {
+  JsSupport::beginDefineClass(J, TAG_ForceField, [](js_State *J) { // (molecule[, params]) the topology is taken from the molecule
+    AssertNargsRange(1,2)
+    if (GetNArgs() == 1)
+      ReturnObj(new ForceField(*GetArg(Molecule, 1)));
+    else
+      ReturnObj(new ForceField(*GetArg(Molecule, 1), readParams(J, 2)));
+  });
+  { // methods
+    ADD_METHOD_CPP(ForceField, str, {
+      AssertNargs(0)
+      auto ff = GetArg(ForceField, 0);
+      Return(J, str(boost::format("force-field{bonds=%1% angles=%2% torsions=%3%}") % ff->numBonds() % ff->numAngles() % ff->numTorsions()));
+    }, 0)
+    ADD_METHOD_CPP(ForceField, toString, {
+      AssertNargs(0)
+      auto ff = GetArg(ForceField, 0);
+      Return(J, str(boost::format("force-field{bonds=%1% angles=%2% torsions=%3%}") % ff->numBonds() % ff->numAngles() % ff->numTorsions()));
+    }, 0)
+    ADD_METHOD_CPP(ForceField, numBonds, {
+      AssertNargs(0)
+      Return(J, GetArg(ForceField, 0)->numBonds());
+    }, 0)
+    ADD_METHOD_CPP(ForceField, numAngles, {
+      AssertNargs(0)
+      Return(J, GetArg(ForceField, 0)->numAngles());
+    }, 0)
+    ADD_METHOD_CPP(ForceField, numTorsions, {
+      AssertNargs(0)
+      Return(J, GetArg(ForceField, 0)->numTorsions());
+    }, 0)
+    ADD_METHOD_CPP(ForceField, calcEnergy, { // (molecule[, grad]) -> kcal/mol, the FloatArray8 grad receives dE/dx,dE/dy,dE/dz for each atom from the same evaluation
+      AssertNargsRange(1,2)
+      if (js_isundefined(J, 2))
+        Return(J, GetArg(ForceField, 0)->compute(*GetArg(Molecule, 1)).total());
+      else {
+        auto ff = GetArg(ForceField, 0);
+        auto res = (std::vector<double>*)js_touserdata(J, 2, TAG_FloatArray8);
+        if (res->size() != 3*ff->getNumAtoms())
+          JsSupport::checkView(J, 2, JsSupport::VIEW_FIXED_SIZE, "ForceField.calcEnergy");
+        JsSupport::checkView(J, 2, JsSupport::VIEW_READ_ONLY, "ForceField.calcEnergy");
+        std::vector<Vec3> grad;
+        auto E = ff->compute(*GetArg(Molecule, 1), &grad).total();
+        res->resize(3*grad.size());
+        std::memcpy(res->data(), grad.data(), res->size()*sizeof(double));
+        Return(J, E);
+      }
+    }, 2)
+    ADD_METHOD_CPP(ForceField, calcEnergyTerms, { // (molecule) -> {bond, angle, torsion, vdw, coulomb, total}
+      AssertNargs(1)
+      auto e = GetArg(ForceField, 0)->compute(*GetArg(Molecule, 1));
+      Return(J, std::map<std::string,Float>{{"bond", e.bond}, {"angle", e.angle}, {"torsion", e.torsion}, {"vdw", e.vdw}, {"coulomb", e.coulomb}, {"total", e.total()}});
+    }, 1)
+    ADD_METHOD_CPP(ForceField, calcGradient, { // (molecule) -> FloatArray8: dE/dx,dE/dy,dE/dz for each atom, kcal/mol/A
+      AssertNargs(1)
+      std::vector<Vec3> grad;
+      GetArg(ForceField, 0)->compute(*GetArg(Molecule, 1), &grad);
+      auto res = JsFloatArray::xnewoEmpty8(J);
+      res->resize(3*grad.size());
+      std::memcpy(res->data(), grad.data(), res->size()*sizeof(double));
+    }, 1)
+  }
+  JsSupport::endDefineClass(J);
+}
+
+} // JsForceField
+
+namespace JsMolecularDynamics {
+
+static void xnewo(js_State *J, MolecularDynamics *md) {
+  js_getglobal(J, TAG_MolecularDynamics);
+  js_getproperty(J, -1, "prototype");
+  js_newuserdata(J, TAG_MolecularDynamics, md, [](js_State *J, void *p) {
+    delete (MolecularDynamics*)p;
+  });
+}
+
+static MolecularDynamics::Params readParams(js_State *J, int idx) { // {timeStep, temperature, thermostatTau, skin, seed, trajectoryFile, frameInterval, trajectoryPrecision}, all are optional
+  MolecularDynamics::Params params;
+  if (!js_isobject(J, idx))
+    js_typeerror(J, "MolecularDynamics: params isn't an object");
+  js_pushiterator(J, idx, 1/*own*/);
+  const char *key;
+  while ((key = js_nextiterator(J, -1))) {
+    std::string k = key;
+    js_getproperty(J, idx, key);
+    if (k == "timeStep")
+      params.timeStep = js_tonumber(J, -1);
+    else if (k == "temperature")
+      params.temperature = js_tonumber(J, -1);
+    else if (k == "thermostatTau")
+      params.thermostatTau = js_tonumber(J, -1);
+    else if (k == "skin")
+      params.skin = js_tonumber(J, -1);
+    else if (k == "seed")
+      params.seed = js_touint32(J, -1);
+    else if (k == "trajectoryFile")
+      params.trajectoryFile = js_tostring(J, -1);
+    else if (k == "frameInterval")
+      params.frameInterval = js_touint32(J, -1);
+    else if (k == "trajectoryPrecision")
+      params.trajectoryPrecision = js_tonumber(J, -1);
+    else
+      js_typeerror(J, "MolecularDynamics: unknown parameter '%s'", key);
+    js_pop(J, 1);
+  }
+  js_pop(J, 1);
+  return params;
+}
+
+static void pushStats(js_State *J, const MolecularDynamics::Stats &stats) {
+  js_newobject(J);
+  js_pushnumber(J, stats.step);
+  js_setproperty(J, -2, "step");
+  js_pushnumber(J, stats.time);
+  js_setproperty(J, -2, "time");
+  js_pushnumber(J, stats.potential);
+  js_setproperty(J, -2, "potential");
+  js_pushnumber(J, stats.kinetic);
+  js_setproperty(J, -2, "kinetic");
+  js_pushnumber(J, stats.temperature);
+  js_setproperty(J, -2, "temperature");
+  js_pushnumber(J, stats.numListRebuilds);
+  js_setproperty(J, -2, "numListRebuilds");
+}
+
+static void init(js_State *J) {
+  JsSupport::beginDefineClass(J, TAG_MolecularDynamics, [](js_State *J) { // (molecule, forceField[, params]) the force field is copied
+    AssertNargsRange(2,3)
+    if (GetNArgs() == 2)
+      ReturnObj(new MolecularDynamics(*GetArg(Molecule, 1), *GetArg(ForceField, 2)));
+    else
+      ReturnObj(new MolecularDynamics(*GetArg(Molecule, 1), *GetArg(ForceField, 2), readParams(J, 3)));
+  });
+  { // methods
+    ADD_METHOD_CPP(MolecularDynamics, str, {
+      AssertNargs(0)
+      auto md = GetArg(MolecularDynamics, 0);
+      Return(J, str(boost::format("molecular-dynamics{step=%1% T=%2%}") % md->getStats().step % md->getStats().temperature));
+    }, 0)
+    ADD_METHOD_CPP(MolecularDynamics, toString, {
+      AssertNargs(0)
+      auto md = GetArg(MolecularDynamics, 0);
+      Return(J, str(boost::format("molecular-dynamics{step=%1% T=%2%}") % md->getStats().step % md->getStats().temperature));
+    }, 0)
+    ADD_METHOD_CPP(MolecularDynamics, run, { // (molecule, numSteps) -> {step, time, potential, kinetic, temperature, numListRebuilds}: the molecule's coordinates are advanced in place
+      AssertNargs(2)
+      pushStats(J, GetArg(MolecularDynamics, 0)->run(*GetArg(Molecule, 1), GetArgUInt32(2)));
+    }, 2)
+    ADD_METHOD_CPP(MolecularDynamics, getStats, { // stats after the last run
+      AssertNargs(0)
+      pushStats(J, GetArg(MolecularDynamics, 0)->getStats());
+    }, 0)
+    ADD_METHOD_CPP(MolecularDynamics, getVelocities, { // -> FloatArray8: vx,vy,vz for each atom, A/fs
+      AssertNargs(0)
+      auto &vel = GetArg(MolecularDynamics, 0)->getVelocities();
+      auto res = JsFloatArray::xnewoEmpty8(J);
+      res->resize(3*vel.size());
+      std::memcpy(res->data(), vel.data(), res->size()*sizeof(double));
+    }, 0)
+    ADD_METHOD_CPP(MolecularDynamics, setVelocities, { // accepts FloatArray8 or an array of numbers: vx,vy,vz for each atom, A/fs
+      AssertNargs(1)
+      auto vel = js_isuserdata(J, 1, TAG_FloatArray8) ? *(std::vector<double>*)js_touserdata(J, 1, TAG_FloatArray8) : GetArgFloatArray(1);
+      if (vel.size() % 3 != 0)
+        js_typeerror(J, "MolecularDynamics.setVelocities: velocities should be vx,vy,vz triplets");
+      GetArg(MolecularDynamics, 0)->setVelocities(std::vector<Vec3>((const Vec3*)vel.data(), (const Vec3*)vel.data() + vel.size()/3));
+      ReturnVoid(J);
+    }, 1)
+  }
+  JsSupport::endDefineClass(J);
+}
+
+} // JsMolecularDynamics
+
+namespace JsTrajectoryWriter {
+
+static void xnewo(js_State *J, TrajectoryWriter *w) {
+  js_getglobal(J, TAG_TrajectoryWriter);
+  js_getproperty(J, -1, "prototype");
+  js_newuserdata(J, TAG_TrajectoryWriter, w, [](js_State *J, void *p) {
+    delete (TrajectoryWriter*)p; // writes the incomplete chunk
+  });
+}
+
+static TrajectoryWriter::Params readParams(js_State *J, int idx) { // {precision, framesPerChunk}, all are optional
+  TrajectoryWriter::Params params;
+  if (!js_isobject(J, idx))
+    js_typeerror(J, "TrajectoryWriter: params isn't an object");
+  js_pushiterator(J, idx, 1/*own*/);
+  const char *key;
+  while ((key = js_nextiterator(J, -1))) {
+    std::string k = key;
+    js_getproperty(J, idx, key);
+    if (k == "precision")
+      params.precision = js_tonumber(J, -1);
+    else if (k == "framesPerChunk")
+      params.framesPerChunk = js_touint32(J, -1);
+    else
+      js_typeerror(J, "TrajectoryWriter: unknown parameter '%s'", key);
+    js_pop(J, 1);
+  }
+  js_pop(J, 1);
+  return params;
+}
+
+static void init(js_State *J) {
+  JsSupport::beginDefineClass(J, TAG_TrajectoryWriter, [](js_State *J) { // (fname, molecule[, params]) the file is overwritten, the elements are taken from the molecule
+    AssertNargsRange(2,3)
+    if (GetNArgs() == 2)
+      ReturnObj(new TrajectoryWriter(GetArgString(1), *GetArg(Molecule, 2)));
+    else
+      ReturnObj(new TrajectoryWriter(GetArgString(1), *GetArg(Molecule, 2), readParams(J, 3)));
+  });
+  { // methods
+    ADD_METHOD_CPP(TrajectoryWriter, str, {
+      AssertNargs(0)
+      auto w = GetArg(TrajectoryWriter, 0);
+      Return(J, str(boost::format("trajectory-writer{atoms=%1% precision=%2%}") % w->getNumAtoms() % w->getParams().precision));
+    }, 0)
+    ADD_METHOD_CPP(TrajectoryWriter, toString, {
+      AssertNargs(0)
+      auto w = GetArg(TrajectoryWriter, 0);
+      Return(J, str(boost::format("trajectory-writer{atoms=%1% precision=%2%}") % w->getNumAtoms() % w->getParams().precision));
+    }, 0)
+    ADD_METHOD_CPP(TrajectoryWriter, write, { // (step, molecule or FloatArray8 with x,y,z for each atom)
+      AssertNargs(2)
+      if (js_isuserdata(J, 2, TAG_Molecule))
+        GetArg(TrajectoryWriter, 0)->write(uint64_t(GetArgFloat(1)), GetArg(Molecule, 2)->coords);
+      else if (js_isuserdata(J, 2, TAG_FloatArray8))
+        GetArg(TrajectoryWriter, 0)->write(uint64_t(GetArgFloat(1)), *(const std::vector<double>*)js_touserdata(J, 2, TAG_FloatArray8));
+      else
+        js_typeerror(J, "TrajectoryWriter.write: coordinates should be Molecule or FloatArray8");
+      ReturnVoid(J);
+    }, 2)
+    ADD_METHOD_CPP(TrajectoryWriter, flush, { // writes the incomplete chunk, the file can then be read while it's still being written
+      AssertNargs(0)
+      GetArg(TrajectoryWriter, 0)->flush();
+      ReturnVoid(J);
+    }, 0)
+  }
+  JsSupport::endDefineClass(J);
+}
+
+} // JsTrajectoryWriter
+
+namespace JsTrajectoryReader {
+
+static void xnewo(js_State *J, TrajectoryReader *r) {
+  js_getglobal(J, TAG_TrajectoryReader);
+  js_getproperty(J, -1, "prototype");
+  js_newuserdata(J, TAG_TrajectoryReader, r, [](js_State *J, void *p) {
+    delete (TrajectoryReader*)p;
+  });
+}
+
+static void init(js_State *J) {
+  JsSupport::beginDefineClass(J, TAG_TrajectoryReader, [](js_State *J) { // (fname)
+    AssertNargs(1)
+    ReturnObj(new TrajectoryReader(GetArgString(1)));
+  });
+  { // methods
+    ADD_METHOD_CPP(TrajectoryReader, str, {
+      AssertNargs(0)
+      auto r = GetArg(TrajectoryReader, 0);
+      Return(J, str(boost::format("trajectory-reader{atoms=%1% frames=%2%}") % r->numAtoms() % r->numFrames()));
+    }, 0)
+    ADD_METHOD_CPP(TrajectoryReader, toString, {
+      AssertNargs(0)
+      auto r = GetArg(TrajectoryReader, 0);
+      Return(J, str(boost::format("trajectory-reader{atoms=%1% frames=%2%}") % r->numAtoms() % r->numFrames()));
+    }, 0)
+    ADD_METHOD_CPP(TrajectoryReader, numAtoms, {
+      AssertNargs(0)
+      Return(J, GetArg(TrajectoryReader, 0)->numAtoms());
+    }, 0)
+    ADD_METHOD_CPP(TrajectoryReader, numFrames, {
+      AssertNargs(0)
+      Return(J, GetArg(TrajectoryReader, 0)->numFrames());
+    }, 0)
+    ADD_METHOD_CPP(TrajectoryReader, getPrecision, { // the quantization step of the coordinates, A
+      AssertNargs(0)
+      Return(J, GetArg(TrajectoryReader, 0)->getPrecision());
+    }, 0)
+    ADD_METHOD_CPP(TrajectoryReader, getElements, { // -> Binary: one byte per atom
+      AssertNargs(0)
+      JsBinary::xnewo(J, new Binary(GetArg(TrajectoryReader, 0)->getElements()));
+    }, 0)
+    ADD_METHOD_CPP(TrajectoryReader, readStep, { // (frameIdx) -> the step number of the frame
+      AssertNargs(1)
+      Return(J, (double)GetArg(TrajectoryReader, 0)->readStep(GetArgUInt32(1)));
+    }, 1)
+    ADD_METHOD_CPP(TrajectoryReader, readFrame, { // (frameIdx[, coords]) -> FloatArray8: x,y,z for each atom, the coords object is refilled and returned when passed
+      AssertNargsRange(1,2)
+      if (js_isundefined(J, 2)) {
+        GetArg(TrajectoryReader, 0)->readFrame(GetArgUInt32(1), *JsFloatArray::xnewoEmpty8(J));
+      } else {
+        if (!js_isuserdata(J, 2, TAG_FloatArray8))
+          js_typeerror(J, "TrajectoryReader.readFrame: coords should be FloatArray8");
+        auto coords = (std::vector<double>*)js_touserdata(J, 2, TAG_FloatArray8);
+        if (coords->size() != 3*GetArg(TrajectoryReader, 0)->numAtoms())
+          JsSupport::checkView(J, 2, JsSupport::VIEW_FIXED_SIZE, "TrajectoryReader.readFrame");
+        JsSupport::checkView(J, 2, JsSupport::VIEW_READ_ONLY, "TrajectoryReader.readFrame");
+        GetArg(TrajectoryReader, 0)->readFrame(GetArgUInt32(1), *coords);
+        js_copy(J, 2);
+      }
+    }, 2)
+  }
+  JsSupport::endDefineClass(J);
+}
+
+} // JsTrajectoryReader
+
+//
+// exported functions
+//
+
+namespace helpers {
+  static void applyAttrs(std::ostream &os, const std::vector<std::string> &attrs) {
+    for (auto &attr : attrs) {
+      if (attr == "clr.fg.black")        os << rang::fg::black;
+      else if (attr == "clr.fg.red")     os << rang::fg::red;
+      else if (attr == "clr.fg.green")   os << rang::fg::green;
+      else if (attr == "clr.fg.yellow")  os << rang::fg::yellow;
+      else if (attr == "clr.fg.blue")    os << rang::fg::blue;
+      else if (attr == "clr.fg.magenta") os << rang::fg::magenta;
+      else if (attr == "clr.fg.cyan")    os << rang::fg::cyan;
+      else if (attr == "clr.fg.gray")    os << rang::fg::gray;
+      else if (attr == "clr.fg.reset")   os << rang::fg::reset;
+      else if (attr == "clr.bg.black")   os << rang::bg::black;
+      else if (attr == "clr.bg.red")     os << rang::bg::red;
+      else if (attr == "clr.bg.green")   os << rang::bg::green;
+      else if (attr == "clr.bg.yellow")  os << rang::bg::yellow;
+      else if (attr == "clr.bg.blue")    os << rang::bg::blue;
+      else if (attr == "clr.bg.magenta") os << rang::bg::magenta;
+      else if (attr == "clr.bg.cyan")    os << rang::bg::cyan;
+      else if (attr == "clr.bg.gray")    os << rang::bg::gray;
+      else if (attr == "clr.bg.reset")   os << rang::bg::reset;
+      else
+        ERROR("unknown attr supplied: " << attr)
+    }
+  }
+}
+
+static void print(js_State *J) {
+  AssertNargs(1)
+  std::cout << GetArgString(1) << std::endl;
+  ReturnVoid(J);
+}
+
+static void printn(js_State *J) {
+  AssertNargs(1)
+  std::cout << GetArgString(1);
+  ReturnVoid(J);
+}
+
+static void printa(js_State *J) {
+  AssertNargs(2)
+  helpers::applyAttrs(std::cout, GetArgStringArray(1));
+  std::cout << GetArgString(2) << rang::fg::reset << rang::bg::reset << std::endl;
+  ReturnVoid(J);
+}
+
+static void printna(js_State *J) {
+  AssertNargs(2)
+  helpers::applyAttrs(std::cout, GetArgStringArray(1));
+  std::cout << GetArgString(2);
+  ReturnVoid(J);
+}
+
+static void flush(js_State *J) {
+  AssertNargs(0)
+  std::cout.flush();
+}
 
 namespace JsSystem {
 
@@ -1032,6 +2024,8 @@ static void numCPUs(js_State *J) {
   if (res)
     ERROR_SYSCALL(sysctlbyname)
   Return(J, (unsigned) buf);
+#elif defined(__linux__)
+  Return(J, ThreadPool::numCPUs());
 #else
 #  error "numCPUs not defined for your system"
 #endif
@@ -1057,6 +2051,195 @@ static void setCtlParam(js_State *J) {
 
 } // JsSystem
 
+namespace JsParallel {
+
+class Value { // JS value detached from any js_State so that it can be passed between the workers, userdata objects are copied
+public:
+  enum Kind {Undefined, Null, Boolean, Number, String, Array, Object, MoleculeObj, BinaryObj, FloatArray8Obj, LAVectorDObj, LAMatrixDObj};
+  Kind                                 kind;
+  double                               num;
+  std::string                          str;
+  std::vector<Value>                   elts;     // Array and Object
+  std::vector<std::string>             keys;     // Object
+  std::unique_ptr<Molecule>            molecule;
+  std::unique_ptr<Binary>              binary;
+  std::unique_ptr<std::vector<double>> floats;
+  std::unique_ptr<LAVectorD>           vectorD;
+  std::unique_ptr<LAMatrixD>           matrixD;
+  Value() : kind(Undefined), num(0) { }
+  void read(js_State *J, int idx, unsigned depth = 0) { // idx should be absolute
+    if (depth > 100)
+      js_typeerror(J, "Parallel: value is nested too deep (is it cyclic?)");
+    if (js_isundefined(J, idx)) {
+      kind = Undefined;
+    } else if (js_isnull(J, idx)) {
+      kind = Null;
+    } else if (js_isboolean(J, idx)) {
+      kind = Boolean;
+      num = js_toboolean(J, idx);
+    } else if (js_isnumber(J, idx)) {
+      kind = Number;
+      num = js_tonumber(J, idx);
+    } else if (js_isstring(J, idx)) {
+      kind = String;
+      str = js_tostring(J, idx);
+    } else if (js_isuserdata(J, idx, TAG_Molecule)) {
+      kind = MoleculeObj;
+      molecule.reset(new Molecule(*(Molecule*)js_touserdata(J, idx, TAG_Molecule)));
+    } else if (js_isuserdata(J, idx, TAG_Binary)) {
+      kind = BinaryObj;
+      binary.reset(new Binary(*(Binary*)js_touserdata(J, idx, TAG_Binary)));
+    } else if (js_isuserdata(J, idx, TAG_FloatArray8)) {
+      kind = FloatArray8Obj;
+      floats.reset(new std::vector<double>(*(std::vector<double>*)js_touserdata(J, idx, TAG_FloatArray8)));
+    } else if (js_isuserdata(J, idx, TAG_LAVectorD)) {
+      kind = LAVectorDObj;
+      vectorD.reset(new LAVectorD(*(LAVectorD*)js_touserdata(J, idx, TAG_LAVectorD)));
+    } else if (js_isuserdata(J, idx, TAG_LAMatrixD)) {
+      kind = LAMatrixDObj;
+      matrixD.reset(new LAMatrixD(*(LAMatrixD*)js_touserdata(J, idx, TAG_LAMatrixD)));
+    } else if (js_isarray(J, idx)) {
+      kind = Array;
+      elts.resize(js_getlength(J, idx));
+      for (unsigned i = 0, ie = elts.size(); i < ie; i++) {
+        js_getindex(J, idx, i);
+        elts[i].read(J, js_gettop(J) - 1, depth + 1);
+        js_pop(J, 1);
+      }
+    } else if (js_isuserdata(J, idx, TAG_Atom)) {
+      js_typeerror(J, "Parallel: atoms can't be passed between the workers, pass their molecules instead");
+    } else if (auto tag = otherUserdataTag(J, idx)) { // they would otherwise be read as empty objects
+      js_typeerror(J, "Parallel: %s objects can't be passed between the workers", tag);
+    } else if (js_isobject(J, idx) && !js_iscallable(J, idx)) {
+      kind = Object;
+      js_pushiterator(J, idx, 1/*own*/);
+      while (auto key = js_nextiterator(J, -1)) {
+        keys.push_back(key);
+        js_getproperty(J, idx, key);
+        elts.emplace_back();
+        elts.back().read(J, js_gettop(J) - 1, depth + 1);
+        js_pop(J, 1);
+      }
+      js_pop(J, 1);
+    } else {
+      js_typeerror(J, "Parallel: values of the type '%s' can't be passed between the workers", js_typeof(J, idx));
+    }
+  }
+  void push(js_State *J) { // owned objects are moved into J
+    switch (kind) {
+    case Undefined:      js_pushundefined(J); break;
+    case Null:           js_pushnull(J); break;
+    case Boolean:        js_pushboolean(J, num != 0); break;
+    case Number:         js_pushnumber(J, num); break;
+    case String:         js_pushstring(J, str.c_str()); break;
+    case MoleculeObj:    JsMolecule::xnewo(J, molecule.release()); break;
+    case BinaryObj:      JsBinary::xnewo(J, binary.release()); break;
+    case FloatArray8Obj: JsFloatArray::xnewoEmpty8(J)->swap(*floats); break;
+    case LAVectorDObj:   JsLinearAlgebra::xnewo(J, vectorD.release()); break;
+    case LAMatrixDObj:   JsLinearAlgebra::xnewo(J, matrixD.release()); break;
+    case Array:
+      js_newarray(J);
+      for (unsigned i = 0, ie = elts.size(); i < ie; i++) {
+        elts[i].push(J);
+        js_setindex(J, -2, i);
+      }
+      break;
+    case Object:
+      js_newobject(J);
+      for (unsigned i = 0, ie = elts.size(); i < ie; i++) {
+        elts[i].push(J);
+        js_setproperty(J, -2, keys[i].c_str());
+      }
+      break;
+    }
+  }
+private:
+  static const char* otherUserdataTag(js_State *J, int idx) { // the userdata that isn't copied
+    static const char* const tags[] = {TAG_Obj, TAG_TempFile, TAG_StructureDb, TAG_FingerprintDb, TAG_Substructure, TAG_PeptideBuilder,
+                                       TAG_TorsionTree, TAG_ForceField, TAG_MolecularDynamics, TAG_TrajectoryWriter, TAG_TrajectoryReader,
+                                       TAG_NeighborGrid, TAG_FloatArray4, TAG_LAVectorF, TAG_LAMatrixF, TAG_NeuralNetwork, TAG_Image, TAG_ImageDrawer};
+    for (auto tag : tags)
+      if (js_isuserdata(J, idx, tag))
+        return tag;
+    return nullptr;
+  }
+}; // Value
+
+static js_State* newWorkerState() { // the same environment as the main interpreter has
+  auto J = js_newstate(NULL, NULL, JS_STRICT);
+  if (!J)
+    ERROR("Parallel: failed to create the JavaScript interpreter")
+  js_newarray(J);
+  js_setglobal(J, "scriptArgs");
+  registerFunctions(J);
+  JsSupport::registerFuncRequire(J);
+  JsSupport::registerFuncImportCodeString(J);
+  JsSupport::registerErrorToString(J);
+  return J;
+}
+
+static void map(js_State *J) { // (items, fnSource, nthreads): fnSource is the source of function(item, idx), each worker compiles it in its own interpreter
+  AssertNargs(3)
+  if (!js_isarray(J, 1))
+    js_typeerror(J, "Parallel.map: items should be an array");
+  std::vector<Value> items(js_getlength(J, 1));
+  for (unsigned i = 0, ie = items.size(); i < ie; i++) {
+    js_getindex(J, 1, i);
+    items[i].read(J, js_gettop(J) - 1);
+    js_pop(J, 1);
+  }
+  auto code = "var __parallelMapFn = ("+GetArgString(2)+");";
+  auto nthreads = GetArgUInt32(3);
+
+  std::vector<Value> results(items.size());
+  std::atomic<unsigned> nextItem(0);
+  std::atomic<bool> failed(false);
+  std::mutex errMtx;
+  std::string err;
+  auto nworkers = std::min<unsigned>(nthreads == 0 ? ThreadPool::get().numWorkers() + 1 : nthreads, items.size());
+  ThreadPool::get().parallelFor(nworkers, nworkers, [&](unsigned) {
+    auto W = newWorkerState();
+    auto fail = [&](const std::string &msg) {
+      std::unique_lock<std::mutex> lock(errMtx);
+      if (!failed.exchange(true))
+        err = msg;
+    };
+    if (js_ploadstring(W, "[Parallel.map]", code.c_str()) || (js_pushundefined(W), js_pcall(W, 0))) {
+      fail(std::string("failed to compile the function: ")+js_trystring(W, -1, "Error"));
+    } else {
+      js_pop(W, 1);
+      for (unsigned i; !failed && (i = nextItem++) < items.size();) {
+        js_getglobal(W, "__parallelMapFn");
+        js_pushundefined(W);
+        items[i].push(W);
+        js_pushnumber(W, i);
+        if (js_pcall(W, 2)) {
+          fail("item#"+std::to_string(i)+": "+js_trystring(W, -1, "Error"));
+          break;
+        }
+        if (js_try(W)) { // unsupported results are reported like the errors of the function
+          fail("item#"+std::to_string(i)+": "+js_trystring(W, -1, "Error"));
+          break;
+        }
+        results[i].read(W, js_gettop(W) - 1);
+        js_endtry(W);
+        js_pop(W, 1);
+      }
+    }
+    js_freestate(W);
+  });
+  if (failed)
+    js_error(J, "Parallel.map: %s", err.c_str());
+
+  js_newarray(J);
+  for (unsigned i = 0, ie = results.size(); i < ie; i++) {
+    results[i].push(J);
+    js_setindex(J, -2, i);
+  }
+}
+
+} // JsParallel
+
 namespace JsFile {
 
 static void exists(js_State *J) {
@@ -1197,12 +2380,159 @@ static void writeXyzFile(js_State *J) {
   ReturnVoid(J);
 }
 
+namespace SymmetryFunctions {
+static void compute(js_State *J) { // (molecule or FloatArray8 with coordinates, cutoff, [[eta,Rs],...], [[zeta,lambda,eta],...]) -> LAMatrixD with a column per atom
+  AssertNargs(4)
+  Op::SymmetryFunctionParams params;
+  params.cutoff = GetArgFloat(2);
+  for (auto &r : GetArgFloatArrayArray(3)) {
+    if (r.size() != 2)
+      js_typeerror(J, "SymmetryFunctions.compute: radial parameters should be [eta,Rs]");
+    params.radial.push_back({{r[0], r[1]}});
+  }
+  for (auto &a : GetArgFloatArrayArray(4)) {
+    if (a.size() != 3)
+      js_typeerror(J, "SymmetryFunctions.compute: angular parameters should be [zeta,lambda,eta]");
+    params.angular.push_back({{a[0], a[1], a[2]}});
+  }
+  if (js_isuserdata(J, 1, TAG_Molecule)) { // periodic molecules have their images as neighbors
+    auto m = GetArg(Molecule, 1);
+    JsLinearAlgebra::xnewo(J, Op::computeSymmetryFunctions(m->coords, params, m->getLattice()));
+  } else
+    JsLinearAlgebra::xnewo(J, Op::computeSymmetryFunctions(*(const std::vector<double>*)js_touserdata(J, 1, TAG_FloatArray8), params));
+}
+}
+
+namespace JsOptimizer {
+
+static Optimizer::Params readParams(js_State *J, int idx) { // {method, maxIterations, gradTolerance, energyTolerance, maxStep, memory, fireDt, fireDtMax, frozenAtoms, frozenTorsions, torsionRestraint}
+  Optimizer::Params params;
+  if (!js_isobject(J, idx))
+    js_typeerror(J, "Optimizer.minimize: params isn't an object");
+  js_pushiterator(J, idx, 1/*own*/);
+  const char *key;
+  while ((key = js_nextiterator(J, -1))) {
+    std::string k = key;
+    js_getproperty(J, idx, key);
+    if (k == "method") {
+      std::string method = js_tostring(J, -1);
+      if (method == "lbfgs")
+        params.method = Optimizer::LBFGS;
+      else if (method == "fire")
+        params.method = Optimizer::FIRE;
+      else
+        js_typeerror(J, "Optimizer.minimize: unknown method '%s', expected 'lbfgs' or 'fire'", method.c_str());
+    } else if (k == "maxIterations")
+      params.maxIterations = js_touint32(J, -1);
+    else if (k == "gradTolerance")
+      params.gradTolerance = js_tonumber(J, -1);
+    else if (k == "energyTolerance")
+      params.energyTolerance = js_tonumber(J, -1);
+    else if (k == "maxStep")
+      params.maxStep = js_tonumber(J, -1);
+    else if (k == "memory")
+      params.memory = js_touint32(J, -1);
+    else if (k == "fireDt")
+      params.fireDt = js_tonumber(J, -1);
+    else if (k == "fireDtMax")
+      params.fireDtMax = js_tonumber(J, -1);
+    else if (k == "frozenAtoms")
+      params.frozenAtoms = GetArgUnsignedArray(js_gettop(J)-1);
+    else if (k == "frozenTorsions")
+      for (auto &t : GetArgUnsignedArrayArray(js_gettop(J)-1)) {
+        if (t.size() != 4)
+          js_typeerror(J, "Optimizer.minimize: frozen torsion should be [a1,a2,a3,a4]");
+        params.frozenTorsions.push_back({{t[0], t[1], t[2], t[3]}});
+      }
+    else if (k == "torsionRestraint")
+      params.torsionRestraint = js_tonumber(J, -1);
+    else
+      js_typeerror(J, "Optimizer.minimize: unknown parameter '%s'", key);
+    js_pop(J, 1);
+  }
+  js_pop(J, 1);
+  return params;
+}
+
+static void minimize(js_State *J) { // (molecule or FloatArray8 with coordinates, ForceField or fn(coords, grad) returning the energy and filling grad, [params]) -> {energy, maxGrad, iterations, evaluations, converged}
+  AssertNargsRange(2,3)
+  // coordinates are updated in place
+  std::vector<double> *x = nullptr;
+  if (js_isuserdata(J, 1, TAG_Molecule))
+    x = &GetArg(Molecule, 1)->coords;
+  else if (js_isuserdata(J, 1, TAG_FloatArray8))
+    x = (std::vector<double>*)js_touserdata(J, 1, TAG_FloatArray8);
+  else
+    js_typeerror(J, "Optimizer.minimize: coordinates should be a molecule or FloatArray8");
+  auto params = js_isundefined(J, 3) ? Optimizer::Params() : readParams(J, 3);
+  if (js_isuserdata(J, 2, TAG_ForceField) && js_isuserdata(J, 1, TAG_Molecule) && GetArg(Molecule, 1)->isPeriodic())
+    js_typeerror(J, "Optimizer.minimize: the force field doesn't support periodic molecules");
+  if (js_isuserdata(J, 2, TAG_ForceField) && x->size() != 3*GetArg(ForceField, 2)->getNumAtoms())
+    js_typeerror(J, "Optimizer.minimize: the force field is for %u atoms, the coordinates have %u values", GetArg(ForceField, 2)->getNumAtoms(), unsigned(x->size()));
+
+  bool failed = false;
+  Optimizer::Result res;
+  { // C++ objects are released before the exception is rethrown
+    Optimizer::Objective objective;
+    if (js_isuserdata(J, 2, TAG_ForceField)) {
+      auto ff = GetArg(ForceField, 2);
+      objective = [ff](const std::vector<double> &x, std::vector<double> &grad) {
+        return ff->compute((const Vec3*)x.data(), (Vec3*)grad.data()).total();
+      };
+    } else if (js_iscallable(J, 2)) {
+      // the callback receives the copies of the optimizer's buffers because the script can keep them after minimize returns,
+      // grad is kept on the stack under the call and copied back
+      objective = [J,&failed](const std::vector<double> &x, std::vector<double> &grad) {
+        auto gradJs = JsFloatArray::xnewoEmpty8(J);
+        gradJs->resize(grad.size(), 0);
+        JsSupport::restrictView(J, -1, JsSupport::VIEW_FIXED_SIZE);
+        js_copy(J, 2);
+        js_pushundefined(J);
+        *JsFloatArray::xnewoEmpty8(J) = x;
+        js_copy(J, -4);
+        if (js_pcall(J, 2)) {
+          js_rot2(J);
+          js_pop(J, 1);
+          failed = true; // the exception is on the stack, NaN stops the optimizer
+          return std::numeric_limits<Float>::quiet_NaN();
+        }
+        Float E = js_tonumber(J, -1);
+        grad = *gradJs;
+        js_pop(J, 2);
+        return E;
+      };
+    } else
+      js_typeerror(J, "Optimizer.minimize: the energy provider should be a ForceField or a function");
+    res = Optimizer::minimize(*x, objective, params);
+  }
+  if (failed)
+    js_throw(J);
+
+  js_newobject(J);
+  js_pushnumber(J, res.energy);
+  js_setproperty(J, -2, "energy");
+  js_pushnumber(J, res.maxGrad);
+  js_setproperty(J, -2, "maxGrad");
+  js_pushnumber(J, res.iterations);
+  js_setproperty(J, -2, "iterations");
+  js_pushnumber(J, res.evaluations);
+  js_setproperty(J, -2, "evaluations");
+  js_pushboolean(J, res.converged);
+  js_setproperty(J, -2, "converged");
+}
+
+} // JsOptimizer
+
 namespace Pdb {
-static void readBuffer(js_State *J) {
+static void readBuffer(js_State *J) { // accepts either Binary or a string
   AssertNargs(1)
-  auto mols = Molecule::readPdbBuffer(GetArgString(1));
-  for (auto m : mols)
+  auto mols = js_isuserdata(J, 1, TAG_Binary) ? Molecule::readPdbBuffer(GetArg(Binary, 1)) : Molecule::readPdbBuffer(GetArgString(1));
+  js_newarray(J);
+  unsigned idx = 0;
+  for (auto m : mols) {
     JsMolecule::xnewo(J, m);
+    js_setindex(J, -2, idx++);
+  }
 }
 }
 
@@ -1236,6 +2566,26 @@ namespace Mmtf {
       js_setindex(J, -2, idx++);
     }
   }
+
+  static void readFileParallel(js_State *J) { // (fname, nthreads, withBonds): nthreads=0 uses all CPUs
+    AssertNargs(3)
+    js_newarray(J);
+    unsigned idx = 0;
+    for (auto m : Molecule::readMmtfFile(GetArgString(1), GetArgUInt32(2), GetArgBoolean(3))) {
+      JsMolecule::xnewo(J, m);
+      js_setindex(J, -2, idx++);
+    }
+  }
+
+  static void readBufferParallel(js_State *J) { // (binary, nthreads, withBonds)
+    AssertNargs(3)
+    js_newarray(J);
+    unsigned idx = 0;
+    for (auto m : Molecule::readMmtfBuffer(GetArg(Binary, 1), GetArgUInt32(2), GetArgBoolean(3))) {
+      JsMolecule::xnewo(J, m);
+      js_setindex(J, -2, idx++);
+    }
+  }
 }
 #endif
 
@@ -1532,6 +2882,15 @@ void registerFunctions(js_State *J) {
   JsMolecule::init(J);
   JsTempFile::init(J);
   JsStructureDb::init(J);
+  JsFingerprintDb::init(J);
+  JsSubstructure::init(J);
+  JsPeptideBuilder::init(J);
+  JsTorsionTree::init(J);
+  JsForceField::init(J);
+  JsMolecularDynamics::init(J);
+  JsTrajectoryWriter::init(J);
+  JsTrajectoryReader::init(J);
+  JsNeighborGrid::init(J);
   // externally defined
   JsBinary::init(J);
   JsImage::init(J);
@@ -1557,6 +2916,9 @@ void registerFunctions(js_State *J) {
     else
       ReturnNull(J);
   }, 0)
+  BEGIN_NAMESPACE(Parallel)
+    ADD_NS_FUNCTION_CPP(Parallel, map, JsParallel::map, 3)
+  END_NAMESPACE(Parallel)
   BEGIN_NAMESPACE(System)
     ADD_NS_FUNCTION_CPP(System, numCPUs,            JsSystem::numCPUs, 0)
     ADD_NS_FUNCTION_CPP(System, setCtlParam,        JsSystem::setCtlParam, 2)
@@ -1658,6 +3020,12 @@ void registerFunctions(js_State *J) {
   // Read/Write functions
   //
   ADD_JS_FUNCTION(writeXyzFile, 2)
+  BEGIN_NAMESPACE(SymmetryFunctions)
+    ADD_NS_FUNCTION_CPP(SymmetryFunctions, compute, SymmetryFunctions::compute, 4)
+  END_NAMESPACE(SymmetryFunctions)
+  BEGIN_NAMESPACE(Optimizer)
+    ADD_NS_FUNCTION_CPP(Optimizer, minimize, JsOptimizer::minimize, 3)
+  END_NAMESPACE(Optimizer)
   BEGIN_NAMESPACE(Pdb)
     ADD_NS_FUNCTION_CPP(Pdb, readBuffer,  Pdb::readBuffer, 1)
   END_NAMESPACE(Pdb)
@@ -1668,6 +3036,8 @@ void registerFunctions(js_State *J) {
   BEGIN_NAMESPACE(Mmtf)
     ADD_NS_FUNCTION_CPP(Mmtf, readFile,   Mmtf::readFile, 1)
     ADD_NS_FUNCTION_CPP(Mmtf, readBuffer, Mmtf::readBuffer, 1)
+    ADD_NS_FUNCTION_CPP(Mmtf, readFileParallel,   Mmtf::readFileParallel, 3)
+    ADD_NS_FUNCTION_CPP(Mmtf, readBufferParallel, Mmtf::readBufferParallel, 3)
   END_NAMESPACE(Mmtf)
 #endif
 
@@ -1726,11 +3096,15 @@ void registerFunctions(js_State *J) {
   BEGIN_NAMESPACE(Moleculex) // TODO figure out how to have the same namespace for methodsand functions
     ADD_NS_FUNCTION_CPP(Moleculex, fromXyzOne, JsMolecule::fromXyzOne, 1)
     ADD_NS_FUNCTION_CPP(Moleculex, fromXyzMany, JsMolecule::fromXyzMany, 1)
+    ADD_NS_FUNCTION_CPP(Moleculex, forEachXyzFrame, JsMolecule::forEachXyzFrame, 3)
+    ADD_NS_FUNCTION_CPP(Moleculex, forEachXyzFrameCoords, JsMolecule::forEachXyzFrameCoords, 2)
     ADD_NS_FUNCTION_CPP(Moleculex, listNeighborsHierarchically, JsMolecule::listNeighborsHierarchically, 4)
 #if defined(USE_OPENBABEL)
     ADD_NS_FUNCTION_CPP(Moleculex, fromSMILES, JsMolecule::fromSMILES, 2)
 #endif
-    ADD_NS_FUNCTION_JS (Moleculex, rmsd, function(m1, m2) {return Vec3.rmsd(m1.extractCoords(), m2.extractCoords())})
+    ADD_NS_FUNCTION_JS (Moleculex, rmsd, function(m1, m2) {return m1.rmsd(m2)})
+    ADD_NS_FUNCTION_CPP(Moleculex, rmsdMatrix, JsMolecule::rmsdMatrix, 2)
+    ADD_NS_FUNCTION_CPP(Moleculex, rmsdOneToMany, JsMolecule::rmsdOneToMany, 3)
     ADD_NS_FUNCTION_CPP(Moleculex, angleIntToStr, JsMolecule::angleIntToStr, 1)
     ADD_NS_FUNCTION_CPP(Moleculex, angleStrToInt, JsMolecule::angleStrToInt, 1)
   END_NAMESPACE(Moleculex)
@@ -1786,6 +3160,7 @@ void registerFunctions(js_State *J) {
       AssertNargs(4)
       auto fd = GetArgUInt32(1);
       auto buf = GetArg(Binary, 2);
+      JsSupport::checkView(J, 2, JsSupport::VIEW_READ_ONLY, "FileApi.read");
       auto off = GetArgUInt32(3);
       auto size = GetArgUInt32(4);
       auto bufSz = buf->size();
@@ -1892,6 +3267,7 @@ void registerFunctions(js_State *J) {
       AssertNargs(4)
       auto fd = GetArgUInt32(1);
       auto buf = GetArg(Binary, 2);
+      JsSupport::checkView(J, 2, JsSupport::VIEW_READ_ONLY, "SocketApi.read");
       auto off = GetArgUInt32(3);
       auto len = GetArgUInt32(4);
       auto bufSz = buf->size();
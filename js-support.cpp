@@ -186,6 +186,20 @@ void JsSupport::error(js_State *J, const std::string &msg) {
   js_throw(J);
 }
 
+void JsSupport::restrictView(js_State *J, int idx, unsigned restrictions) {
+  js_pushnumber(J, restrictions);
+  js_defproperty(J, idx < 0 ? idx - 1 : idx, "viewRestrictions", JS_READONLY | JS_DONTENUM | JS_DONTCONF);
+}
+
+void JsSupport::checkView(js_State *J, int idx, ViewRestriction restriction, const char *fname) {
+  if (!js_hasproperty(J, idx, "viewRestrictions"))
+    return;
+  auto restrictions = js_touint32(J, -1);
+  js_pop(J, 1);
+  if (restrictions & restriction)
+    js_typeerror(J, "%s: the view can't be %s, it shares the data with another object", fname, restriction == VIEW_FIXED_SIZE ? "resized" : "modified");
+}
+
 /// internals
 
 void JsSupport::initObjectRegistry(js_State *J, const char *objTag) {
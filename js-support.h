@@ -42,6 +42,10 @@ public:
   static std::vector<int> objToInt32ArrayZ(js_State *J, int idx, const char *fname);
   static char toChar(js_State *J, int idx);
   [[noreturn]] static void error(js_State *J, const std::string &msg);
+  // views: FloatArray/Binary objects sharing the data of other objects, whose size or contents these objects rely on
+  enum ViewRestriction {VIEW_FIXED_SIZE = 1, VIEW_READ_ONLY = 2};
+  static void restrictView(js_State *J, int idx, unsigned restrictions);
+  static void checkView(js_State *J, int idx, ViewRestriction restriction, const char *fname); // throws when the object has the restriction
 private:
   static void initObjectRegistry(js_State *J, const char *objTag);
   static void popPreviousStackElement(js_State *J);
@@ -83,6 +87,8 @@ private:
 #define AssertNargs(n)           assert(js_gettop(J) == n+1);
 #define AssertNargsRange(n1,n2)  assert(n1+1 <= js_gettop(J) && js_gettop(J) <= n2+1);
 #define AssertNargs2(nmin,nmax)  assert(nmin+1 <= js_gettop(J) && js_gettop(J) <= nmax+1);
+#define AssertResizable(fname)   JsSupport::checkView(J, 0, JsSupport::VIEW_FIXED_SIZE, fname);
+#define AssertWritable(fname)    JsSupport::checkView(J, 0, JsSupport::VIEW_READ_ONLY, fname);
 #define AssertStack(n)           assert(js_gettop(J) == n);
 
 //
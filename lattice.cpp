@@ -0,0 +1,71 @@
+#include "lattice.h"
+#include "xerror.h"
+
+/// Lattice
+
+Lattice::Lattice(const std::array<Vec3,3> &newVecs)
+: vecs(newVecs)
+{
+  auto det = vecs[0]*vecs[1].cross(vecs[2]);
+  if (!(std::abs(det) > 1e-12*vecs[0].len()*vecs[1].len()*vecs[2].len()))
+    ERROR("Lattice: the lattice vectors " << vecs[0] << ", " << vecs[1] << ", " << vecs[2] << " don't span a cell")
+  recip = {{vecs[1].cross(vecs[2])/det, vecs[2].cross(vecs[0])/det, vecs[0].cross(vecs[1])/det}};
+}
+
+Vec3 Lattice::wrap(const Vec3 &p) const {
+  auto f = toFractional(p);
+  return p - toCartesian(Vec3(std::floor(f[0]), std::floor(f[1]), std::floor(f[2])));
+}
+
+Vec3 Lattice::minimumImage(const Vec3 &d) const {
+  // rounding of the fractional coordinates is only exact for the orthogonal cells, the neighbors of that image are also checked
+  auto f = toFractional(d);
+  auto r = d - toCartesian(Vec3(std::round(f[0]), std::round(f[1]), std::round(f[2])));
+  auto best = r;
+  for (int i = -1; i <= 1; i++)
+    for (int j = -1; j <= 1; j++)
+      for (int k = -1; k <= 1; k++) {
+        auto c = r + toCartesian(Vec3(i, j, k));
+        if (c.len2() < best.len2())
+          best = c;
+      }
+  return best;
+}
+
+/// internals
+
+void Lattice::buildImages(const std::vector<Vec3> &pts, Float radius, Images &images) const {
+  // the points are wrapped into the cell, and their images are kept when they are within the radius of the cell:
+  // a point at the distance up to radius from the cell is within radius/width beyond it in the fractional coordinates
+  std::array<Float,3> margin;
+  std::array<int,3> maxShift;
+  for (unsigned d = 0; d < 3; d++) {
+    margin[d] = radius/width(d);
+    maxShift[d] = int(std::ceil(margin[d])) + 1;
+  }
+  std::vector<Vec3> fracs;
+  for (auto &p : pts) {
+    auto f = toFractional(p);
+    fracs.push_back(Vec3(f[0] - std::floor(f[0]), f[1] - std::floor(f[1]), f[2] - std::floor(f[2])));
+  }
+  auto add = [this,&images](const Vec3 &f, unsigned idx, bool isPositive) {
+    images.pts.push_back(toCartesian(f));
+    images.idx.push_back(idx);
+    images.isPositive.push_back(isPositive);
+  };
+  // the primary images first
+  for (unsigned i = 0, ie = pts.size(); i < ie; i++)
+    add(fracs[i], i, false);
+  for (int sa = -maxShift[0]; sa <= maxShift[0]; sa++)
+    for (int sb = -maxShift[1]; sb <= maxShift[1]; sb++)
+      for (int sc = -maxShift[2]; sc <= maxShift[2]; sc++) {
+        if (sa == 0 && sb == 0 && sc == 0)
+          continue;
+        bool isPositive = sa > 0 || (sa == 0 && (sb > 0 || (sb == 0 && sc > 0)));
+        for (unsigned i = 0, ie = pts.size(); i < ie; i++) {
+          auto f = fracs[i] + Vec3(sa, sb, sc);
+          if (-margin[0] <= f[0] && f[0] <= 1 + margin[0] && -margin[1] <= f[1] && f[1] <= 1 + margin[1] && -margin[2] <= f[2] && f[2] <= 1 + margin[2])
+            add(f, i, isPositive);
+        }
+      }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Vec3.h"
+#include "neighbor-grid.h"
+
+#include <vector>
+#include <array>
+#include <cmath>
+
+//
+// Lattice: periodic unit cell spanned by the lattice vectors a, b, c
+//          Periodic searches build the images of the points that are within the radius of the cell (ghost points)
+//          and search them with NeighborGrid, so they are exact for any radius, also when it's larger than the cell.
+//
+
+class Lattice {
+  std::array<Vec3,3> vecs;   // a, b, c
+  std::array<Vec3,3> recip;  // fractional coordinate d of the point p is recip[d]*p
+public: // constr/iface
+  Lattice(const std::array<Vec3,3> &newVecs);
+  const std::array<Vec3,3>& getVectors() const {return vecs;}
+  Float volume() const {return std::abs(vecs[0]*vecs[1].cross(vecs[2]));}
+  Float width(unsigned d) const {return 1/recip[d].len();} // the distance between the faces of the cell across the direction d
+  Vec3 toFractional(const Vec3 &p) const {return Vec3(recip[0]*p, recip[1]*p, recip[2]*p);}
+  Vec3 toCartesian(const Vec3 &f) const {return vecs[0]*f[0] + vecs[1]*f[1] + vecs[2]*f[2];}
+  Vec3 wrap(const Vec3 &p) const; // the image of p in the cell
+  Vec3 minimumImage(const Vec3 &d) const; // the shortest periodic image of the displacement d
+  Lattice scaled(const std::array<unsigned,3> &n) const {return Lattice(std::array<Vec3,3>{{vecs[0]*Float(n[0]), vecs[1]*Float(n[1]), vecs[2]*Float(n[2])}});}
+  template<typename Pred>
+  bool anyPairWithin(const std::vector<Vec3> &pts, Float radius, Pred &&pred) const { // pred(i, j, d, dist2) for the periodic pairs with dist<=radius
+                                                                                     // until it returns true: d is from pts[i] to the image of pts[j],
+                                                                                     // pairs come once with i<j, or with i==j for the images of the point itself
+    Images images;
+    buildImages(pts, radius, images);
+    if (images.pts.empty())
+      return false;
+    NeighborGrid grid(images.pts, radius);
+    for (unsigned i = 0, ie = pts.size(); i < ie; i++) {
+      auto &pi = images.pts[i]; // the primary images come first, in the order of pts
+      if (grid.anyWithin(pi, radius, [&](unsigned k, Float dist2) {
+        auto j = images.idx[k];
+        return (j > i || (j == i && images.isPositive[k])) && pred(i, j, images.pts[k] - pi, dist2);
+      }))
+        return true;
+    }
+    return false;
+  }
+  template<typename Fn>
+  void forEachPairWithin(const std::vector<Vec3> &pts, Float radius, Fn &&fn) const { // fn(i, j, d, dist2) for each periodic pair with dist<=radius, see anyPairWithin
+    anyPairWithin(pts, radius, [&fn](unsigned i, unsigned j, const Vec3 &d, Float dist2) {
+      fn(i, j, d, dist2);
+      return false;
+    });
+  }
+private: // internals
+  struct Images {
+    std::vector<Vec3>     pts;
+    std::vector<unsigned> idx;        // the original point index
+    std::vector<bool>     isPositive; // the lattice shift is lexicographically positive, to tell the two directions of the self-image pairs
+  }; // Images
+  void buildImages(const std::vector<Vec3> &pts, Float radius, Images &images) const;
+}; // Lattice
@@ -22,21 +22,19 @@ function decodePeptide(peptide, f) {
   }
 }
 
+var builder // PeptideBuilder keeps the amino acid templates between the calls
+
 function combine(peptide, angles) {
   if (angles != undefined && angles.length != 0 && angles.length != peptide.length-1)
     throw "peptide combine: unmatching angles array provided, angles.length=" + angles.length + ", expected " + (peptide.length-1)
-  var peptideChain
+  if (builder == undefined)
+    builder = new PeptideBuilder
   decodePeptide(peptide, function(i,code) {
-    var aaMolecule = Moleculex.fromXyzOne(codeToFile(code))
-    if (i == 0) {
-      peptideChain = aaMolecule
-    } else {
-      var anglesOne = angles != undefined ? angles[i-1] : undefined
-      peptideChain.appendAminoAcid(aaMolecule, anglesOne)
-    }
-    var prevCode = code
+    if (!builder.hasResidue(code))
+      builder.setResidue(code, Moleculex.fromXyzOne(codeToFile(code)))
   })
-  return peptideChain
+  builder.appendSequence(peptide, angles)
+  return builder.takeMolecule()
 }
 
 //
@@ -0,0 +1,66 @@
+// module CalcMm: molecular mechanics computation module using the built-in ForceField, energies are in kcal/mol
+
+var CalcUtils = require('calc-utils')
+
+var nameUpp = "MM"
+var nameLwr = "mm"
+
+//
+// local functions
+//
+
+var optParamKeys = ["method", "maxIterations", "gradTolerance", "energyTolerance", "maxStep", "memory", "fireDt", "fireDtMax",
+                    "frozenAtoms", "frozenTorsions", "torsionRestraint"]
+
+function paramsToFfParams(engParams) {
+  var ffParams = {}
+  Object.keys(engParams).forEach(function(key) {
+    if (key == "cutoff" || key == "dielectric" || key == "scale14" || key == "charges")
+      ffParams[key] = engParams[key]
+    else if (key != "precision" && optParamKeys.indexOf(key) == -1 && !CalcUtils.isValidParam(key))
+      xthrow("unexpected key '"+key+"' found in params passed to the '"+nameUpp+"' calc engine")
+  })
+  return ffParams
+}
+
+function paramsToOptParams(engParams) {
+  var optParams = {}
+  optParamKeys.forEach(function(key) {
+    if (engParams[key] != undefined)
+      optParams[key] = engParams[key]
+  })
+  return optParams
+}
+
+function xthrow(msg) {
+  throw "ERROR("+nameUpp+") "+msg
+}
+
+//
+// export: creates the instance of the MM calculation module
+//
+
+exports.create = function() {
+  return {
+    toString: function() {return nameUpp+" calc module"},
+    kind: function() {return nameLwr},
+    calcEnergy: function(m, params, outGradients) { // outGradients receives [dE/dx,dE/dy,dE/dz] for each atom when it is an array
+      var ff = new ForceField(m, paramsToFfParams(CalcUtils.argParams(params)))
+      if (outGradients == undefined)
+        return ff.calcEnergy(m)
+      var grad = new FloatArray8
+      var energy = ff.calcEnergy(m, grad) // one evaluation for both
+      for (var i = 0; i < m.numAtoms(); i++)
+        outGradients.push([grad.get(3*i), grad.get(3*i+1), grad.get(3*i+2)])
+      return energy
+    },
+    calcOptimized: function(m, params) { // returns the optimized copy of the molecule
+      params = CalcUtils.argParams(params)
+      var mo = m.dupl()
+      var res = Optimizer.minimize(mo, new ForceField(mo, paramsToFfParams(params)), paramsToOptParams(params))
+      if (!res.converged)
+        xthrow("optimization didn't converge after "+res.iterations+" iterations, the largest gradient is "+res.maxGrad)
+      return mo
+    }
+  }
+}
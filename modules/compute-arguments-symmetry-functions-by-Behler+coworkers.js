@@ -7,11 +7,73 @@
 
 // arg: atoms: [[elt1, [pos1...]], [elt2, [pos2...]], ...]
 
+// cutoff radius in Å, used by the cutoff function fc
+exports.cutoff = 5;
+
+// 8 functions from Table I: Hyperparameters used in the radial descriptor Gα²: [eta, Rs]
+exports.radialParams = [
+	[0.0001, 0],
+	[0.001,  0],
+	[0.02,   0],
+	[0.035,  0],
+	[0.06,   0],
+	[0.1,    0],
+	[0.2,    0],
+	[0.4,    0]
+];
+
+// 43 functions from Table I: Hyperparameters used in the angular descriptor Gα⁴: [zeta, lambda, eta]
+exports.angularParams = [
+	[1,  -1, 0.0001], // #1
+	[1,   1, 0.0001], // #2
+	[2,  -1, 0.0001], // #3
+	[2,   1, 0.0001], // #4
+	[1,  -1, 0.0003], // #5
+	[1,   1, 0.0003], // #6
+	[2,  -1, 0.0003], // #7
+	[2,   1, 0.0003], // #8
+	[1,  -1, 0.0008], // #9
+	[1,   1, 0.0008], // #10
+	[2,  -1, 0.0008], // #11
+	[2,   1, 0.0008], // #12
+	[1,  -1, 0.0015], // #13
+	[1,   1, 0.0015], // #14
+	[2,  -1, 0.0015], // #15
+	[2,   1, 0.0015], // #16
+	[4,  -1, 0.0015], // #17
+	[4,   1, 0.0015], // #18
+	[16, -1, 0.0015], // #19
+	[16,  1, 0.0015], // #20
+	[1,  -1, 0.0025], // #21
+	[1,   1, 0.0025], // #22
+	[2,  -1, 0.0025], // #23
+	[2,   1, 0.0025], // #24
+	[4,  -1, 0.0025], // #25
+	[4,   1, 0.0025], // #26
+	[16, -1, 0.0025], // #27
+	[16,  1, 0.0025], // #28
+	[1,  -1, 0.0045], // #29
+	[1,   1, 0.0045], // #30
+	[2,  -1, 0.0045], // #31
+	[2,   1, 0.0045], // #32
+	[4,  -1, 0.0045], // #33
+	[4,   1, 0.0045], // #34
+	[16, -1, 0.0045], // #35
+	[16,  1, 0.0045], // #36
+	[1,  -1, 0.08],   // #37
+	[1,   1, 0.08],   // #38
+	[2,  -1, 0.08],   // #39
+	[2,   1, 0.08],   // #40
+	[4,  -1, 0.08],   // #41
+	[4,   1, 0.08],   // #42
+	[16,  1, 0.08]    // #43
+];
+
 exports.computeArguments = function(a, atoms) {
 
 	// helper functions used in the computation
 	var fc = function(r) { // the cutoff function
-		var Rc = 5; // Å
+		var Rc = exports.cutoff;
 		return r<Rc ? 0.5*(Math.cos(Math.PI*r/Rc) + 1) : 0;
 	};
 	var sq = function(x) {
@@ -72,60 +134,26 @@ exports.computeArguments = function(a, atoms) {
 		return Z*sum;
 	};
 
-	return [
-		// 8 functions from Table I: Hyperparameters used in the radial descriptor Gα²
-		Ga2a(a, 0.0001, 0),
-		Ga2a(a, 0.001,  0),
-		Ga2a(a, 0.02,   0),
-		Ga2a(a, 0.035,  0),
-		Ga2a(a, 0.06,   0),
-		Ga2a(a, 0.1,    0),
-		Ga2a(a, 0.2,    0),
-		Ga2a(a, 0.4,    0),
+	return exports.radialParams.map(function(p) {
+		return Ga2a(a, p[0], p[1]);
+	}).concat(exports.angularParams.map(function(p) {
+		return Ga4a(a, p[0], p[1], p[2]);
+	}));
+};
 
-		// 43 functions from Table I: Hyperparameters used in the angular descriptor Gα⁴
-		Ga4a(a, 1,    -1,    0.0001), // #1
-		Ga4a(a, 1,     1,    0.0001), // #2
-		Ga4a(a, 2,    -1,    0.0001), // #3
-		Ga4a(a, 2,     1,    0.0001), // #4
-		Ga4a(a, 1,    -1,    0.0003), // #5
-		Ga4a(a, 1,     1,    0.0003), // #6
-		Ga4a(a, 2,    -1,    0.0003), // #7
-		Ga4a(a, 2,     1,    0.0003), // #8
-		Ga4a(a, 1,    -1,    0.0008), // #9
-		Ga4a(a, 1,     1,    0.0008), // #10
-		Ga4a(a, 2,    -1,    0.0008), // #11
-		Ga4a(a, 2,     1,    0.0008), // #12
-		Ga4a(a, 1,    -1,    0.0015), // #13
-		Ga4a(a, 1,     1,    0.0015), // #14
-		Ga4a(a, 2,    -1,    0.0015), // #15
-		Ga4a(a, 2,     1,    0.0015), // #16
-		Ga4a(a, 4,    -1,    0.0015), // #17
-		Ga4a(a, 4,     1,    0.0015), // #18
-		Ga4a(a, 16,   -1,    0.0015), // #19
-		Ga4a(a, 16,    1,    0.0015), // #20
-		Ga4a(a, 1,    -1,    0.0025), // #21
-		Ga4a(a, 1,     1,    0.0025), // #22
-		Ga4a(a, 2,    -1,    0.0025), // #23
-		Ga4a(a, 2,     1,    0.0025), // #24
-		Ga4a(a, 4,    -1,    0.0025), // #25
-		Ga4a(a, 4,     1,    0.0025), // #26
-		Ga4a(a, 16,   -1,    0.0025), // #27
-		Ga4a(a, 16,    1,    0.0025), // #28
-		Ga4a(a, 1,    -1,    0.0045), // #29
-		Ga4a(a, 1,     1,    0.0045), // #30
-		Ga4a(a, 2,    -1,    0.0045), // #31
-		Ga4a(a, 2,     1,    0.0045), // #32
-		Ga4a(a, 4,    -1,    0.0045), // #33
-		Ga4a(a, 4,     1,    0.0045), // #34
-		Ga4a(a, 16,   -1,    0.0045), // #35
-		Ga4a(a, 16,    1,    0.0045), // #36
-		Ga4a(a, 1,    -1,    0.08),   // #37
-		Ga4a(a, 1,     1,    0.08),   // #38
-		Ga4a(a, 2,    -1,    0.08),   // #39
-		Ga4a(a, 2,     1,    0.08),   // #40
-		Ga4a(a, 4,    -1,    0.08),   // #41
-		Ga4a(a, 4,     1,    0.08),   // #42
-		Ga4a(a, 16,    1,    0.08)    // #43
-	];
+// arguments for all atoms at once computed natively, the same values as computeArguments(a, atoms) for every a
+exports.computeArgumentsForAll = function(atoms) {
+	var coords = new FloatArray8();
+	atoms.forEach(function(atom) {
+		coords.append3(atom[1][0], atom[1][1], atom[1][2]);
+	});
+	var m = SymmetryFunctions.compute(coords, exports.cutoff, exports.radialParams, exports.angularParams);
+	var res = [];
+	for (var a = 0; a < atoms.length; a++) {
+		var args = [];
+		for (var f = 0, fe = m.rows(); f < fe; f++)
+			args.push(m.get(f, a));
+		res.push(args);
+	}
+	return res;
 };
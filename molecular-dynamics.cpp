@@ -0,0 +1,145 @@
+#include "molecular-dynamics.h"
+#include "periodic-table-data.h"
+#include "xerror.h"
+
+#include <cmath>
+#include <random>
+#include <algorithm>
+
+/// units
+
+namespace {
+
+const Float kB           = 0.0019872041; // kcal/mol/K
+const Float accelFactor  = 4.184e-4;     // (kcal/mol/A)/amu -> A/fs^2
+const Float kineticFactor = 1/accelFactor; // amu*A^2/fs^2 -> kcal/mol
+
+}
+
+/// MolecularDynamics
+
+MolecularDynamics::MolecularDynamics(const Molecule &m, const ForceField &newFf, const Params &newParams)
+: ff(newFf), params(newParams), numAtoms(m.numAtoms()), vel(m.numAtoms(), Vec3(0,0,0)), grad(m.numAtoms())
+{
+  if (m.isPeriodic())
+    ERROR("MolecularDynamics: periodic molecules aren't supported")
+  if (ff.getNumAtoms() != numAtoms)
+    ERROR("MolecularDynamics: the molecule has " << numAtoms << " atoms, the force field was created for " << ff.getNumAtoms() << " atoms")
+  if (!(params.timeStep > 0))
+    ERROR("MolecularDynamics: timeStep should be positive, got " << params.timeStep)
+  if (params.temperature < 0 || params.thermostatTau < 0 || params.skin < 0)
+    ERROR("MolecularDynamics: temperature, thermostatTau and skin can't be negative")
+  if (!params.trajectoryFile.empty() && params.frameInterval == 0)
+    ERROR("MolecularDynamics: frameInterval should be positive when the trajectory is written")
+  stats = Stats{0, 0, 0, 0, 0, 0};
+
+  auto &ptd = PeriodicTableData::get();
+  for (auto e : m.elements) {
+    masses.push_back(ptd(e).atomic_mass);
+    invMasses.push_back(1/masses.back());
+  }
+
+  // Maxwell-Boltzmann velocities without the net momentum, scaled to the exact temperature
+  if (params.temperature > 0 && numAtoms > 1) {
+    std::mt19937 rng(params.seed);
+    std::normal_distribution<Float> normal;
+    Vec3 momentum(0,0,0);
+    Float totalMass = 0;
+    for (unsigned a = 0; a < numAtoms; a++) {
+      auto sigma = std::sqrt(kB*params.temperature*invMasses[a]*accelFactor);
+      vel[a] = Vec3(normal(rng), normal(rng), normal(rng))*sigma;
+      momentum += vel[a]*masses[a];
+      totalMass += masses[a];
+    }
+    for (auto &v : vel)
+      v -= momentum/totalMass;
+    auto scale = std::sqrt(params.temperature*numDegreesOfFreedom()*kB/(2*kineticEnergy()));
+    for (auto &v : vel)
+      v *= scale;
+  }
+
+  if (!params.trajectoryFile.empty()) {
+    TrajectoryWriter::Params trajectoryParams;
+    trajectoryParams.precision = params.trajectoryPrecision;
+    trajectory.reset(new TrajectoryWriter(params.trajectoryFile, m, trajectoryParams));
+  }
+}
+
+const MolecularDynamics::Stats& MolecularDynamics::run(Molecule &m, unsigned numSteps) {
+  if (m.numAtoms() != numAtoms)
+    ERROR("MolecularDynamics: the molecule has " << m.numAtoms() << " atoms, the dynamics was created for " << numAtoms << " atoms")
+  if (m.isPeriodic())
+    ERROR("MolecularDynamics: periodic molecules aren't supported")
+  auto pos = (Vec3*)m.coords.data(); // positions are updated in place
+  auto dt = params.timeStep;
+
+  // coordinates could have been changed since the last run
+  updatePairList(pos, true/*force*/);
+  computeForces(pos);
+
+  for (unsigned s = 0; s < numSteps; s++) {
+    // velocity Verlet
+    for (unsigned a = 0; a < numAtoms; a++) {
+      vel[a] -= grad[a]*(dt/2*accelFactor*invMasses[a]);
+      pos[a] += vel[a]*dt;
+    }
+    updatePairList(pos, false/*force*/);
+    computeForces(pos);
+    for (unsigned a = 0; a < numAtoms; a++)
+      vel[a] -= grad[a]*(dt/2*accelFactor*invMasses[a]);
+
+    // thermostat
+    stats.kinetic = kineticEnergy();
+    if (params.thermostatTau > 0 && stats.kinetic > 0) {
+      auto T = 2*stats.kinetic/(numDegreesOfFreedom()*kB);
+      auto lambda = std::sqrt(std::max(Float(0), 1 + dt/params.thermostatTau*(params.temperature/T - 1)));
+      for (auto &v : vel)
+        v *= lambda;
+      stats.kinetic *= lambda*lambda;
+    }
+
+    stats.step++;
+    if (trajectory && stats.step % params.frameInterval == 0)
+      trajectory->write(stats.step, m.coords);
+  }
+
+  if (trajectory)
+    trajectory->flush();
+  stats.time = stats.step*dt;
+  stats.kinetic = kineticEnergy();
+  stats.temperature = 2*stats.kinetic/(numDegreesOfFreedom()*kB);
+  return stats;
+}
+
+void MolecularDynamics::setVelocities(const std::vector<Vec3> &newVel) {
+  if (newVel.size() != numAtoms)
+    ERROR("MolecularDynamics: velocities array has " << newVel.size() << " elements, expected " << numAtoms)
+  vel = newVel;
+}
+
+/// internals
+
+Float MolecularDynamics::kineticEnergy() const {
+  Float E = 0;
+  for (unsigned a = 0; a < numAtoms; a++)
+    E += masses[a]*vel[a].len2();
+  return E/2*kineticFactor;
+}
+
+void MolecularDynamics::updatePairList(const Vec3 *pos, bool force) {
+  if (!force) { // valid while no atom moved by more than skin/2
+    auto maxMove2 = params.skin*params.skin/4;
+    bool valid = true;
+    for (unsigned a = 0; a < numAtoms && valid; a++)
+      valid = (pos[a] - listPos[a]).len2() <= maxMove2;
+    if (valid)
+      return;
+  }
+  pairs = ff.findPairs(pos, ff.getCutoff() + params.skin);
+  listPos.assign(pos, pos + numAtoms);
+  stats.numListRebuilds++;
+}
+
+void MolecularDynamics::computeForces(const Vec3 *pos) {
+  stats.potential = ff.compute(pos, pairs, grad.data()).total();
+}
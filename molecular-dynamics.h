@@ -0,0 +1,63 @@
+#pragma once
+
+#include "force-field.h"
+#include "trajectory.h"
+#include "Vec3.h"
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+
+//
+// MolecularDynamics: velocity Verlet integration of the molecule's motion in the ForceField with the Berendsen thermostat
+//                    The non-bonded terms are evaluated over the Verlet pair list found with a cell list,
+//                    frames are streamed into the trajectory file. Units: fs, Angstroms, amu, kcal/mol, K.
+//                    Velocities are kept between the runs, coordinates are taken from the molecule and written back to it.
+//
+
+class MolecularDynamics {
+public:
+  struct Params {
+    Float       timeStep;       // fs
+    Float       temperature;    // K: of the initial velocities and the thermostat target
+    Float       thermostatTau;  // fs: the Berendsen coupling time, 0 disables the thermostat (NVE)
+    Float       skin;           // the pair list covers cutoff+skin, it is rebuilt when some atom moves by more than skin/2
+    unsigned    seed;           // for the initial velocities
+    std::string trajectoryFile; // frames are written into it every frameInterval steps when it isn't empty
+    unsigned    frameInterval;
+    Float       trajectoryPrecision; // A: the quantization step of the trajectory coordinates
+    Params() : timeStep(0.5), temperature(300), thermostatTau(100), skin(1), seed(1), frameInterval(100), trajectoryPrecision(0.001) { }
+  }; // Params
+  struct Stats {
+    uint64_t    step;           // the total number of steps done
+    Float       time;           // fs
+    Float       potential;      // kcal/mol
+    Float       kinetic;        // kcal/mol
+    Float       temperature;    // K, instantaneous
+    unsigned    numListRebuilds;
+  }; // Stats
+private:
+  ForceField                        ff;
+  Params                            params;
+  unsigned                          numAtoms;
+  std::vector<Float>                invMasses;  // 1/amu
+  std::vector<Float>                masses;
+  std::vector<Vec3>                 vel;        // A/fs
+  std::vector<Vec3>                 grad;       // kcal/mol/A
+  ForceField::PairList              pairs;
+  std::vector<Vec3>                 listPos;    // positions at the time the pair list was found
+  std::unique_ptr<TrajectoryWriter> trajectory;
+  Stats                             stats;
+public: // constr/iface
+  MolecularDynamics(const Molecule &m, const ForceField &newFf, const Params &newParams = Params());
+  const Stats& run(Molecule &m, unsigned numSteps); // m should have the same atoms as the one the dynamics was created from
+  const Stats& getStats() const {return stats;}
+  const std::vector<Vec3>& getVelocities() const {return vel;}
+  void setVelocities(const std::vector<Vec3> &newVel);
+private: // internals
+  unsigned numDegreesOfFreedom() const {return numAtoms > 1 ? 3*numAtoms - 3 : 3*numAtoms;} // the momentum is removed
+  Float kineticEnergy() const;
+  void updatePairList(const Vec3 *pos, bool force);
+  void computeForces(const Vec3 *pos);
+}; // MolecularDynamics
@@ -1,100 +1,164 @@
-
 #include "molecule.h"
 #include "xerror.h"
 #include "periodic-table-data.h"
+#include "thread-pool.h"
 
 #include <string>
 #include <memory>
+#include <array>
+#include <algorithm>
 
 #include <mmtf.hpp>
 
 
 /// Molecule: MMTF chemical structure format reader
 
-static std::vector<Molecule*> readMolecule(const mmtf::StructureData &sd) {
-  std::vector<Molecule*> res;
+// starting chain/group/atom through indexes of a model, computed with prefix sums so that models can be built independently
+struct ModelStart {
+  int chain;
+  int group;
+  int atom;
+};
+
+static std::vector<ModelStart> computeModelStarts(const mmtf::StructureData &sd) { // numModels+1 entries, the last one is the end
+  std::vector<ModelStart> starts;
+  starts.reserve(sd.numModels + 1);
+  ModelStart s = {0, 0, 0};
+  for (int im = 0; im < sd.numModels; im++) {
+    starts.push_back(s);
+    for (int ic = 0; ic < sd.chainsPerModel[im]; ic++, s.chain++)
+      for (int ig = 0; ig < sd.groupsPerChain[s.chain]; ig++, s.group++)
+        s.atom += sd.groupList[sd.groupTypeList[s.group]].atomNameList.size();
+  }
+  starts.push_back(s);
+  return starts;
+}
 
-  assert(sd.secStructList.empty() || (int)sd.secStructList.size() == sd.numGroups);
+static bool haveBondInfo(const mmtf::StructureData &sd) {
+  if (!sd.bondAtomList.empty())
+    return true;
+  for (auto &group : sd.groupList)
+    if (!group.bondAtomList.empty())
+      return true;
+  return false;
+}
 
+static Molecule* readModel(const mmtf::StructureData &sd, const ModelStart &start, const ModelStart &end,
+                           bool withBonds, bool bondsFromFile, const std::vector<std::array<int,2>> &interGroupBonds)
+{
   auto &ptd = PeriodicTableData::get();
 
+  std::unique_ptr<Molecule> m(new Molecule("")); // molecule per model
+  m->reserve(end.atom - start.atom);
+
+  int groupIndex = start.group; // through index
+  int atomIndex = start.atom;   // through index
+  // traverse chains
+  for (int chainIndex = start.chain; chainIndex < end.chain; chainIndex++) {
+    // increase chain count in the molecule
+    m->nChains++;
+    // traverse groups
+    for (int ig = 0; ig < sd.groupsPerChain[chainIndex]; ig++, groupIndex++) {
+      // increase group count in the molecule
+      m->nGroups++;
+      //
+      const mmtf::GroupType& group = sd.groupList[sd.groupTypeList[groupIndex]];
+      int groupAtomCount = group.atomNameList.size();
+      auto groupFirstAtom = m->getNumAtoms();
+      // traverse ATOMs or HETATMs
+      for (int ia = 0; ia < groupAtomCount; ia++, atomIndex++) {
+        // serial is atomIndex+1
+        // otherwise, it is sd.atomIdList[atomIndex], XXX how should we use it?
+        // Group name
+        // TODO save group name: group.groupName has VAL/LEU/etc - AA names
+
+        // Chain
+        // TODO save chain info: sd.chainIdList[chainIndex] has "A"/"B"/... or other names
+
+        // Occupancy
+        // TODO use occupancy: assert(mmtf::isDefaultValue(sd.occupancyList)); // use sd.occupancyList[atomIndex] if this fails, see PDB conversion example in the MMTF project how
+
+        // create the atom in the molecule's storage
+        Atom a(Element(ptd.elementFromSymbol(group.elementList[ia])), Vec3(sd.xCoordList[atomIndex], sd.yCoordList[atomIndex], sd.zCoordList[atomIndex]));
+        a.name = group.atomNameList[ia]; // meaningful name as related to the structure it is involved in
+        if (mmtf::is_hetatm(group.chemCompType.c_str()))
+          a.isHetAtm = true;
+
+        // set chain/group/secStructKind
+        a.chain = m->nChains;
+        a.group = m->nGroups;
+        if (!sd.secStructList.empty())
+          a.secStructKind = (SecondaryStructureKind)sd.secStructList[groupIndex];
+
+        // add atom to molecule
+        m->add(a);
+      } // atom
+      // bonds within the group: indexes are relative to the group
+      if (withBonds && bondsFromFile)
+        for (unsigned ib = 0, ibe = group.bondAtomList.size()/2; ib < ibe; ib++)
+          m->getAtom(groupFirstAtom + group.bondAtomList[2*ib])->link(m->getAtom(groupFirstAtom + group.bondAtomList[2*ib + 1]));
+    } // groups
+  } // chains
+  assert(atomIndex == end.atom);
+
+  // bonds between groups, or geometric bonds when the file doesn't have any
+  if (withBonds) {
+    if (bondsFromFile) {
+      for (auto &b : interGroupBonds)
+        m->getAtom(b[0] - start.atom)->link(m->getAtom(b[1] - start.atom));
+    } else {
+      m->detectBonds();
+    }
+  }
+
+  return m.release();
+}
+
+static std::vector<Molecule*> readMolecule(const mmtf::StructureData &sd, unsigned nthreads, bool withBonds) {
+  assert(sd.secStructList.empty() || (int)sd.secStructList.size() == sd.numGroups);
+
   if (!sd.hasConsistentData(true))
     ERROR("MMTF doesn't have consisent data")
 
-  int modelIndex = 0;
-  int chainIndex = 0; // through index
-  int groupIndex = 0; // through index
-
-  // traverse models
-  for (int im = 0; im < sd.numModels; im++, modelIndex++) {
-    std::unique_ptr<Molecule> m(new Molecule("")); // molecule per model
-    // traverse chains
-    for (int ic = 0; ic < sd.chainsPerModel[modelIndex]; ic++, chainIndex++) {
-      // increase chain count in the molecule
-      m->nChains++;
-      // traverse groups
-      for (int ig = 0; ig < sd.groupsPerChain[chainIndex]; ig++, groupIndex++) {
-        // increase group count in the molecule
-        m->nGroups++;
-        //
-        const mmtf::GroupType& group = sd.groupList[sd.groupTypeList[groupIndex]];
-        int groupAtomCount = group.atomNameList.size();
-        // traverse ATOMs or HETATMs
-        for (int ia = 0; ia < groupAtomCount; ia++) {
-          int atomId = sd.atomIdList[ia]; // through index
-
-            // serial is atomIndex+1
-            // otherwise, it is sd.atomIdList[atomIndex], XXX how should we use it?
-          // Group name
-          // TODO save group name: group.groupName has VAL/LEU/etc - AA names
-
-          // Chain
-          // TODO save chain info: sd.chainIdList[chainIndex] has "A"/"B"/... or other names
-
-          // Group serial: they are numbered per chain
-          // TODO std::cout << "... GRP: @groupIndex=" << groupIndex << " sd.groupIdList[groupIndex]=" << sd.groupIdList[groupIndex] << std::endl;
-          // TODO assert(sd.groupIdList[groupIndex] == groupIndex+1); // how to handle weird (non-sequential) GroupIds?
-          // x, y, z: use later
-
-          // Occupancy
-          // TODO use occupancy: assert(mmtf::isDefaultValue(sd.occupancyList)); // use sd.occupancyList[atomIndex] if this fails, see PDB conversion example in the MMTF project how
-
-          // create the atom object
-          std::unique_ptr<Atom> a(new Atom(Element(ptd.elementFromSymbol(group.elementList[ia])), Vec3(sd.xCoordList[atomId-1], sd.yCoordList[atomId-1], sd.zCoordList[atomId-1])));
-          a->name = group.atomNameList[ia]; // meaningful name as related to the structure it is involved in
-          if (mmtf::is_hetatm(group.chemCompType.c_str()))
-            a->isHetAtm = true;
-
-          // set chain/group/secStructKind
-          a->chain = m->nChains;
-          a->group = m->nGroups;
-          if (!sd.secStructList.empty())
-            a->secStructKind = (SecondaryStructureKind)sd.secStructList[a->group - 1];
-
-          // add atom to molecule
-          m->add(a.release());
-        } // atom
-      } // groups
-    } // chains
-    res.push_back(m.release());
-  } // models
+  auto starts = computeModelStarts(sd);
+  if (starts.back().atom != sd.numAtoms)
+    ERROR("MMTF: groups have " << starts.back().atom << " atoms, but numAtoms=" << sd.numAtoms)
+
+  // distribute inter-group bonds among models, bonds between models are ignored
+  bool bondsFromFile = withBonds && haveBondInfo(sd);
+  std::vector<std::vector<std::array<int,2>>> interGroupBonds(sd.numModels);
+  if (bondsFromFile)
+    for (unsigned ib = 0, ibe = sd.bondAtomList.size()/2; ib < ibe; ib++) {
+      int a1 = sd.bondAtomList[2*ib], a2 = sd.bondAtomList[2*ib + 1];
+      auto modelOf = [&starts](int a) {
+        return std::upper_bound(starts.begin(), starts.end(), a, [](int a, const ModelStart &s) {return a < s.atom;}) - starts.begin() - 1;
+      };
+      auto im = modelOf(a1);
+      if (im == modelOf(a2))
+        interGroupBonds[im].push_back({{a1, a2}});
+    }
+
+  // build models: models are independent, workers take them one by one
+  std::vector<Molecule*> res(sd.numModels);
+  ThreadPool::get().parallelFor(sd.numModels, nthreads, [&](unsigned im) {
+    res[im] = readModel(sd, starts[im], starts[im + 1], withBonds, bondsFromFile, interGroupBonds[im]);
+  });
 
   return res;
 }
 
 /// iface
 
-std::vector<Molecule*> Molecule::readMmtfFile(const std::string &fname) {
+std::vector<Molecule*> Molecule::readMmtfFile(const std::string &fname, unsigned nthreads, bool withBonds) {
   mmtf::StructureData sd;
   mmtf::decodeFromFile(sd, fname);
 
-  return readMolecule(sd);
+  return readMolecule(sd, nthreads, withBonds);
 }
 
-std::vector<Molecule*> Molecule::readMmtfBuffer(const std::vector<uint8_t> *buffer) {
+std::vector<Molecule*> Molecule::readMmtfBuffer(const std::vector<uint8_t> *buffer, unsigned nthreads, bool withBonds) {
   mmtf::StructureData sd;
   mmtf::decodeFromBuffer(sd, (const char*)&(*buffer)[0], buffer->size());
 
-  return readMolecule(sd);
+  return readMolecule(sd, nthreads, withBonds);
 }
-
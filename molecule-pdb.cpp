@@ -1,15 +1,186 @@
-
 #include "molecule.h"
 #include "xerror.h"
+#include "util.h"
+#include "periodic-table-data.h"
 
 #include <iostream>
 #include <string>
+#include <cstring>
+#include <cctype>
+#include <memory>
+#include <map>
+
+// fixed-column PDB parser: only the ATOM/HETATM/TER/MODEL/ENDMDL/END records are interpreted, everything else is skipped
+
+/// local helpers
+
+namespace {
+
+class PdbLine { // one line with the 1-based inclusive column ranges as in the PDB format description
+  const char *b;
+  const char *e;
+public:
+  PdbLine(const char *newB, const char *newE) : b(newB), e(newE) {
+    if (e > b && e[-1] == '\r')
+      e--;
+  }
+  unsigned length() const {return e - b;}
+  bool isRecord(const char *name) const { // record names occupy columns 1-6 and are padded with spaces
+    auto len = std::strlen(name);
+    if (length() < len || std::memcmp(b, name, len) != 0)
+      return false;
+    for (auto p = b + len, pe = b + std::min<unsigned>(6, length()); p < pe; p++)
+      if (*p != ' ')
+        return false;
+    return true;
+  }
+  char col(unsigned c) const {return c <= length() ? b[c - 1] : ' ';}
+  void field(unsigned c1, unsigned c2, const char *&fb, const char *&fe) const { // trimmed, possibly empty
+    fb = b + std::min(c1 - 1, length());
+    fe = b + std::min(c2, length());
+    while (fb < fe && *fb == ' ')
+      fb++;
+    while (fe > fb && fe[-1] == ' ')
+      fe--;
+  }
+  bool fieldEquals(unsigned c1, unsigned c2, const PdbLine &other) const { // raw comparison with the same columns of another line
+    for (auto c = c1; c <= c2; c++)
+      if (col(c) != other.col(c))
+        return false;
+    return true;
+  }
+  std::string atomKey() const { // name, resName, chain, resSeq, iCode: the altLoc column 17 is left out
+    std::string key;
+    for (unsigned c = 13; c <= 27; c++)
+      if (c != 17)
+        key += col(c);
+    return key;
+  }
+}; // PdbLine
+
+}
+
+static Float parseCoord(const PdbLine &line, unsigned c1, unsigned c2, unsigned lineNo) {
+  const char *fb, *fe;
+  line.field(c1, c2, fb, fe);
+  double res;
+  if (fb == fe || !Util::parseDouble(fb, fe, res) || fb != fe)
+    ERROR("PDB: bad coordinate in columns " << c1 << "-" << c2 << " on line " << lineNo)
+  return res;
+}
+
+static Element parseElement(const PdbLine &line, bool isHetAtm, unsigned lineNo) {
+  auto &ptd = PeriodicTableData::get();
+  char sym[3] = {0, 0, 0};
+  const char *fb, *fe;
+  line.field(77, 78, fb, fe); // element symbol, right-justified
+  if (fb < fe && std::isalpha((unsigned char)*fb)) {
+    sym[0] = *fb;
+    if (fe - fb == 2 && std::isalpha((unsigned char)fb[1]))
+      sym[1] = fb[1];
+  } else { // old files: derive from the atom name, the 1st column of the name is only used by the two-letter elements
+    auto c13 = line.col(13), c14 = line.col(14);
+    if (std::isalpha((unsigned char)c13) && std::isalpha((unsigned char)c14) && isHetAtm) {
+      sym[0] = c13;
+      sym[1] = c14;
+    } else if (std::isalpha((unsigned char)c13) && !std::isalpha((unsigned char)c14)) {
+      sym[0] = c13;
+    } else if (std::isalpha((unsigned char)c14)) {
+      sym[0] = std::isalpha((unsigned char)c13) ? c13 : c14;
+    } else {
+      ERROR("PDB: can't determine the element on line " << lineNo)
+    }
+  }
+  sym[0] = std::toupper(sym[0]);
+  sym[1] = std::tolower(sym[1]);
+  if (sym[0] == 'D' && sym[1] == 0) // deuterium
+    sym[0] = 'H';
+  return Element(ptd.elementFromSymbol(sym));
+}
+
+static std::vector<Molecule*> readPdb(const char *buf, size_t size) {
+  std::vector<std::unique_ptr<Molecule>> res;
+  std::unique_ptr<Molecule> m;
+
+  // chains and groups are numbered in the order of appearance, like in the MMTF reader
+  bool chainEnded = true;
+  PdbLine prevAtomLine(nullptr, nullptr);
+  std::map<std::string, char> firstAltLocs; // per model, the first alternate location seen for each atom
+
+  auto finishModel = [&]() {
+    if (m) {
+      m->detectBonds();
+      res.push_back(std::move(m));
+    }
+  };
+
+  unsigned lineNo = 0;
+  for (const char *p = buf, *e = buf + size; p < e;) {
+    auto le = (const char*)std::memchr(p, '\n', e - p);
+    if (!le)
+      le = e;
+    PdbLine line(p, le);
+    p = le < e ? le + 1 : e;
+    lineNo++;
+
+    bool isAtom = line.isRecord("ATOM"), isHetAtm = !isAtom && line.isRecord("HETATM");
+    if (isAtom || isHetAtm) {
+      if (line.length() < 54)
+        ERROR("PDB: the ATOM/HETATM record is too short on line " << lineNo)
+      // alternate locations: only the first one is used, whatever its label is
+      auto altLoc = line.col(17);
+      if (altLoc != ' ' && firstAltLocs.emplace(line.atomKey(), altLoc).first->second != altLoc)
+        continue;
+      if (!m) {
+        m.reset(new Molecule(""));
+        chainEnded = true;
+      }
+      // chain: column 22, group: columns 23-27 (resSeq+iCode)
+      bool newChain = chainEnded || m->numAtoms() == 0 || !line.fieldEquals(22, 22, prevAtomLine);
+      if (newChain) {
+        m->nChains++;
+        chainEnded = false;
+      }
+      if (newChain || !line.fieldEquals(18, 27, prevAtomLine))
+        m->nGroups++;
+      prevAtomLine = line;
+      // the atom
+      Atom a(parseElement(line, isHetAtm, lineNo), Vec3(parseCoord(line, 31, 38, lineNo), parseCoord(line, 39, 46, lineNo), parseCoord(line, 47, 54, lineNo)));
+      const char *fb, *fe;
+      line.field(13, 16, fb, fe);
+      a.name.assign(fb, fe);
+      a.isHetAtm = isHetAtm;
+      a.chain = m->nChains;
+      a.group = m->nGroups;
+      m->add(a);
+    } else if (line.isRecord("TER")) {
+      chainEnded = true;
+    } else if (line.isRecord("MODEL")) {
+      finishModel();
+      m.reset(new Molecule(""));
+      chainEnded = true;
+      firstAltLocs.clear();
+    } else if (line.isRecord("ENDMDL")) {
+      finishModel();
+    } else if (line.isRecord("END")) {
+      break;
+    }
+  }
+  finishModel();
+
+  // return as a plain vector
+  std::vector<Molecule*> mols;
+  for (auto &m : res)
+    mols.push_back(m.release());
+  return mols;
+}
 
 /// Molecule
 
 std::vector<Molecule*> Molecule::readPdbBuffer(const std::string &pdbBuffer) {
-  std::vector<Molecule*> res;
-  ERROR("TODO This is a stub and it doesn't yet do anything")
-  return res;
+  return readPdb(pdbBuffer.data(), pdbBuffer.size());
 }
 
+std::vector<Molecule*> Molecule::readPdbBuffer(const std::vector<uint8_t> *buffer) {
+  return readPdb((const char*)buffer->data(), buffer->size());
+}
@@ -1,7 +1,12 @@
 #include "molecule.h"
+#include "xerror.h"
 
 #include <vector>
+#include <array>
 #include <limits>
+#include <algorithm>
+#include <numeric>
+#include <set>
 
 extern "C" {
 #include <libqhull_r/libqhull_r.h>
@@ -10,55 +15,199 @@ extern "C" {
 
 #include <stdio.h>
 
-std::vector<Vec3> Molecule::computeConvexHullFacets(std::vector<double> *withFurthestdist) const {
-  std::vector<Vec3> facetNormals;
+/// internals
+
+namespace {
+
+struct Hull { // convex hull in terms of atom indexes
+  std::vector<unsigned>              vertices;      // sorted
+  std::vector<Vec3>                  normals;       // outward facet normals
+  std::vector<std::vector<unsigned>> facetVertices;
+}; // Hull
+
+bool computeHull(const Molecule &m, const char *qhullFlags, Hull &hull) { // fails for less than 4 atoms or when qhull fails
+  if (m.numAtoms() < 4)
+    return false;
 
   int dim = 3;
   char flags[25];
-  sprintf(flags, "qhull s FA Pp"); // Pp removes the warnings about narrow hulls (we will get narrow hulls for flat molecules)
-
-  // fill the 'points' array
-  std::vector<coordT> points;
-  for (auto a : atoms) {
-    points.push_back(a->pos(X));
-    points.push_back(a->pos(Y));
-    points.push_back(a->pos(Z));
-  }
+  snprintf(flags, sizeof(flags), "%s", qhullFlags);
 
   // create the qhT object
   qhT qhVal;
   qhT *qh = &qhVal;
   qh_zero(qh, stderr);
-  qh_new_qhull(qh, dim, numAtoms(), &points[0], 0, flags, NULL, NULL);
+  auto exitcode = qh_new_qhull(qh, dim, m.numAtoms(), const_cast<coordT*>(m.coords.data()), 0/*ismalloc*/, flags, NULL, NULL); // coords are x,y,z triplets, as qhull expects
 
-  { // enumerate and output facets
+  if (exitcode == 0) { // enumerate vertices and facets
+    vertexT *vertex, **vertexp;
+    FORALLvertices
+      hull.vertices.push_back(qh_pointid(qh, vertex->point));
+    std::sort(hull.vertices.begin(), hull.vertices.end());
     facetT *facet;
     FORALLfacets {
-      if (withFurthestdist) {
-#if 0 // QHull-based computation: always returns zero, it's unclear why, see https://github.com/qhull/qhull/issues/39
-#  if qh_COMPUTEfurthest
-#    error "qh_COMPUTEfurthest=1: need to compute furthestdist ourselves!"
-#  endif
-        withFurthestdist->push_back(facet->furthestdist);
-#else // workaround for the above
-        Float pmin = std::numeric_limits<Float>::max();
-        Float pmax = std::numeric_limits<Float>::min();
-        for (auto a : atoms) {
-          auto p = a->pos*Vec3(facet->normal[0], facet->normal[1], facet->normal[2]);
-          if (p < pmin)
-            pmin = p;
-          if (p > pmax)
-            pmax = p;
-        }
-        withFurthestdist->push_back(pmax - pmin);
-#endif
-      }
-      facetNormals.push_back(Vec3(facet->normal[0], facet->normal[1], facet->normal[2]));
+      hull.normals.push_back(Vec3(facet->normal[0], facet->normal[1], facet->normal[2]));
+      hull.facetVertices.emplace_back();
+      FOREACHvertex_(facet->vertices)
+        hull.facetVertices.back().push_back(qh_pointid(qh, vertex->point));
     }
   }
 
   // free
   qh_freeqhull(qh, !qh_ALL);
+  int curlong, totlong;
+  qh_memfreeshort(qh, &curlong, &totlong); // the short memory pool of this qhT, otherwise it leaks on every call
+
+  return exitcode == 0;
+}
+
+Hull computeHullOrAllAtoms(const Molecule &m) { // QJ: joggled input never fails on flat or collinear molecules, point ids still refer to the original atoms
+  Hull hull;
+  if (!computeHull(m, "qhull QJ Pp", hull)) {
+    hull.vertices.resize(m.numAtoms());
+    std::iota(hull.vertices.begin(), hull.vertices.end(), 0);
+  }
+  return hull;
+}
 
-  return facetNormals;
+std::array<Float,2> projectionRange(const Molecule &m, const std::vector<unsigned> &idxs, const Vec3 &dir) {
+  std::array<Float,2> range = {{std::numeric_limits<Float>::max(), std::numeric_limits<Float>::lowest()}};
+  auto pos = m.positions();
+  for (auto i : idxs) {
+    auto p = pos[i]*dir;
+    range[0] = std::min(range[0], p);
+    range[1] = std::max(range[1], p);
+  }
+  return range;
+}
+
+Molecule::OrientedBox boxAlongAxes(const Molecule &m, const std::vector<unsigned> &idxs, const std::array<Vec3,3> &axes) {
+  Molecule::OrientedBox box{Vec3(0,0,0), axes, Vec3(0,0,0)};
+  for (unsigned d = 0; d < 3; d++) {
+    auto range = projectionRange(m, idxs, axes[d]);
+    box.center += axes[d]*((range[0] + range[1])/2);
+    box.extents[d] = range[1] - range[0];
+  }
+  return box;
+}
+
+Vec3 anyOrthogonal(const Vec3 &dir) { // dir is normalized
+  return (std::abs(dir[0]) < 0.9 ? Vec3(1,0,0) : Vec3(0,1,0)).orthogonal(dir).normalize();
+}
+
+}
+
+/// Molecule
+
+std::vector<Vec3> Molecule::computeConvexHullFacets(std::vector<double> *withFurthestdist) const {
+  Hull hull;
+  computeHull(*this, "qhull s FA Pp", hull); // Pp removes the warnings about narrow hulls (we will get narrow hulls for flat molecules)
+
+  // QHull-based computation of furthestdist always returns zero, it's unclear why, see https://github.com/qhull/qhull/issues/39
+  // so it is computed as the width across the facet, the extremes are always among the hull vertices
+  if (withFurthestdist)
+    for (auto &normal : hull.normals) {
+      auto range = projectionRange(*this, hull.vertices, normal);
+      withFurthestdist->push_back(range[1] - range[0]);
+    }
+
+  return hull.normals;
+}
+
+std::vector<unsigned> Molecule::findConvexHullVertices() const {
+  return computeHullOrAllAtoms(*this).vertices;
+}
+
+std::array<unsigned,2> Molecule::findFurthestAtoms() const {
+  if (numAtoms() < 2)
+    ERROR("Molecule::findFurthestAtoms: the molecule needs at least 2 atoms, it has " << numAtoms())
+  // the furthest pair is always a pair of the hull vertices, there are few of them
+  auto vertices = findConvexHullVertices();
+  auto pos = positions();
+  std::array<unsigned,2> res = {{0, 1}};
+  Float maxDist2 = -1;
+  for (unsigned i1 = 0, ie = vertices.size(); i1 < ie; i1++)
+    for (unsigned i2 = i1+1; i2 < ie; i2++) {
+      auto dist2 = (pos[vertices[i1]] - pos[vertices[i2]]).len2();
+      if (dist2 > maxDist2) {
+        maxDist2 = dist2;
+        res = {{vertices[i1], vertices[i2]}};
+      }
+    }
+  return res;
+}
+
+Float Molecule::diameter() const {
+  if (numAtoms() < 2)
+    return 0;
+  auto pair = findFurthestAtoms();
+  return (positions()[pair[0]] - positions()[pair[1]]).len();
+}
+
+Float Molecule::minWidth() const {
+  auto hull = computeHullOrAllAtoms(*this);
+  if (hull.normals.empty()) // less than 4 atoms are always in a plane
+    return 0;
+  auto width = std::numeric_limits<Float>::max();
+  auto tryDirection = [this,&hull,&width](const Vec3 &dir) {
+    auto range = projectionRange(*this, hull.vertices, dir);
+    width = std::min(width, range[1] - range[0]);
+  };
+
+  // the minimum is either across a facet or between the planes through two skew edges, along the cross product of the edges
+  for (auto &normal : hull.normals)
+    tryDirection(normal);
+  std::set<std::array<unsigned,2>> edgeSet;
+  for (auto &fv : hull.facetVertices)
+    for (unsigned i1 = 0, ie = fv.size(); i1 < ie; i1++)
+      for (unsigned i2 = i1+1; i2 < ie; i2++)
+        edgeSet.insert({{std::min(fv[i1], fv[i2]), std::max(fv[i1], fv[i2])}});
+  std::vector<std::array<unsigned,2>> edges(edgeSet.begin(), edgeSet.end());
+  auto pos = positions();
+  for (unsigned e1 = 0, ee = edges.size(); e1 < ee; e1++)
+    for (unsigned e2 = e1+1; e2 < ee; e2++) {
+      auto dir = (pos[edges[e1][1]] - pos[edges[e1][0]]).cross(pos[edges[e2][1]] - pos[edges[e2][0]]);
+      auto len = dir.len();
+      if (len > 1e-9)
+        tryDirection(dir/len);
+    }
+  return width;
+}
+
+Molecule::OrientedBox Molecule::orientedBoundingBox() const {
+  if (atoms.empty())
+    ERROR("Molecule::orientedBoundingBox: the molecule has no atoms")
+  auto hull = computeHullOrAllAtoms(*this);
+  auto pos = positions();
+
+  if (hull.normals.empty()) { // less than 4 atoms: the axes are along the first edge and in the plane of the atoms
+    auto e0 = numAtoms() > 1 && (pos[1] - pos[0]).len2() > 0 ? (pos[1] - pos[0]).normalize() : Vec3(1,0,0);
+    auto e1 = numAtoms() > 2 && (pos[2] - pos[0]).orthogonal(e0).len2() > 0 ? (pos[2] - pos[0]).orthogonal(e0).normalize() : anyOrthogonal(e0);
+    return boxAlongAxes(*this, hull.vertices, {{e0, e1, e0.cross(e1)}});
+  }
+
+  // candidate boxes: a face on the facet and an edge along a pair of the facet's vertices
+  // volumes are compared with the extents padded, so that the flat molecules are compared by their area
+  const Float pad = 0.001;
+  OrientedBox best;
+  auto bestVolume = std::numeric_limits<Float>::max();
+  for (unsigned f = 0, fe = hull.normals.size(); f < fe; f++) {
+    auto &n = hull.normals[f];
+    auto &fv = hull.facetVertices[f];
+    for (unsigned i1 = 0, ie = fv.size(); i1 < ie; i1++)
+      for (unsigned i2 = i1+1; i2 < ie; i2++) {
+        auto e = (pos[fv[i2]] - pos[fv[i1]]).orthogonal(n);
+        auto len = e.len();
+        if (len == 0)
+          continue;
+        e = e/len;
+        auto box = boxAlongAxes(*this, hull.vertices, {{n, e, n.cross(e)}});
+        auto volume = (box.extents[0] + pad)*(box.extents[1] + pad)*(box.extents[2] + pad);
+        if (volume < bestVolume) {
+          bestVolume = volume;
+          best = box;
+        }
+      }
+  }
+  return best;
 }
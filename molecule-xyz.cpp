@@ -2,6 +2,7 @@
 #include "molecule.h"
 #include "xerror.h"
 #include "util.h"
+#include "xyz-reader.h"
 
 #include <boost/format.hpp>
 
@@ -80,20 +81,13 @@ Molecule* Molecule::readXyzFileOne(const std::string &fname) { // reads a file w
   return output.release();
 }
 
-std::vector<Molecule*> Molecule::readXyzFileMany(const std::string &fname) { // reads a file with a single xyz section
-  // open file
-  std::ifstream file(fname, std::ios::in);
-  if (!file.is_open())
-    ERROR(str(boost::format("can't open the xyz file for reading: %1%") % fname));
+std::vector<Molecule*> Molecule::readXyzFileMany(const std::string &fname) { // reads a file with 1+ xyz sections
+  XyzFrameReader reader(fname);
+  XyzFrame frame;
   // create
   std::vector<std::unique_ptr<Molecule>> output;
-  while (!Util::realEof(file)) {
-    Molecule *m;
-    // create a molecule
-    output.push_back(std::unique_ptr<Molecule>(m = new Molecule("")));
-    // read
-    file >> *m;
-  }
+  while (reader.next(frame))
+    output.push_back(std::unique_ptr<Molecule>(createFromXyzFrame(frame)));
   // return as a plain vector
   std::vector<Molecule*> res;
   for (auto &m : output)
@@ -101,6 +95,16 @@ std::vector<Molecule*> Molecule::readXyzFileMany(const std::string &fname) { //
   return res;
 }
 
+Molecule* Molecule::createFromXyzFrame(const XyzFrame &frame, bool doDetectBonds) {
+  std::unique_ptr<Molecule> m(new Molecule(frame.descr));
+  m->reserve(frame.numAtoms());
+  for (unsigned a = 0, ae = frame.numAtoms(); a < ae; a++)
+    m->add(Atom(frame.elements[a], Vec3(frame.coords[3*a], frame.coords[3*a + 1], frame.coords[3*a + 2])));
+  if (doDetectBonds)
+    m->detectBonds();
+  return m.release();
+}
+
 void Molecule::writeXyzFile(const std::string &fname) const {
   // open file
   std::ofstream file(fname, std::ios::out);
@@ -1,5 +1,8 @@
 #include "common.h"
 #include "molecule.h"
+#include "torsion-tree.h"
+#include "neighbor-grid.h"
+#include "lattice.h"
 #include "xerror.h"
 #include "Vec3.h"
 #include "Vec3-ext.h"
@@ -13,7 +16,6 @@
 
 #include <map>
 #include <set>
-#include <list>
 #include <array>
 #include <ostream>
 #include <cmath>
@@ -22,6 +24,7 @@
 /// (DBG) logging: uncomment to enable
 
 #define LOG_ROTATE_FUNCTIONS(msg...) // std::cout << rang::fg::cyan << "{rotate}: " << msg << rang::style::reset << std::endl;
+#define LOG_DETECT_BONDS(msg...) // std::cout << rang::fg::cyan << "{bonds}: " << msg << rang::style::reset << std::endl;
 
 /// references
 
@@ -62,7 +65,7 @@ std::ostream& operator<<(std::ostream &os, const SecondaryStructureKind &secStr)
 
 bool Atom::isEqual(const Atom &other) const {
   return elt == other.elt &&
-         pos == other.pos;
+         pos() == other.pos();
 }
 
 std::string Atom::bondsAsString() const {
@@ -132,7 +135,7 @@ Atom* Atom::findSingleNeighbor2(Element elt1, Element elt2) const {
 }
 
 void Atom::snapToGrid(const Vec3 &grid) {
-  pos.snapToGrid(grid);
+  pos().snapToGrid(grid);
 }
 
 std::ostream& operator<<(std::ostream &os, const Atom &a) {
@@ -141,7 +144,7 @@ std::ostream& operator<<(std::ostream &os, const Atom &a) {
     sprintf(buf, "%.05lf", c);
     return std::string(buf);
   };
-  os << a.elt << ' ' << prnCoord(a.pos(X)) << ' ' << prnCoord(a.pos(Y)) << ' ' << prnCoord(a.pos(Z));
+  os << a.elt << ' ' << prnCoord(a.pos()(X)) << ' ' << prnCoord(a.pos()(Y)) << ' ' << prnCoord(a.pos()(Z));
   return os;
 }
 
@@ -150,7 +153,8 @@ std::ostream& operator<<(std::ostream &os, const Atom &a) {
 Molecule::Molecule(const std::string &newDescr)
 : descr(newDescr),
   nChains(0),
-  nGroups(0)
+  nGroups(0),
+  bondGraphValid(false)
 {
   //std::cout << "Molecule::Molecule(copy) " << this << std::endl;
 }
@@ -158,64 +162,98 @@ Molecule::Molecule(const std::string &newDescr)
 Molecule::Molecule(const Molecule &other)
 : descr(other.descr),
   nChains(other.nChains),
-  nGroups(other.nGroups)
+  nGroups(other.nGroups),
+  bondGraphValid(false),
+  lattice(other.lattice ? new Lattice(*other.lattice) : nullptr)
 {
   //std::cout << "Molecule::Molecule() " << this << std::endl;
-  for (auto a : other.atoms)
-    atoms.push_back((new Atom(*a))->setMolecule(this));
-  detectBonds();
+  add(other, false/*doDetectBonds*/); // bonds are copied
+  if (other.bondGraphValid) {
+    bondGraph = other.bondGraph;
+    bondGraphValid = true;
+  }
 }
 
 Molecule::~Molecule() {
   //std::cout << "Molecule::~Molecule " << this << std::endl;
   for (auto a : atoms)
-    delete a;
+    AtomArena::destroy(a);
 }
 
 void Molecule::add(const Atom &a) { // doesn't detect bonds when one atom is added
-  atoms.push_back((new Atom(a))->setMolecule(this));
+  attach(arena.create(a));
 }
 
 void Molecule::add(Atom *a) { // doesn't detect bonds when one atom is added // pass ownership of the object
-  atoms.push_back(a->setMolecule(this));
+  if (a->molecule)
+    ERROR("Molecule::add: atom " << *a << " already belongs to a molecule")
+  attach(a);
 }
 
 void Molecule::add(const Molecule &m, bool doDetectBonds) {
+  auto offset = atoms.size();
+  reserve(offset + m.atoms.size());
   for (auto a : m.atoms)
-    atoms.push_back((new Atom(*a))->setMolecule(this));
+    attach(arena.create(*a));
   if (doDetectBonds)
-    detectBonds();
+    updateBonds(std::vector<Atom*>(atoms.begin() + offset, atoms.end()));
+  else
+    copyBonds(m, offset);
 }
 
 void Molecule::add(const Molecule &m, const Vec3 &shft, const Vec3 &rot, bool doDetectBonds) { // shift and rotation (normalized)
+  auto offset = atoms.size();
+  reserve(offset + m.atoms.size());
   for (auto a : m.atoms)
-    atoms.push_back((new Atom(a->transform(shft, rot)))->setMolecule(this));
+    attach(arena.create(a->transform(shft, rot)));
   if (doDetectBonds)
-    detectBonds();
+    updateBonds(std::vector<Atom*>(atoms.begin() + offset, atoms.end()));
+  else
+    copyBonds(m, offset); // rigid transformation keeps the bonds
+}
+
+void Molecule::remove(Atom *a) {
+  while (!a->bonds.empty())
+    a->unlink(a->bonds[0]);
+  auto idx = a->index;
+  atoms.erase(atoms.begin() + idx);
+  coords.erase(coords.begin() + 3*idx, coords.begin() + 3*(idx+1));
+  elements.erase(elements.begin() + idx);
+  for (auto ie = atoms.size(); idx < ie; idx++)
+    atoms[idx]->index = idx;
+  AtomArena::destroy(a);
+  invalidateBondGraph();
+}
+
+void Molecule::reserve(unsigned n) {
+  atoms.reserve(n);
+  coords.reserve(3*n);
+  elements.reserve(n);
+  if (n > atoms.size())
+    arena.reserve(n - atoms.size());
 }
 
 std::vector<std::vector<Atom*>> Molecule::findComponents() const {
+  auto &graph = getBondGraph();
   std::vector<std::vector<Atom*>> res;
-  std::set<const Atom*> seen;
-  auto already = [&seen](const Atom *atom) {return seen.find(atom) != seen.end();};
-  for (auto a : atoms)
-    if (!already(a)) {
+  std::vector<bool> seen(atoms.size(), false);
+  std::vector<unsigned> todo; // BFS queue: atoms are appended to the component in the order they are discovered
+  todo.reserve(atoms.size());
+  for (unsigned a = 0, ae = atoms.size(); a < ae; a++)
+    if (!seen[a]) {
       // new component
       res.resize(res.size()+1);
       auto &curr = *res.rbegin();
-      std::list<const Atom*> todo;
+      todo.clear();
       todo.push_back(a);
-      seen.insert(a);
-      curr.push_back(a);
-      while (!todo.empty()) {
-        auto at = *todo.begin();
-        todo.pop_front();
+      seen[a] = true;
+      for (unsigned t = 0; t < todo.size(); t++) {
+        curr.push_back(atoms[todo[t]]);
         // iterate through the bonds
-        for (auto ab : at->bonds)
-          if (!already(ab)) {
-            todo.push_back(ab);
-            seen.insert(ab);
-            curr.push_back(ab);
+        for (auto n : graph.neighbors(todo[t]))
+          if (!seen[n]) {
+            todo.push_back(n);
+            seen[n] = true;
           }
       }
     }
@@ -301,7 +339,7 @@ std::vector<Molecule::AaBackbone> Molecule::findAaBackbonesSorted() {  // finds
       //std::cout << "Molecule::findAaBackbones: bb #" << (idx+1) << " of " << aaBackbones.size() << ": isNterm=" << b.isNterm() << " isCterm=" << b.isCterm()  << std::endl;
       if (b.isNterm()) {
         assert(idxNterm == -1);
-        idxNterm = aaBackbones.size();
+        idxNterm = idx;
       }
       n2idx[b.N] = idx++;
     }
@@ -310,11 +348,11 @@ std::vector<Molecule::AaBackbone> Molecule::findAaBackbonesSorted() {  // finds
     aaBackbonesSorted.reserve(aaBackbones.size());
     aaBackbonesSorted.push_back(aaBackbones[idxNterm]); // seed
     while (aaBackbonesSorted.size() < aaBackbones.size()) {
-      auto &lst = *aaBackbones.rbegin();
+      auto &lst = *aaBackbonesSorted.rbegin();
       if (lst.isCterm())
         break;
-      assert(n2idx.find(lst.N) != n2idx.end());
-      aaBackbonesSorted.push_back(aaBackbones[n2idx[lst.N]]);
+      assert(n2idx.find(lst.nextN()) != n2idx.end());
+      aaBackbonesSorted.push_back(aaBackbones[n2idx[lst.nextN()]]);
     }
     assert(aaBackbonesSorted.size() == aaBackbones.size());
   }
@@ -425,51 +463,367 @@ Molecule::Angle Molecule::setAminoAcidSingleAngle(const std::vector<AaBackbone>
 
   typedef AaAngles A;
 
-  const AaBackbone &cterm = aaBackbones[idx];
-  const AaBackbone &nterm = aaBackbones[idx+1];
-
-  AaAngles::AngleAndAxis priorAngle;
   switch (angleId) {
-  case A::OMEGA: {
-    priorAngle = AaAngles::omega(cterm, nterm);
-    rotateAtoms(A::OMEGA, cterm.Coo->pos, priorAngle.axis, newAngle - priorAngle.angle,
-      std_ext::vector_range<AaBackbone>(&aaBackbones, aaBackbones.begin() + idx + 1, aaBackbones.end()),
-      nullptr);
-    break;
+  case A::OMEGA:
+  case A::PHI:
+  case A::PSI: {
+    TorsionTree tree(this, aaBackbones);
+    auto priorAngle = tree.setAngle(idx, angleId, newAngle);
+    tree.apply();
+    return priorAngle;
   } default: {
     ERROR("UNIMPLEMENTED Molecule::setAminoAcidSingleAngle for angleId=" << angleId)
   }}
-
-  return priorAngle.angle;
 }
 
 void Molecule::setAminoAcidSingleJunctionAngles(const std::vector<AaBackbone> &aaBackbones, unsigned idx, const std::vector<Angle> &newAngles) {
-  ERROR("UNIMPLEMENTED Molecule::setAminoAcidSingleJunctionAngles")
+  setAminoAcidSequenceAngles(aaBackbones, {idx}, {newAngles});
 }
 
 void Molecule::setAminoAcidSequenceAngles(const std::vector<AaBackbone> &aaBackbones, const std::vector<unsigned> &idxs, const std::vector<std::vector<Angle>> &newAngles) {
-  ERROR("UNIMPLEMENTED Molecule::setAminoAcidSequenceAngles")
+  // checks
+  if (aaBackbones.size() < 2)
+    ERROR("Molecule::setAminoAcidSequenceAngles: aaBackbones should have at least 2 elements, but it has " << aaBackbones.size() << " elements")
+  if (idxs.size() != newAngles.size())
+    ERROR("Molecule::setAminoAcidSequenceAngles: idxs array should have the same size as the newAngles array, but got sizes " << idxs.size() << " and " << newAngles.size())
+  for (auto idx : idxs)
+    if (idx >= aaBackbones.size()-1)
+      ERROR("Molecule::setAminoAcidSequenceAngles: bad index=" << idx << " supplied: it should not exceed the element before the last one in aaBackbones")
+  for (auto &angles : newAngles)
+    if (angles.size() > TorsionTree::NUM_TORSIONS)
+      ERROR("UNIMPLEMENTED Molecule::setAminoAcidSequenceAngles for the adjacency and secondary angles, only omega, phi and psi can be set")
+
+  // all angles are changed in the tree, and the positions are updated once
+  TorsionTree tree(this, aaBackbones);
+  for (unsigned i = 0; i < idxs.size(); i++)
+    tree.setAngles(idxs[i], newAngles[i]);
+  tree.apply();
 }
 
 void Molecule::detectBonds() {
   // clear previous bonds
   for (auto a : atoms)
     a->bonds.clear();
-  // build bonds
+  if (atoms.size() < 2) {
+    getBondGraph();
+    return;
+  }
+  auto cutoff = maxBondDistance();
+  if (lattice) { // bonds are with the periodic images, an atom is bonded once to the same partner even when several images are close
+    std::vector<std::array<unsigned,2>> pairs;
+    lattice->forEachPairWithin(getAtomPositions(), cutoff, [this,&pairs](unsigned i1, unsigned i2, const Vec3 &d, Float dist2) {
+      if (i1 != i2 && std::sqrt(dist2) < Atom::atomBondMaxDistance(atoms[i1]->elt, atoms[i2]->elt))
+        pairs.push_back({{i1, i2}});
+    });
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+    for (auto &p : pairs)
+      atoms[p[0]]->link(atoms[p[1]]);
+    invalidateBondGraph();
+    getBondGraph();
+    return;
+  }
+  // only atoms in the adjacent grid cells can be bonded
+  NeighborGrid grid(getAtomPositions(), cutoff);
+  // build bonds: partners are linked in the increasing index order, like the all-pairs loop does
+  std::vector<unsigned> near;
   for (unsigned i1 = 0, ie = atoms.size(); i1 < ie; i1++) {
     auto a1 = atoms[i1];
-    for (unsigned i2 = i1+1; i2 < ie; i2++) {
+    near.clear();
+    grid.forEachWithin(a1->pos(), cutoff, [i1,&near](unsigned i2, Float dist2) {
+      if (i2 > i1)
+        near.push_back(i2);
+    });
+    std::sort(near.begin(), near.end());
+    for (auto i2 : near) {
       auto a2 = atoms[i2];
       if (a1->isBond(*a2)) {
         a1->link(a2);
-        if ((a1->elt == N && a2->elt == C) || (a1->elt == C && a2->elt == N))
-          std::cout << "BOND--> dist=" << (a1->pos-a2->pos).len() << " [" << a1 << "] " << *a1 << " -> [" << a2 << "] " << *a2 << std::endl;
-      } else {
-        if ((a1->elt == N && a2->elt == C) || (a1->elt == C && a2->elt == N))
-          std::cout << ".. NO BOND--> dist=" << (a1->pos-a2->pos).len() << " [" << a1 << "] " << *a1 << " -> [" << a2 << "] " << *a2 << std::endl;
+        LOG_DETECT_BONDS("bond dist=" << (a1->pos()-a2->pos()).len() << " [" << a1 << "] " << *a1 << " -> [" << a2 << "] " << *a2)
+      }
+    }
+  }
+  // flat bond graph
+  invalidateBondGraph();
+  getBondGraph();
+}
+
+void Molecule::updateBonds(const std::vector<Atom*> &touched) {
+  if (touched.empty())
+    return;
+  if (lattice) { // the images of the touched atoms can be anywhere in the cell
+    detectBonds();
+    return;
+  }
+  // touched atoms lose all their bonds, and are bonded again with whatever atoms are near them now
+  for (auto a : touched) {
+    assert(a->molecule == this);
+    while (!a->bonds.empty())
+      a->unlink(a->bonds[0]);
+  }
+  // the longest bond that a touched atom can have with the elements present
+  std::array<bool,256> present{};
+  for (auto elt : elements)
+    present[elt] = true;
+  std::set<Element> eltsTouched;
+  for (auto a : touched)
+    eltsTouched.insert(a->elt);
+  Float cutoff = 0;
+  for (unsigned elt2 = 0; elt2 < present.size(); elt2++)
+    if (present[elt2])
+      for (auto elt1 : eltsTouched)
+        cutoff = std::max(cutoff, Atom::atomBondMaxDistance(elt1, Element(elt2)));
+  // only atoms in the bounding box of the touched atoms extended by the cutoff can be bonded to them
+  Vec3 lo = touched[0]->pos(), hi = lo;
+  for (auto a : touched)
+    for (unsigned d = 0; d < 3; d++) {
+      lo[d] = std::min(lo[d], a->pos()[d]);
+      hi[d] = std::max(hi[d], a->pos()[d]);
+    }
+  for (unsigned d = 0; d < 3; d++) {
+    lo[d] -= cutoff;
+    hi[d] += cutoff;
+  }
+  // the grid is built over the few touched atoms, and the candidates look up the touched atoms near them
+  std::vector<Vec3> touchedPts;
+  for (auto a : touched)
+    touchedPts.push_back(a->pos());
+  NeighborGrid grid(touchedPts, cutoff);
+  std::vector<std::vector<unsigned>> near(touched.size());
+  unsigned idx = 0;
+  for (auto &p : positions()) {
+    if (lo[0] <= p[0] && p[0] <= hi[0] && lo[1] <= p[1] && p[1] <= hi[1] && lo[2] <= p[2] && p[2] <= hi[2])
+      grid.forEachWithin(p, cutoff, [idx,&near](unsigned ti, Float dist2) {
+        near[ti].push_back(idx);
+      });
+    idx++;
+  }
+  // partners come in the increasing index order, like in detectBonds
+  for (unsigned ti = 0; ti < touched.size(); ti++) {
+    auto a1 = touched[ti];
+    for (auto i2 : near[ti]) {
+      auto a2 = atoms[i2];
+      if (a2 != a1 && !a1->hasBond(a2) && a1->isBond(*a2)) {
+        a1->link(a2);
+        LOG_DETECT_BONDS("bond dist=" << (a1->pos()-a2->pos()).len() << " [" << a1 << "] " << *a1 << " -> [" << a2 << "] " << *a2)
+      }
+    }
+  }
+  // the flat bond graph is rebuilt when it is needed next time
+  invalidateBondGraph();
+}
+
+const Molecule::BondGraph& Molecule::getBondGraph() const {
+  if (!bondGraphValid) {
+    bondGraph.offsets.resize(atoms.size() + 1);
+    bondGraph.nbrs.clear();
+    unsigned idx = 0;
+    for (auto a : atoms) {
+      bondGraph.offsets[idx++] = bondGraph.nbrs.size();
+      for (auto n : a->bonds)
+        bondGraph.nbrs.push_back(n->index);
+    }
+    bondGraph.offsets[idx] = bondGraph.nbrs.size();
+    bondGraphValid = true;
+  }
+  return bondGraph;
+}
+
+Float Molecule::maxBondDistance() const {
+  std::set<Element> elts;
+  for (auto a : atoms)
+    elts.insert(a->elt);
+  Float dist = 0;
+  for (auto elt1 : elts)
+    for (auto elt2 : elts)
+      dist = std::max(dist, Atom::atomBondMaxDistance(elt1, elt2));
+  return dist;
+}
+
+std::vector<Vec3> Molecule::getAtomPositions() const {
+  auto pts = positions();
+  return std::vector<Vec3>(pts.begin(), pts.end());
+}
+
+void Molecule::setCoords(const std::vector<double> &newCoords) {
+  if (newCoords.size() != 3*atoms.size())
+    ERROR("Molecule::setCoords: coordinates array has " << newCoords.size() << " elements, expected " << 3*atoms.size())
+  std::copy(newCoords.begin(), newCoords.end(), coords.begin());
+}
+
+void Molecule::setElements(const std::vector<uint8_t> &newElements) {
+  if (newElements.size() != atoms.size())
+    ERROR("Molecule::setElements: elements array has " << newElements.size() << " elements, expected " << atoms.size())
+  auto numKnown = PeriodicTableData::get().numElements();
+  for (auto e : newElements)
+    if (e == 0 || e > numKnown)
+      ERROR("Molecule::setElements: invalid element " << unsigned(e))
+  for (unsigned i = 0, ie = atoms.size(); i < ie; i++)
+    atoms[i]->elt = Element(newElements[i]);
+  elements = newElements;
+}
+
+std::vector<unsigned> Molecule::getChains() const {
+  std::vector<unsigned> res(atoms.size());
+  for (unsigned i = 0, ie = atoms.size(); i < ie; i++)
+    res[i] = atoms[i]->chain;
+  return res;
+}
+
+std::vector<unsigned> Molecule::getGroups() const {
+  std::vector<unsigned> res(atoms.size());
+  for (unsigned i = 0, ie = atoms.size(); i < ie; i++)
+    res[i] = atoms[i]->group;
+  return res;
+}
+
+void Molecule::setChains(const std::vector<unsigned> &newChains) {
+  if (newChains.size() != atoms.size())
+    ERROR("Molecule::setChains: chains array has " << newChains.size() << " elements, expected " << atoms.size())
+  nChains = 0;
+  for (unsigned i = 0, ie = atoms.size(); i < ie; i++) {
+    atoms[i]->chain = newChains[i];
+    nChains = std::max(nChains, newChains[i]+1);
+  }
+}
+
+void Molecule::setGroups(const std::vector<unsigned> &newGroups) {
+  if (newGroups.size() != atoms.size())
+    ERROR("Molecule::setGroups: groups array has " << newGroups.size() << " elements, expected " << atoms.size())
+  nGroups = 0;
+  for (unsigned i = 0, ie = atoms.size(); i < ie; i++) {
+    atoms[i]->group = newGroups[i];
+    nGroups = std::max(nGroups, newGroups[i]+1);
+  }
+}
+
+std::vector<unsigned> Molecule::getBondPairs() const {
+  auto &graph = getBondGraph();
+  std::vector<unsigned> res;
+  res.reserve(graph.nbrs.size());
+  for (unsigned i = 0, ie = graph.numAtoms(); i < ie; i++)
+    for (auto j : graph.neighbors(i))
+      if (i < j) {
+        res.push_back(i);
+        res.push_back(j);
+      }
+  return res;
+}
+
+NeighborGrid* Molecule::buildNeighborGrid(Float cellSize) const {
+  return new NeighborGrid(getAtomPositions(), cellSize);
+}
+
+void Molecule::setLattice(const std::array<Vec3,3> &vecs) {
+  lattice.reset(new Lattice(vecs));
+}
+
+void Molecule::clearLattice() {
+  lattice.reset();
+}
+
+Float Molecule::distance(unsigned i1, unsigned i2) const {
+  auto d = positions()[i2] - positions()[i1];
+  return (lattice ? lattice->minimumImage(d) : d).len();
+}
+
+void Molecule::wrapAtoms() {
+  if (!lattice)
+    ERROR("Molecule::wrapAtoms: the molecule isn't periodic")
+  for (auto &p : positions())
+    p = lattice->wrap(p);
+}
+
+Molecule* Molecule::supercell(const std::array<unsigned,3> &n) const {
+  if (!lattice)
+    ERROR("Molecule::supercell: the molecule isn't periodic")
+  if (n[0] == 0 || n[1] == 0 || n[2] == 0)
+    ERROR("Molecule::supercell: the numbers of cells should be positive, got " << n[0] << "x" << n[1] << "x" << n[2])
+  std::unique_ptr<Molecule> res(new Molecule(descr));
+  res->reserve(atoms.size()*n[0]*n[1]*n[2]);
+  auto &vecs = lattice->getVectors();
+  for (unsigned ia = 0; ia < n[0]; ia++)
+    for (unsigned ib = 0; ib < n[1]; ib++)
+      for (unsigned ic = 0; ic < n[2]; ic++) {
+        auto shift = vecs[0]*Float(ia) + vecs[1]*Float(ib) + vecs[2]*Float(ic);
+        for (auto a : atoms)
+          res->add(Atom(a->elt, a->pos() + shift));
       }
+  res->lattice.reset(new Lattice(lattice->scaled(n)));
+  return res.release();
+}
+
+bool Molecule::hasClash(Float minDist) const {
+  if (!(minDist > 0) || atoms.empty())
+    return false;
+  if (lattice) {
+    auto minDist2 = minDist*minDist;
+    return lattice->anyPairWithin(getAtomPositions(), minDist, [minDist2](unsigned i1, unsigned i2, const Vec3 &d, Float dist2) {
+      return dist2 < minDist2;
+    });
+  }
+  if (atoms.size() < 2)
+    return false;
+  return NeighborGrid(getAtomPositions(), minDist).hasPairCloser(minDist);
+}
+
+bool Molecule::hasClash(const Molecule &other, Float minDist) const {
+  if (!(minDist > 0) || atoms.empty() || other.atoms.empty())
+    return false;
+  // the grid is over the larger molecule, the smaller one queries it
+  auto &big = atoms.size() >= other.atoms.size() ? *this : other;
+  auto &small = &big == this ? other : *this;
+  NeighborGrid grid(big.getAtomPositions(), minDist);
+  auto minDist2 = minDist*minDist;
+  for (auto &p : small.positions())
+    if (grid.anyWithin(p, minDist, [minDist2](unsigned idx, Float dist2) {return dist2 < minDist2;}))
+      return true;
+  return false;
+}
+
+std::vector<unsigned> Molecule::findContacts(Float cutoff) const {
+  std::vector<unsigned> res;
+  if (!(cutoff > 0))
+    return res;
+  if (lattice) { // a pair is listed once even when several of its images are in contact
+    std::vector<std::array<unsigned,2>> pairs;
+    lattice->forEachPairWithin(getAtomPositions(), cutoff, [&pairs](unsigned i1, unsigned i2, const Vec3 &d, Float dist2) {
+      if (i1 != i2)
+        pairs.push_back({{i1, i2}});
+    });
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+    for (auto &pair : pairs) {
+      res.push_back(pair[0]);
+      res.push_back(pair[1]);
+    }
+    return res;
+  }
+  for (auto &pair : NeighborGrid(getAtomPositions(), cutoff).findPairsWithin(cutoff)) {
+    res.push_back(pair[0]);
+    res.push_back(pair[1]);
+  }
+  return res;
+}
+
+std::vector<unsigned> Molecule::findContacts(const Molecule &other, Float cutoff) const {
+  std::vector<unsigned> res;
+  if (!(cutoff > 0) || atoms.empty() || other.atoms.empty())
+    return res;
+  NeighborGrid grid(other.getAtomPositions(), cutoff);
+  std::vector<unsigned> found;
+  for (unsigned i = 0, ie = atoms.size(); i < ie; i++) {
+    found.clear();
+    grid.forEachWithin(positions()[i], cutoff, [&found](unsigned idx, Float dist2) {
+      found.push_back(idx);
+    });
+    std::sort(found.begin(), found.end());
+    for (auto j : found) {
+      res.push_back(i);
+      res.push_back(j);
     }
   }
+  return res;
 }
 
 bool Molecule::isEqual(const Molecule &other) const {
@@ -483,32 +837,49 @@ bool Molecule::isEqual(const Molecule &other) const {
   return true;
 }
 
-std::set<Atom*> Molecule::listNeighborsHierarchically(Atom *self, bool includeSelf, const Atom *except1, const Atom *except2) { // up to 2 excluded atoms
-  std::set<Atom*> lst;
-
-  auto listBonds = [self,except1,except2,&lst](Atom *a, auto &lb) -> void {
-    for (auto n : a->bonds)
-      if (n != self && n != except1 && n != except2)
-        if (lst.find(n) == lst.end()) {
-          lst.insert(n);
-          lb(n, lb);
-        }
-  };
-
-  listBonds(self, listBonds);
+std::vector<Atom*> Molecule::listNeighborsHierarchically(Atom *self, bool includeSelf, const Atom *except1, const Atom *except2) { // up to 2 excluded atoms
+  std::vector<Atom*> lst;
+  if (!self->molecule) { // a standalone atom has no bonds
+    if (includeSelf)
+      lst.push_back(self);
+    return lst;
+  }
 
+  auto &atoms = self->molecule->atoms;
+  auto &graph = self->molecule->getBondGraph();
+  std::vector<bool> seen(atoms.size(), false);
+  for (auto a : {(const Atom*)self, except1, except2})
+    if (a)
+      seen[a->index] = true;
+
+  // traverse the bond graph, excluded atoms aren't passed through
+  std::vector<unsigned> found;
+  std::vector<unsigned> todo = {self->index};
+  while (!todo.empty()) {
+    auto a = todo.back();
+    todo.pop_back();
+    for (auto n : graph.neighbors(a))
+      if (!seen[n]) {
+        seen[n] = true;
+        found.push_back(n);
+        todo.push_back(n);
+      }
+  }
   if (includeSelf)
-    lst.insert(self);
+    found.push_back(self->index);
 
+  std::sort(found.begin(), found.end());
+  lst.reserve(found.size());
+  for (auto i : found)
+    lst.push_back(atoms[i]);
   return lst;
 }
 
 void Molecule::appendAsAminoAcidChain(Molecule &aa, const std::vector<Angle> &angles) { // angles are in degrees, -180..+180
-  typedef AaAngles A;
   LOG_ROTATE_FUNCTIONS("appendAaChain: >>>")
 
   // check angles
-  A::checkAngles(angles, "Molecule::appendAsAminoAcidChain");
+  AaAngles::checkAngles(angles, "Molecule::appendAsAminoAcidChain");
 
   // ASSUME that aa is an amino acid XXX alters aa
   // ASSUME that aa is small because we will translate/rotate it
@@ -516,22 +887,38 @@ void Molecule::appendAsAminoAcidChain(Molecule &aa, const std::vector<Angle> &an
   // find C/N terms // XXX some peptides are also defined beginning with C-term for some reason, we need another procedure for that
   auto meAaBackboneCterm = me.findAaBackboneLast();
   auto aaAaBackboneNterm = aa.findAaBackboneFirst();
-  // local functions in a form of lambda functions
-  // center them both at the junction point
-  me.centerAt(meAaBackboneCterm.O1->pos); // XXX should not center it
-  aa.centerAt(aaAaBackboneNterm.N->pos);
+  auto aaAaBackboneCterm = aa.findAaBackboneLast();
+  me.centerAt(meAaBackboneCterm.O1->pos()); // XXX should not center it
+  placeAminoAcid(meAaBackboneCterm, aa, aaAaBackboneNterm, aaAaBackboneCterm, angles);
+
+  // remove atoms that are excluded by the connection: 1xO and 2xH atoms
+  me.removeAtEnd(meAaBackboneCterm.O1);
+  me.removeAtEnd(meAaBackboneCterm.Ho);
+  aa.removeAtBegin(aaAaBackboneNterm.HCn1->elt == H ? aaAaBackboneNterm.HCn1 : aaAaBackboneNterm.Hn2); // ad-hoc choice - HCn1 and Hn2 are chosen aritrarily in 'findAaBackbone'
+
+  // append aa to me
+  add(aa);
+
+  LOG_ROTATE_FUNCTIONS("appendAaChain: <<<")
+}
+
+void Molecule::placeAminoAcid(const AaBackbone &meAaBackboneCterm, Molecule &aa, const AaBackbone &aaAaBackboneNterm, const AaBackbone &aaAaBackboneCterm, const std::vector<Angle> &angles) {
+  typedef AaAngles A;
+
+  // center aa at the junction point: its N goes where O1 of the C-term is
+  aa.centerAt(aaAaBackboneNterm.N->pos());
   // rotate aa to (1) align its Oalpha-N axis with me's Oalpha-N axis, (2) make O2 bonds anti-parallel
   { // XXX this might be a wrong way, but we align them such that they are in one line along the AA backbone
     auto meAlong = getAtomAxis(meAaBackboneCterm.N, meAaBackboneCterm.O1);
     auto aaAlong = getAtomAxis(aaAaBackboneNterm.N, aaAaBackboneNterm.O1);
-    auto aaAaBackboneCterm = aa.findAaBackboneLast();
-    auto meDblO = (meAaBackboneCterm.O2->pos - meAaBackboneCterm.Coo->pos).orthogonal(meAlong).normalize();
-    auto aaDblO = (aaAaBackboneCterm.O2->pos - aaAaBackboneCterm.Coo->pos).orthogonal(aaAlong).normalize();
+    auto meDblO = (meAaBackboneCterm.O2->pos() - meAaBackboneCterm.Coo->pos()).orthogonal(meAlong).normalize();
+    auto aaDblO = (aaAaBackboneCterm.O2->pos() - aaAaBackboneCterm.Coo->pos()).orthogonal(aaAlong).normalize();
     assert(meDblO.isOrthogonal(meAlong));
     assert(aaDblO.isOrthogonal(aaAlong));
     aa.applyMatrix(Vec3Extra::rotateCornerToCorner(meAlong,meDblO, aaAlong,-aaDblO));
-    assert((meAaBackboneCterm.O1->pos - meAaBackboneCterm.N->pos).isParallel((aaAaBackboneNterm.O1->pos - aaAaBackboneNterm.N->pos)));
+    assert((meAaBackboneCterm.O1->pos() - meAaBackboneCterm.N->pos()).isParallel((aaAaBackboneNterm.O1->pos() - aaAaBackboneNterm.N->pos())));
   }
+  aa.centerAt(-meAaBackboneCterm.O1->pos());
 
   // apply omega, phi, psi angles
   if (angles.size() >= A::MAX_RAM+1) {
@@ -542,9 +929,9 @@ void Molecule::appendAsAminoAcidChain(Molecule &aa, const std::vector<Angle> &an
     LOG_ROTATE_FUNCTIONS("appendAaChain: priorOmega=" << priorOmega.angle << " priorPhi=" << priorPhi.angle << " priorPsi=" << priorPsi.angle)
     LOG_ROTATE_FUNCTIONS("appendAaChain: newOmega=" << angles[A::OMEGA] << " newPhi=" << angles[A::PHI] << " newPsi=" << angles[A::PSI])
     // rotate: begin from the most remote from C-term
-    rotateAtoms(A::PSI,   aaAaBackboneNterm.Cmain->pos, priorPsi.axis,   angles[A::PSI]   - priorPsi.angle,   aa.atoms, aaAaBackboneNterm.N);
-    rotateAtoms(A::PHI,   aaAaBackboneNterm.N->pos,     priorPhi.axis,   angles[A::PHI]   - priorPhi.angle,   aa.atoms, nullptr);
-    rotateAtoms(A::OMEGA, meAaBackboneCterm.Coo->pos,   priorOmega.axis, angles[A::OMEGA] - priorOmega.angle, aa.atoms, nullptr);
+    rotateAtoms(A::PSI,   aaAaBackboneNterm.Cmain->pos(), priorPsi.axis,   angles[A::PSI]   - priorPsi.angle,   aa.atoms, aaAaBackboneNterm.N);
+    rotateAtoms(A::PHI,   aaAaBackboneNterm.N->pos(),     priorPhi.axis,   angles[A::PHI]   - priorPhi.angle,   aa.atoms, nullptr);
+    rotateAtoms(A::OMEGA, meAaBackboneCterm.Coo->pos(),   priorOmega.axis, angles[A::OMEGA] - priorOmega.angle, aa.atoms, nullptr);
   }
 
   // apply adjacencyN, adjacencyCmain, adjacencyCoo when supplied
@@ -555,9 +942,9 @@ void Molecule::appendAsAminoAcidChain(Molecule &aa, const std::vector<Angle> &an
     LOG_ROTATE_FUNCTIONS("appendAaChain: priorAdjacencyN=" << priorAdjacencyN.angle << " priorAdjacencyCmain=" << priorAdjacencyCmain.angle << " priorAdjacencyCoo=" << priorAdjacencyCoo.angle)
     LOG_ROTATE_FUNCTIONS("appendAaChain: newAdjacencyN=" << angles[A::ADJ_N] << " newAdjacencyCmain=" << angles[A::ADJ_CMAIN] << " newAdjacencyCoo=" << angles[A::ADJ_COO])
     // rotate: begin from the most remote from C-term
-    rotateAtoms(A::ADJ_COO,   aaAaBackboneNterm.Coo->pos,   priorAdjacencyCoo.axis,   angles[A::ADJ_COO]   - priorAdjacencyCoo.angle,   aa.atoms, aaAaBackboneNterm.N);
-    rotateAtoms(A::ADJ_CMAIN, aaAaBackboneNterm.Cmain->pos, priorAdjacencyCmain.axis, angles[A::ADJ_CMAIN] - priorAdjacencyCmain.angle, aa.atoms, nullptr);
-    rotateAtoms(A::ADJ_N,     aaAaBackboneNterm.N->pos,     priorAdjacencyN.axis,     angles[A::ADJ_N]     - priorAdjacencyN.angle,     aa.atoms, nullptr);
+    rotateAtoms(A::ADJ_COO,   aaAaBackboneNterm.Coo->pos(),   priorAdjacencyCoo.axis,   angles[A::ADJ_COO]   - priorAdjacencyCoo.angle,   aa.atoms, aaAaBackboneNterm.N);
+    rotateAtoms(A::ADJ_CMAIN, aaAaBackboneNterm.Cmain->pos(), priorAdjacencyCmain.axis, angles[A::ADJ_CMAIN] - priorAdjacencyCmain.angle, aa.atoms, nullptr);
+    rotateAtoms(A::ADJ_N,     aaAaBackboneNterm.N->pos(),     priorAdjacencyN.axis,     angles[A::ADJ_N]     - priorAdjacencyN.angle,     aa.atoms, nullptr);
   }
 
   // apply secondary angles when supplied
@@ -570,21 +957,11 @@ void Molecule::appendAsAminoAcidChain(Molecule &aa, const std::vector<Angle> &an
     LOG_ROTATE_FUNCTIONS("appendAaChain: newSecondaryO2Rise=" << angles[A::O2_RISE] << " newSecondaryO2Tilt=" << angles[A::O2_TILT] << " newSecondaryPlRise=" << angles[A::PL_RISE] << " newSecondaryPlTilt=" << angles[A::PL_TILT])
     auto ntermPayload = aaAaBackboneNterm.listPayload();
     // rotate: begin from the most remote from C-term
-    rotateAtom (A::O2_RISE, aaAaBackboneNterm.Coo->pos,   priorSecondaryO2Rise.axis, angles[A::O2_RISE] - priorSecondaryO2Rise.angle, aaAaBackboneNterm.O2);
-    rotateAtom (A::O2_TILT, aaAaBackboneNterm.Coo->pos,   priorSecondaryO2Rise.axis, angles[A::O2_TILT] - priorSecondaryO2Tilt.angle, aaAaBackboneNterm.O2);
-    rotateAtoms(A::PL_RISE, aaAaBackboneNterm.Cmain->pos, priorSecondaryO2Rise.axis, angles[A::PL_RISE] - priorSecondaryPlRise.angle, ntermPayload, nullptr);
-    rotateAtoms(A::PL_TILT, aaAaBackboneNterm.Cmain->pos, priorSecondaryO2Rise.axis, angles[A::PL_TILT] - priorSecondaryPlTilt.angle, ntermPayload, nullptr);
+    rotateAtom (A::O2_RISE, aaAaBackboneNterm.Coo->pos(),   priorSecondaryO2Rise.axis, angles[A::O2_RISE] - priorSecondaryO2Rise.angle, aaAaBackboneNterm.O2);
+    rotateAtom (A::O2_TILT, aaAaBackboneNterm.Coo->pos(),   priorSecondaryO2Rise.axis, angles[A::O2_TILT] - priorSecondaryO2Tilt.angle, aaAaBackboneNterm.O2);
+    rotateAtoms(A::PL_RISE, aaAaBackboneNterm.Cmain->pos(), priorSecondaryO2Rise.axis, angles[A::PL_RISE] - priorSecondaryPlRise.angle, ntermPayload, nullptr);
+    rotateAtoms(A::PL_TILT, aaAaBackboneNterm.Cmain->pos(), priorSecondaryO2Rise.axis, angles[A::PL_TILT] - priorSecondaryPlTilt.angle, ntermPayload, nullptr);
   }
-
-  // remove atoms that are excluded by the connection: 1xO and 2xH atoms
-  me.removeAtEnd(meAaBackboneCterm.O1);
-  me.removeAtEnd(meAaBackboneCterm.Ho);
-  aa.removeAtBegin(aaAaBackboneNterm.HCn1->elt == H ? aaAaBackboneNterm.HCn1 : aaAaBackboneNterm.Hn2); // ad-hoc choice - HCn1 and Hn2 are chosen aritrarily in 'findAaBackbone'
-
-  // append aa to me
-  add(aa);
-
-  LOG_ROTATE_FUNCTIONS("appendAaChain: <<<")
 }
 
 std::vector<std::array<Molecule::Angle,Molecule::AaAngles::CNT>> Molecule::readAminoAcidAnglesFromAaChain(const std::vector<AaBackbone> &aaBackbones) {
@@ -622,8 +999,7 @@ void Molecule::setAminoAcidAnglesInAaChain(const std::vector<AaBackbone> &aaBack
       ERROR("Molecule::setAminoAcidAnglesInAaChain: every index should be in the range of 0.." << aaBackbones.size()-2 <<
                                                     " but found index=" << i)
 
-  // not yet implemented
-  ERROR("Molecule::setAminoAcidAnglesInAaChain isn't yet implemented")
+  aaBackbones[0].N->molecule->setAminoAcidSequenceAngles(aaBackbones, indices, angles);
 }
 
 std::string Molecule::toString() const {
@@ -641,9 +1017,10 @@ Vec3 Molecule::centerOfMass() const {
   const PeriodicTableData &ptd = PeriodicTableData::get();
   Vec3 m(0,0,0);
   double totalMass = 0;
-  for (auto a : atoms) {
-    auto M = ptd((unsigned)a->elt).atomic_mass;
-    m += a->pos*M;
+  auto pts = positions();
+  for (unsigned i = 0, ie = pts.size(); i < ie; i++) {
+    auto M = ptd(elements[i]).atomic_mass;
+    m += pts[i]*M;
     totalMass += M;
   }
 
@@ -651,8 +1028,8 @@ Vec3 Molecule::centerOfMass() const {
 }
 
 void Molecule::snapToGrid(const Vec3 &grid) {
-  for (auto a : atoms)
-    a->snapToGrid(grid);
+  for (auto &p : positions())
+    p.snapToGrid(grid);
 }
 
 template<typename Fn>
@@ -739,14 +1116,34 @@ bool Molecule::findAaBackbone(Atom *O2anchor, AaBackbone &aaBackbone) {
 
 /// internals
 
+Atom* Molecule::attach(Atom *a) {
+  auto pos = a->pos(); // detached position
+  a->molecule = this;
+  a->index = atoms.size();
+  atoms.push_back(a);
+  coords.insert(coords.end(), pos.begin(), pos.end());
+  elements.push_back(a->elt);
+  invalidateBondGraph();
+  return a;
+}
+
+void Molecule::copyBonds(const Molecule &m, unsigned offset) { // m's atoms were copied into this molecule beginning at offset
+  for (unsigned i = 0, ie = m.atoms.size(); i < ie; i++) {
+    auto &bonds = atoms[offset + i]->bonds;
+    for (auto b : m.atoms[i]->bonds)
+      bonds.push_back(atoms[offset + b->index]);
+  }
+  invalidateBondGraph();
+}
+
 Vec3 Molecule::getAtomAxis(const Atom *atom1, const Atom *atom2) {
-  return (atom2->pos - atom1->pos).normalize();
+  return (atom2->pos() - atom1->pos()).normalize();
 }
 
 void Molecule::rotateAtom(AaAngles::Type atype, const Vec3 &center, const Vec3 &axis, double angleD, Atom *a) {
   LOG_ROTATE_FUNCTIONS("rotateAtom: atype=" << atype << " center=" << center << " axis=" << axis << " angleD=" << angleD << " atom=" << *a)
   auto M = Mat3::rotate(axis, Vec3::degToRad(angleD));
-  a->pos = M*(a->pos - center) + center;
+  a->pos() = M*(a->pos() - center) + center;
 }
 
 template<typename Atoms, typename Fn>
@@ -793,7 +1190,7 @@ void Molecule::rotateAtoms(AaAngles::Type atype, const Vec3 &center, const Vec3
   auto M = Mat3::rotate(axis, Vec3::degToRad(angleD));
   iterate(atoms, [&center,except,&M](Atom *a) {
     if (a != except)
-      a->pos = M*(a->pos - center) + center;
+      a->pos() = M*(a->pos() - center) + center;
   });
 }
 
@@ -836,7 +1233,7 @@ std::ostream& operator<<(std::ostream &os, const Molecule &m) {
 
 /// Molecule::AaBackbone
 
-std::set<Atom*> Molecule::AaBackbone::listPayload() const {
+std::vector<Atom*> Molecule::AaBackbone::listPayload() const {
   return Molecule::listNeighborsHierarchically(payload, true/*includeSelf*/, Cmain, N); // except Cmain,N (N is only for Proline)
 }
 
@@ -994,7 +1391,7 @@ Molecule::AaAngles::AngleAndAxis Molecule::AaAngles::tiltFromChain(const Atom *a
 }
 
 Vec3 Molecule::AaAngles::atomPairToVec(const Atom *a1, const Atom *a2) {
-  return (a2->pos - a1->pos);
+  return (a2->pos() - a1->pos());
 }
 
 Vec3 Molecule::AaAngles::atomPairToVecN(const Atom *a1, const Atom *a2) { // returns a normalized vector
@@ -5,8 +5,10 @@
 #include "obj.h"
 #include "Vec3.h"
 #include "Mat3.h"
+#include "stl-ext.h"
 
 #include <boost/format.hpp>
+#include <boost/container/small_vector.hpp>
 
 #include <iostream>
 #include <fstream>
@@ -16,6 +18,9 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <memory>
+#include <cstdint>
+#include <type_traits>
 
 enum Element {
   H  = 1,
@@ -62,37 +67,43 @@ std::ostream& operator<<(std::ostream &os, Element e);
 std::istream& operator>>(std::istream &is, Element &e);
 
 class Molecule;
+class NeighborGrid;
+class Lattice;
+struct XyzFrame;
 
 // define SecondaryStructureKind values to be the same as in the secStructList of MMTF because for now they mostly come from there
 enum SecondaryStructureKind {Undefined = -1, PiHelix = 0, Bend = 1, AlphaHelix = 2, Extended = 3, Helix3_10 = 4, Bridge = 5, Turn = 6, Coil = 7};
 std::ostream& operator<<(std::ostream &os, const SecondaryStructureKind &secStr);
 
 class Atom : public Obj {
+  Vec3               detachedPos; // position while the atom doesn't belong to a molecule, otherwise it is kept in Molecule::coords
 public:
   Molecule          *molecule; // Atom can only belong to one molecule
+  unsigned           index;    // index in molecule->atoms and molecule->coords, valid while molecule is set
+  bool               inArena;  // allocated in the molecule's AtomArena, otherwise on the heap
   Element            elt;
-  Vec3               pos;
   bool               isHetAtm; // what exactly is this?
   std::string        name;     // atom can be given a name, see group.atomNameList[] in MMTF spec
-  std::vector<Atom*> bonds;    // all bonds are listed
+  boost::container::small_vector<Atom*,4> bonds; // all bonds are listed, typical valences don't need any allocations
   unsigned           chain;    // chain number, if available
   unsigned           group;    // group number, if available
   SecondaryStructureKind secStructKind; // defined per-group, but we don't have group objects
   void              *obj;
-  Atom(Element newElt, const Vec3 &newPos) : molecule(nullptr), elt(newElt), pos(newPos), isHetAtm(false), chain(0), group(0), secStructKind(Undefined), obj(nullptr) {
+  Atom(Element newElt, const Vec3 &newPos) : detachedPos(newPos), molecule(nullptr), index(0), inArena(false), elt(newElt), isHetAtm(false), chain(0), group(0), secStructKind(Undefined), obj(nullptr) {
     //std::cout << "Atom::Atom " << this << std::endl;
   }
   Atom(const Atom &other)
-  : molecule(nullptr), elt(other.elt), pos(other.pos), isHetAtm(other.isHetAtm), chain(other.chain), group(other.group), secStructKind(other.secStructKind), obj(nullptr) { // all but bonds and obj
+  : detachedPos(other.pos()), molecule(nullptr), index(0), inArena(false), elt(other.elt), isHetAtm(other.isHetAtm), name(other.name), chain(other.chain), group(other.group), secStructKind(other.secStructKind), obj(nullptr) { // all but bonds and obj
     //std::cout << "Atom::Atom(copy) " << this << std::endl;
   }
   ~Atom() {
     //std::cout << "Atom::~Atom " << this << std::endl;
   }
+  Vec3& pos(); // defined after Molecule
+  const Vec3& pos() const;
   Atom transform(const Vec3 &shft, const Vec3 &rot) const {
-    return Atom(elt, Mat3::rotate(rot)*pos + shft);
+    return Atom(elt, Mat3::rotate(rot)*pos() + shft);
   }
-  Atom* setMolecule(Molecule *m) {molecule = m; return this;}
   bool isEqual(const Atom &other) const; // compares if the data is exactly the same
   unsigned nbonds() const {return bonds.size();}
   bool hasBond(const Atom *other) const;
@@ -116,10 +127,14 @@ public:
       return 2*0.37;
     return atomBondAvgRadius(elt1) + atomBondAvgRadius(elt2);
   }
+  static constexpr Float bondTolerance = 0.2;
+  static Float atomBondMaxDistance(Element elt1, Element elt2) { // atoms further than this are never bonded
+    return atomBondAvgDistance(elt1, elt2) + bondTolerance;
+  }
   bool isBond(const Atom &a) const {
-    auto distActual = (pos - a.pos).len();
+    auto distActual = (pos() - a.pos()).len();
     auto distAverage = atomBondAvgDistance(elt, a.elt);
-    const static Float tolerance = 0.2;
+    const Float tolerance = bondTolerance;
     //assert(distActual > distAverage - tolerance); // needs to be larger than this threshold, otherwise this molecule is invalid
     if (distActual <= distAverage - tolerance)
       warning("distance between atoms " << elt << "@" << (void*)this << "/" << a.elt << "@" << (void*)&a << " is too low: dist=" << distActual << " avg=" << distAverage << " tolerance=" << tolerance)
@@ -131,12 +146,15 @@ public:
   }
   void addToBonds(Atom *a) {
     bonds.push_back(a);
+    bondsChanged();
   }
+  void bondsChanged(); // defined after Molecule
   std::string bondsAsString() const;
   void removeFromBonds(Atom *a) {
     for (auto i = bonds.begin(), ie = bonds.end(); i != ie; i++)
       if (*i == a) {
         bonds.erase(i);
+        bondsChanged();
         return;
       }
     unreachable();
@@ -146,7 +164,7 @@ public:
     othr->removeFromBonds(this);
   }
   void applyMatrix(const Mat3 &m) {
-    pos = m*pos;
+    pos() = m*pos();
   }
   Atom* getOtherBondOf3(Atom *othr1, Atom *othr2) const;
   Atom* findOnlyC() const;
@@ -242,16 +260,49 @@ public:
     return res;
   }
   void centerAt(const Vec3 &pt) {
-    pos -= pt;
+    pos() -= pt;
   }
   void scale(double coef) {
-    pos *= coef;
+    pos() *= coef;
   }
   void snapToGrid(const Vec3 &grid);
   // printing
   friend std::ostream& operator<<(std::ostream &os, const Atom &a);
 }; // Atom
 
+class AtomArena { // chunked storage for the atoms of one molecule: atoms are constructed in place, never move, and the memory is released all at once
+  typedef std::aligned_storage<sizeof(Atom), alignof(Atom)>::type Slot;
+  std::vector<std::unique_ptr<Slot[]>> chunks;
+  unsigned chunkSize; // slots in the last chunk
+  unsigned chunkUsed; // used slots in the last chunk
+public:
+  AtomArena() : chunkSize(0), chunkUsed(0) { }
+  AtomArena(const AtomArena &other) = delete;
+  void reserve(unsigned n) { // the next n atoms will be allocated in one chunk
+    if (chunkSize - chunkUsed < n)
+      newChunk(n);
+  }
+  Atom* create(const Atom &a) {
+    if (chunkUsed == chunkSize)
+      newChunk(chunkSize < 16 ? 16 : 2*chunkSize);
+    auto atom = new (&chunks.back()[chunkUsed++]) Atom(a);
+    atom->inArena = true;
+    return atom;
+  }
+  static void destroy(Atom *a) { // the slot isn't reused
+    if (a->inArena)
+      a->~Atom();
+    else
+      delete a;
+  }
+private:
+  void newChunk(unsigned n) {
+    chunks.emplace_back(new Slot[n]);
+    chunkSize = n;
+    chunkUsed = 0;
+  }
+}; // AtomArena
+
 class Molecule : public Obj {
 public: // structs and types
   struct AaBackbone {
@@ -266,7 +317,7 @@ public: // structs and types
     Atom    *Ho;        // H in OH group (optional, missing when bonded at C)
     Atom    *payload;   // the first atom of the rest of the amino acid
     // methods
-    std::set<Atom*> listPayload() const;  // list all payload atoms
+    std::vector<Atom*> listPayload() const;  // list all payload atoms
     Atom* nextN() const;                  // next N if connected, otherwise our O1
     bool isNterm() const {return Hn2 != nullptr;}
     bool isCterm() const {return O1 != nullptr;}
@@ -329,12 +380,33 @@ public: // structs and types
   }; // CmpStr
   typedef std::array<Angle, Molecule::AaAngles::CNT> AngleArray;
   typedef std::map<const char*, Molecule::Angle, CmpStr> AngleMap; // (DBG) map is used in retrieval functions with suffix "M". It is used for the ease of debugging only.
+  struct BondGraph { // bonds in the compressed sparse row form: neighbors of the atom i are nbrs[offsets[i]..offsets[i+1]), in the order of Atom::bonds
+    std::vector<unsigned> offsets; // numAtoms+1 entries
+    std::vector<unsigned> nbrs;    // atom indexes, every bond is listed twice
+    unsigned numAtoms() const {return offsets.empty() ? 0 : offsets.size()-1;}
+    unsigned numBonds() const {return nbrs.size()/2;}
+    unsigned degree(unsigned i) const {return offsets[i+1] - offsets[i];}
+    std_ext::array_range<const unsigned> neighbors(unsigned i) const {return std_ext::array_range<const unsigned>(nbrs.data() + offsets[i], nbrs.data() + offsets[i+1]);}
+  }; // BondGraph
+  struct OrientedBox { // box enclosing all atoms
+    Vec3               center;
+    std::array<Vec3,3> axes;    // orthonormal
+    Vec3               extents; // side lengths along the axes
+  }; // OrientedBox
 public:
   std::string        idx;
   std::string        descr;
   std::vector<Atom*> atoms; // own atoms here
+  std::vector<double> coords; // positions of all atoms: x,y,z triplets in the order of atoms (FloatArray8 layout)
+  std::vector<uint8_t> elements; // elements of all atoms in the order of atoms (Binary layout), mirrors Atom::elt
   unsigned           nChains; // zero when the object doesn't represent chains
   unsigned           nGroups; // zero when the object doesn't have groups defined
+private:
+  AtomArena          arena;   // atoms copied into the molecule are allocated here, atoms passed in by pointer stay on the heap
+  mutable BondGraph  bondGraph; // flat copy of the bonds for traversals, rebuilt when it is requested after the bonds or the atoms change
+  mutable bool       bondGraphValid;
+  std::unique_ptr<Lattice> lattice; // periodic cell, null when the molecule isn't periodic
+public:
   Molecule(const std::string &newDescr);
   Molecule(const Molecule &other);
   ~Molecule();
@@ -343,18 +415,23 @@ public:
   unsigned numAtoms() const {return atoms.size();}
   void add(const Atom &a); // doesn't detect bonds when one atom is added
   void add(Atom *a); // doesn't detect bonds when one atom is added // pass ownership of the object
-  void add(const Molecule &m, bool doDetectBonds = true);
+  void add(const Molecule &m, bool doDetectBonds = true); // without doDetectBonds the bonds of m are copied, with it only the bonds of the added atoms are detected
   void add(const Molecule &m, const Vec3 &shft, const Vec3 &rot, bool doDetectBonds = true); // shift and rotation (normalized)
   unsigned getNumAtoms() const {return atoms.size();}
   Atom* getAtom(unsigned idx) const {return atoms[idx];}
   void applyMatrix(const Mat3 &m) {
-    for (auto a : atoms)
-      a->applyMatrix(m);
+    for (auto &p : positions())
+      p = m*p;
   }
   unsigned numChains() const {return nChains;}
   unsigned numGroups() const {return nGroups;}
   std::vector<std::vector<Atom*>> findComponents() const;
   std::vector<Vec3> computeConvexHullFacets(std::vector<double> *withFurthestdist) const; // in molecule-qhull.cpp
+  std::vector<unsigned> findConvexHullVertices() const; // in molecule-qhull.cpp: sorted atom indexes, all atoms when there are less than 4
+  std::array<unsigned,2> findFurthestAtoms() const; // in molecule-qhull.cpp: the pair at the maximum distance
+  Float diameter() const; // in molecule-qhull.cpp: the maximum distance between atoms
+  Float minWidth() const; // in molecule-qhull.cpp: the minimum distance between two parallel planes enclosing all atoms, across the hull facets and the pairs of hull edges
+  OrientedBox orientedBoundingBox() const; // in molecule-qhull.cpp: the smallest box with a face on a hull facet and an edge along a facet edge
   Atom* findFirst(Element elt) {
     for (auto a : atoms)
       if (a->elt == elt)
@@ -381,52 +458,78 @@ public:
   void setAminoAcidSingleJunctionAngles(const std::vector<AaBackbone> &aaBackbones, unsigned idx, const std::vector<Angle> &newAngles);
   void setAminoAcidSequenceAngles(const std::vector<AaBackbone> &aaBackbones, const std::vector<unsigned> &idxs, const std::vector<std::vector<Angle>> &newAngles);
   void detectBonds();
+  void updateBonds(const std::vector<Atom*> &touched); // re-detects only the bonds of the atoms that were added or moved
+  const BondGraph& getBondGraph() const; // not thread-safe when it has to be rebuilt
+  void invalidateBondGraph() {bondGraphValid = false;}
+  Float maxBondDistance() const; // the longest possible bond between the elements present
+  std::vector<Vec3> getAtomPositions() const;
+  // bulk access: per-atom fields in the order of atoms
+  void setCoords(const std::vector<double> &newCoords); // x,y,z triplets, bonds aren't re-detected
+  void setElements(const std::vector<uint8_t> &newElements); // bonds aren't re-detected
+  std::vector<unsigned> getChains() const;
+  std::vector<unsigned> getGroups() const;
+  void setChains(const std::vector<unsigned> &newChains); // also sets nChains
+  void setGroups(const std::vector<unsigned> &newGroups); // also sets nGroups
+  std::vector<unsigned> getBondPairs() const; // i,j index pairs with i<j, flattened
+  NeighborGrid* buildNeighborGrid(Float cellSize) const;
+  // periodicity: with the lattice, bonds, clashes, contacts and descriptors of the molecule use the periodic images of its atoms
+  const Lattice* getLattice() const {return lattice.get();}
+  void setLattice(const std::array<Vec3,3> &vecs); // bonds aren't re-detected
+  void clearLattice();
+  bool isPeriodic() const {return (bool)lattice;}
+  Float distance(unsigned i1, unsigned i2) const; // the minimum-image distance when periodic
+  void wrapAtoms(); // moves every atom into the cell by the lattice vectors
+  Molecule* supercell(const std::array<unsigned,3> &n) const; // n[0]*n[1]*n[2] copies of the cell in the order of cells then atoms, bonds aren't detected
+  // clashes and contacts, pairs are flattened i,j index pairs sorted by i then j
+  bool hasClash(Float minDist) const; // whether two atoms are closer than minDist, stops at the first such pair, an atom and its own periodic image also clash
+  bool hasClash(const Molecule &other, Float minDist) const; // ... an atom of this molecule and an atom of other, not periodic
+  std::vector<unsigned> findContacts(Float cutoff) const; // pairs within cutoff with i<j
+  std::vector<unsigned> findContacts(const Molecule &other, Float cutoff) const; // i in this molecule, j in other, not periodic
   bool isEqual(const Molecule &other) const; // compares if the data is exactly the same (including the order of atoms)
-  static std::set<Atom*> listNeighborsHierarchically(Atom *self, bool includeSelf, const Atom *except1, const Atom *except2);
+  static std::vector<Atom*> listNeighborsHierarchically(Atom *self, bool includeSelf, const Atom *except1, const Atom *except2); // in the order of atoms
   // high-level append
   void appendAsAminoAcidChain(Molecule &aa, const std::vector<Angle> &angles); // ASSUME that aa is an amino acid XXX alters aa
+  static void placeAminoAcid(const AaBackbone &cterm, Molecule &aa, const AaBackbone &aaNterm, const AaBackbone &aaCterm, const std::vector<Angle> &angles); // moves aa so that its N replaces O1 of cterm, and applies the angles
   static std::vector<std::array<Angle,AaAngles::CNT>> readAminoAcidAnglesFromAaChain(const std::vector<AaBackbone> &aaBackbones);
   static void setAminoAcidAnglesInAaChain(const std::vector<AaBackbone> &aaBackbones, const std::vector<unsigned> &indices, const std::vector<std::vector<Angle>> &angles);
   // remove
   void removeAtBegin(Atom *a) {
-    for (auto i = atoms.begin(), ie = atoms.end(); i != ie; i++)
-      if ((*i) == a) {
-        while (!a->bonds.empty())
-          a->unlink(a->bonds[0]);
-        atoms.erase(i);
-        delete a;
-        return;
-      }
-    unreachable();
+    assert(a->molecule == this);
+    remove(a);
   }
   void removeAtEnd(Atom *a) {
-    auto idx = atoms.size();
-    for (auto i = atoms.rbegin(), ie = atoms.rend(); i != ie; i++, idx--)
-      if ((*i) == a) {
-        while (!a->bonds.empty())
-          a->unlink(a->bonds[0]);
-        atoms.erase(atoms.begin() + (idx-1));
-        delete a;
-        return;
-      }
-    unreachable();
+    assert(a->molecule == this);
+    remove(a);
+  }
+  void remove(Atom *a); // atoms are found by their index, so it doesn't matter where they are
+  void reserve(unsigned n);
+  // coordinates: contiguous views of the coords array
+  std_ext::array_range<Vec3> positions() {
+    auto b = reinterpret_cast<Vec3*>(coords.data());
+    return std_ext::array_range<Vec3>(b, b + atoms.size());
+  }
+  std_ext::array_range<const Vec3> positions() const {
+    auto b = reinterpret_cast<const Vec3*>(coords.data());
+    return std_ext::array_range<const Vec3>(b, b + atoms.size());
   }
   void centerAt(const Vec3 pt) { // no reference (!)
-    for (auto a : atoms)
-      a->centerAt(pt);
+    for (auto &p : positions())
+      p -= pt;
   }
   void scale(double coef) { // no reference (!)
-    for (auto a : atoms)
-      a->scale(coef);
+    for (auto &p : positions())
+      p *= coef;
   }
   std::string toString() const;
   // read external formats
   static Molecule* readXyzFileOne(const std::string &fname); // expects one xyz record
   static std::vector<Molecule*> readXyzFileMany(const std::string &fname); // expects 1+ xyz records
+  static Molecule* createFromXyzFrame(const XyzFrame &frame, bool doDetectBonds = true); // see XyzFrameReader
   static std::vector<Molecule*> readPdbFile(const std::string &newFname); // using dsrpdb
   static std::vector<Molecule*> readPdbBuffer(const std::string &pdbBuffer); // using our parser
-  static std::vector<Molecule*> readMmtfFile(const std::string &fname);
-  static std::vector<Molecule*> readMmtfBuffer(const std::vector<uint8_t> *buffer);
+  static std::vector<Molecule*> readPdbBuffer(const std::vector<uint8_t> *buffer); // using our parser, all MODELs
+  static std::vector<Molecule*> readMmtfFile(const std::string &fname, unsigned nthreads = 1, bool withBonds = false); // nthreads=0: all CPUs, models are built concurrently
+  static std::vector<Molecule*> readMmtfBuffer(const std::vector<uint8_t> *buffer, unsigned nthreads = 1, bool withBonds = false); // withBonds: from the file's bond lists, or detected when there are none
 #if defined(USE_OPENBABEL)
   static Molecule* createFromSMILES(const std::string &smiles, const std::string &opt);
 #endif
@@ -440,6 +543,8 @@ public:
   bool findAaBackbone(Atom *O2anchor, AaBackbone &aaBackbone, Fn &&errFn);
   bool findAaBackbone(Atom *O2anchor, AaBackbone &aaBackbone);
 private: // internals
+  Atom* attach(Atom *a); // takes ownership: appends a to atoms and its position to coords
+  void copyBonds(const Molecule &m, unsigned offset);
   static Vec3 getAtomAxis(const Atom *atom1, const Atom *atom2);
   static void rotateAtom(AaAngles::Type atype, const Vec3 &center, const Vec3 &axis, double angleD, Atom *a);
   template<typename Atoms>
@@ -450,3 +555,18 @@ private: // internals
   friend std::istream& operator>>(std::istream &is, Molecule &m); // Xyz reader
 }; // Molecule
 
+static_assert(sizeof(Vec3) == 3*sizeof(double), "Vec3 has to be castable to the coords array");
+
+inline Vec3& Atom::pos() {
+  return molecule ? reinterpret_cast<Vec3*>(molecule->coords.data())[index] : detachedPos;
+}
+
+inline const Vec3& Atom::pos() const {
+  return molecule ? reinterpret_cast<const Vec3*>(molecule->coords.data())[index] : detachedPos;
+}
+
+inline void Atom::bondsChanged() {
+  if (molecule)
+    molecule->invalidateBondGraph();
+}
+
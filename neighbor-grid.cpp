@@ -0,0 +1,80 @@
+#include "neighbor-grid.h"
+#include "xerror.h"
+
+NeighborGrid::NeighborGrid(const std::vector<Vec3> &newPts, Float newCellSize)
+: cellSize(newCellSize),
+  lo(0,0,0),
+  dims({{1,1,1}}),
+  pts(newPts)
+{
+  if (!(cellSize > 0))
+    ERROR("NeighborGrid: cell size should be positive, got " << cellSize)
+
+  // bounding box
+  Vec3 hi(0,0,0);
+  if (!pts.empty()) {
+    lo = hi = pts[0];
+    for (auto &p : pts)
+      for (unsigned d = 0; d < 3; d++) {
+        lo[d] = std::min(lo[d], p[d]);
+        hi[d] = std::max(hi[d], p[d]);
+      }
+  }
+
+  // dimensions: grow cells when the points are too sparse to keep the memory use proportional to the number of points
+  auto computeDims = [this,&hi]() {
+    double n = 1;
+    for (unsigned d = 0; d < 3; d++)
+      n *= (hi[d] - lo[d])/cellSize + 1;
+    return n;
+  };
+  auto maxCells = std::max<double>(64, 8*pts.size());
+  for (double n; (n = computeDims()) > maxCells;)
+    cellSize *= std::cbrt(n/maxCells)*1.01;
+  if (!std::isfinite(computeDims()))
+    ERROR("NeighborGrid: points have non-finite coordinates")
+  for (unsigned d = 0; d < 3; d++)
+    dims[d] = unsigned((hi[d] - lo[d])/cellSize) + 1;
+
+  // counting sort of points into cells
+  cellStart.resize(numCells() + 1, 0);
+  std::vector<unsigned> ptCell(pts.size());
+  for (unsigned i = 0, ie = pts.size(); i < ie; i++) {
+    ptCell[i] = cellIndex(cellCoord(pts[i][0], 0), cellCoord(pts[i][1], 1), cellCoord(pts[i][2], 2));
+    cellStart[ptCell[i] + 1]++;
+  }
+  for (unsigned c = 0, ce = numCells(); c < ce; c++)
+    cellStart[c + 1] += cellStart[c];
+  cellPts.resize(pts.size());
+  {
+    auto fill = cellStart;
+    for (unsigned i = 0, ie = pts.size(); i < ie; i++)
+      cellPts[fill[ptCell[i]]++] = i;
+  }
+}
+
+std::vector<unsigned> NeighborGrid::findWithin(const Vec3 &pt, Float radius) const {
+  std::vector<unsigned> res;
+  forEachWithin(pt, radius, [&res](unsigned idx, Float dist2) {
+    res.push_back(idx);
+  });
+  std::sort(res.begin(), res.end());
+  return res;
+}
+
+std::vector<std::array<unsigned,2>> NeighborGrid::findPairsWithin(Float radius) const {
+  std::vector<std::array<unsigned,2>> res;
+  forEachPairWithin(radius, [&res](unsigned idx1, unsigned idx2, Float dist2) {
+    res.push_back({{idx1, idx2}});
+  });
+  std::sort(res.begin(), res.end());
+  return res;
+}
+
+bool NeighborGrid::hasPairCloser(Float dist) const {
+  auto dist2max = dist*dist;
+  for (unsigned idx1 = 0, ie = pts.size(); idx1 < ie; idx1++)
+    if (anyWithin(pts[idx1], dist, [idx1,dist2max](unsigned idx2, Float dist2) {return idx1 < idx2 && dist2 < dist2max;}))
+      return true;
+  return false;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Vec3.h"
+
+#include <vector>
+#include <array>
+#include <cmath>
+#include <algorithm>
+
+//
+// NeighborGrid: uniform grid of cells (cell list) over a set of points for the fixed-radius neighbor searches
+//               the points are kept in the cell-sorted (CSR) form: cellStart[c]..cellStart[c+1] is the range of cell c in cellPts
+//
+
+class NeighborGrid {
+  Float                  cellSize;
+  Vec3                   lo;        // lower corner of the bounding box
+  std::array<unsigned,3> dims;      // number of cells in each direction
+  std::vector<Vec3>      pts;       // points in their original order
+  std::vector<unsigned>  cellStart; // numCells()+1 entries
+  std::vector<unsigned>  cellPts;   // point indexes sorted by cell
+public: // constr/iface
+  NeighborGrid(const std::vector<Vec3> &newPts, Float newCellSize);
+  Float getCellSize() const {return cellSize;}
+  unsigned numPoints() const {return pts.size();}
+  unsigned numCells() const {return dims[0]*dims[1]*dims[2];}
+  const Vec3& getPoint(unsigned idx) const {return pts[idx];}
+  template<typename Pred>
+  bool anyWithin(const Vec3 &pt, Float radius, Pred &&pred) const { // pred(idx, dist2) for the points with dist<=radius until it returns true
+    std::array<unsigned,3> cLo, cHi;
+    for (unsigned d = 0; d < 3; d++) {
+      cLo[d] = cellCoord(pt[d] - radius, d);
+      cHi[d] = cellCoord(pt[d] + radius, d);
+    }
+    auto radius2 = radius*radius;
+    for (unsigned iz = cLo[2]; iz <= cHi[2]; iz++)
+      for (unsigned iy = cLo[1]; iy <= cHi[1]; iy++)
+        for (unsigned c = cellIndex(cLo[0], iy, iz), ce = cellIndex(cHi[0], iy, iz); c <= ce; c++)
+          for (unsigned i = cellStart[c], ie = cellStart[c+1]; i < ie; i++) {
+            auto idx = cellPts[i];
+            auto dist2 = (pts[idx] - pt).len2();
+            if (dist2 <= radius2 && pred(idx, dist2))
+              return true;
+          }
+    return false;
+  }
+  template<typename Fn>
+  void forEachWithin(const Vec3 &pt, Float radius, Fn &&fn) const { // fn(idx, dist2) for each point with dist<=radius, in no particular order
+    anyWithin(pt, radius, [&fn](unsigned idx, Float dist2) {
+      fn(idx, dist2);
+      return false;
+    });
+  }
+  template<typename Fn>
+  void forEachPairWithin(Float radius, Fn &&fn) const { // fn(idx1, idx2, dist2) for each pair with idx1<idx2 and dist<=radius
+    for (unsigned idx1 = 0, ie = pts.size(); idx1 < ie; idx1++)
+      forEachWithin(pts[idx1], radius, [idx1,&fn](unsigned idx2, Float dist2) {
+        if (idx1 < idx2)
+          fn(idx1, idx2, dist2);
+      });
+  }
+  std::vector<unsigned> findWithin(const Vec3 &pt, Float radius) const; // sorted indexes
+  std::vector<std::array<unsigned,2>> findPairsWithin(Float radius) const; // sorted pairs
+  bool hasPairCloser(Float dist) const; // stops at the first pair with dist2<dist^2
+private: // internals
+  unsigned cellCoord(Float c, unsigned d) const { // clamped to the grid
+    auto i = std::floor((c - lo[d])/cellSize);
+    return !(i > 0) ? 0 : i >= dims[d]-1 ? dims[d]-1 : unsigned(i);
+  }
+  unsigned cellIndex(unsigned ix, unsigned iy, unsigned iz) const {return (iz*dims[1] + iy)*dims[0] + ix;}
+}; // NeighborGrid
@@ -1,9 +1,13 @@
 #include "op-rmsd.h"
 #include "molecule.h"
+#include "xerror.h"
+#include "thread-pool.h"
 
 #include "contrib/rmsd/rmsd++/kabsch.h"
 
 #include <valarray>
+#include <vector>
+#include <cmath>
 
 namespace Op {
 
@@ -32,4 +36,119 @@ double rmsd(std::valarray<double> &v1, std::valarray<double> &v2) {
   return kabsch::kabsch_rmsd(v1, v2, nPts);
 }
 
+/// QCP: Theobald (2005), Liu, Agrafiotis & Theobald (2010)
+
+double rmsdQcp(const double *c1, double g1, const double *c2, double g2, unsigned nPts) {
+  if (nPts == 0)
+    return 0;
+
+  // inner product matrix
+  double Sxx = 0, Sxy = 0, Sxz = 0, Syx = 0, Syy = 0, Syz = 0, Szx = 0, Szy = 0, Szz = 0;
+  for (unsigned p = 0; p < nPts; p++, c1 += 3, c2 += 3) {
+    Sxx += c1[0]*c2[0]; Sxy += c1[0]*c2[1]; Sxz += c1[0]*c2[2];
+    Syx += c1[1]*c2[0]; Syy += c1[1]*c2[1]; Syz += c1[1]*c2[2];
+    Szx += c1[2]*c2[0]; Szy += c1[2]*c2[1]; Szz += c1[2]*c2[2];
+  }
+
+  // coefficients of the characteristic polynomial of the key matrix: x^4 + C2*x^2 + C1*x + C0
+  double Sxx2 = Sxx*Sxx, Syy2 = Syy*Syy, Szz2 = Szz*Szz;
+  double Sxy2 = Sxy*Sxy, Syz2 = Syz*Syz, Sxz2 = Sxz*Sxz;
+  double Syx2 = Syx*Syx, Szy2 = Szy*Szy, Szx2 = Szx*Szx;
+
+  double SyzSzymSyySzz2 = 2*(Syz*Szy - Syy*Szz);
+  double Sxx2Syy2Szz2Syz2Szy2 = Syy2 + Szz2 - Sxx2 + Syz2 + Szy2;
+
+  double C2 = -2*(Sxx2 + Syy2 + Szz2 + Sxy2 + Syx2 + Sxz2 + Szx2 + Syz2 + Szy2);
+  double C1 = 8*(Sxx*Syz*Szy + Syy*Szx*Sxz + Szz*Sxy*Syx - Sxx*Syy*Szz - Syz*Szx*Sxy - Szy*Syx*Sxz);
+
+  double SxzpSzx = Sxz + Szx, SyzpSzy = Syz + Szy, SxypSyx = Sxy + Syx;
+  double SyzmSzy = Syz - Szy, SxzmSzx = Sxz - Szx, SxymSyx = Sxy - Syx;
+  double SxxpSyy = Sxx + Syy, SxxmSyy = Sxx - Syy;
+  double Sxy2Sxz2Syx2Szx2 = Sxy2 + Sxz2 - Syx2 - Szx2;
+
+  double C0 = Sxy2Sxz2Syx2Szx2*Sxy2Sxz2Syx2Szx2
+            + (Sxx2Syy2Szz2Syz2Szy2 + SyzSzymSyySzz2)*(Sxx2Syy2Szz2Syz2Szy2 - SyzSzymSyySzz2)
+            + (-SxzpSzx*SyzmSzy + SxymSyx*(SxxmSyy - Szz))*(-SxzmSzx*SyzpSzy + SxymSyx*(SxxmSyy + Szz))
+            + (-SxzpSzx*SyzpSzy - SxypSyx*(SxxpSyy - Szz))*(-SxzmSzx*SyzmSzy - SxypSyx*(SxxpSyy + Szz))
+            + ( SxypSyx*SyzpSzy + SxzpSzx*(SxxmSyy + Szz))*(-SxymSyx*SyzmSzy + SxzpSzx*(SxxpSyy + Szz))
+            + ( SxypSyx*SyzmSzy + SxzmSzx*(SxxmSyy - Szz))*(-SxymSyx*SyzpSzy + SxzmSzx*(SxxpSyy - Szz));
+
+  // the largest eigenvalue with Newton's method starting from its upper bound E0
+  double E0 = (g1 + g2)/2;
+  double lambda = E0;
+  for (unsigned i = 0; i < 50; i++) {
+    double prev = lambda;
+    double x2 = lambda*lambda;
+    double b = (x2 + C2)*lambda;
+    double a = b + C1;
+    lambda -= (a*lambda + C0)/(2*x2*lambda + b + a);
+    if (std::fabs(lambda - prev) < std::fabs(1e-11*lambda))
+      break;
+  }
+
+  return std::sqrt(std::fabs(2*(E0 - lambda)/nPts));
+}
+
+/// batched RMSD
+
+namespace {
+
+class CenteredCoords { // coordinates of all molecules in one contiguous buffer, each one centered at its centroid
+  unsigned            nPts;
+  std::vector<double> coords; // nPts*3 per molecule
+  std::vector<double> g;      // sum of the squared coordinates per molecule
+public:
+  CenteredCoords(const std::vector<const Molecule*> &mols, unsigned newNPts) : nPts(newNPts) {
+    coords.resize(mols.size()*3*nPts);
+    g.resize(mols.size());
+    for (unsigned m = 0, me = mols.size(); m < me; m++) {
+      if (mols[m]->numAtoms() != nPts)
+        ERROR("rmsd: molecules have different numbers of atoms: " << mols[m]->numAtoms() << " and " << nPts)
+      auto &src = mols[m]->coords;
+      auto dst = &coords[m*3*nPts];
+      double ctr[3] = {0, 0, 0};
+      for (unsigned i = 0; i < 3*nPts; i++)
+        ctr[i%3] += src[i];
+      for (unsigned d = 0; d < 3; d++)
+        ctr[d] /= nPts;
+      double gm = 0;
+      for (unsigned i = 0; i < 3*nPts; i++) {
+        dst[i] = src[i] - ctr[i%3];
+        gm += dst[i]*dst[i];
+      }
+      g[m] = gm;
+    }
+  }
+  double rmsd(unsigned m1, const CenteredCoords &other, unsigned m2) const {
+    return rmsdQcp(&coords[m1*3*nPts], g[m1], &other.coords[m2*3*nPts], other.g[m2], nPts);
+  }
+}; // CenteredCoords
+
+}
+
+LAMatrixD* rmsdMatrix(const std::vector<const Molecule*> &mols, unsigned nthreads) {
+  unsigned n = mols.size();
+  std::unique_ptr<LAMatrixD> res(new LAMatrixD(n, n));
+  if (n == 0)
+    return res.release();
+  CenteredCoords cc(mols, mols[0]->numAtoms());
+  // rows of the upper triangle, mirrored
+  ThreadPool::get().parallelFor(n, nthreads, [n,&cc,&res](unsigned i) {
+    (*res)(i, i) = 0;
+    for (unsigned j = i + 1; j < n; j++)
+      (*res)(i, j) = (*res)(j, i) = cc.rmsd(i, cc, j);
+  });
+  return res.release();
+}
+
+LAVectorD* rmsdOneToMany(const Molecule *m, const std::vector<const Molecule*> &mols, unsigned nthreads) {
+  std::unique_ptr<LAVectorD> res(new LAVectorD(mols.size()));
+  CenteredCoords cc1({m}, m->numAtoms());
+  CenteredCoords cc(mols, m->numAtoms());
+  ThreadPool::get().parallelFor(mols.size(), nthreads, [&cc1,&cc,&res](unsigned i) {
+    (*res)(i) = cc1.rmsd(0, cc, i);
+  });
+  return res.release();
+}
+
 } // Op
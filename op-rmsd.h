@@ -1,10 +1,23 @@
 #pragma once
 
+#include "mytypes.h"
+
 #include <valarray>
+#include <vector>
+
+class Molecule;
 
 namespace Op {
 
 // rmsd vector function: it alters the arguments for the sake of efficiency
 double rmsd(std::valarray<double> &v1, std::valarray<double> &v2);
 
+// QCP (quaternion characteristic polynomial) superposition RMSD of two centered sets of nPts x,y,z triplets,
+// g1 and g2 are the sums of the squared coordinates of each set
+double rmsdQcp(const double *c1, double g1, const double *c2, double g2, unsigned nPts);
+
+// RMSDs after the optimal superposition, molecules should have the same atoms in the same order, nthreads=0 uses all CPUs
+LAMatrixD* rmsdMatrix(const std::vector<const Molecule*> &mols, unsigned nthreads);
+LAVectorD* rmsdOneToMany(const Molecule *m, const std::vector<const Molecule*> &mols, unsigned nthreads);
+
 }; // Op
@@ -0,0 +1,119 @@
+#include "op-symmetry-functions.h"
+#include "neighbor-grid.h"
+#include "lattice.h"
+#include "xerror.h"
+
+#include <cmath>
+#include <memory>
+#include <algorithm>
+
+namespace Op {
+
+static double powi(double x, unsigned n) {
+  double r = 1;
+  for (; n; n >>= 1, x *= x)
+    if (n & 1)
+      r *= x;
+  return r;
+}
+
+LAMatrixD* computeSymmetryFunctions(const std::vector<double> &coords, const SymmetryFunctionParams &params, const Lattice *lattice) {
+  if (coords.size() % 3 != 0)
+    ERROR("computeSymmetryFunctions: coordinates size=" << coords.size() << " isn't a multiple of 3")
+  if (!(params.cutoff > 0))
+    ERROR("computeSymmetryFunctions: cutoff should be positive, got " << params.cutoff)
+
+  unsigned nAtoms = coords.size()/3;
+  unsigned nRadial = params.radial.size(), nAngular = params.angular.size();
+  auto Rc = params.cutoff;
+  auto fc = [Rc](double r) {return r < Rc ? 0.5*(std::cos(M_PI*r/Rc) + 1) : 0;};
+
+  // angular parameter sets share a few distinct etas and (zeta,lambda) pairs, the exponents and the powers are computed once per triple for these
+  std::vector<double> etas;
+  std::vector<std::array<double,2>> zls;
+  std::vector<unsigned> angEta(nAngular), angZl(nAngular);
+  std::vector<double> angNorm(nAngular);
+  for (unsigned p = 0; p < nAngular; p++) {
+    auto &a = params.angular[p];
+    if (a[0] < 0 || a[0] != std::floor(a[0]))
+      ERROR("computeSymmetryFunctions: zeta should be a non-negative integer, got " << a[0])
+    auto findOrAdd = [](auto &v, const auto &x) {
+      auto i = std::find(v.begin(), v.end(), x);
+      if (i == v.end())
+        i = v.insert(v.end(), x);
+      return unsigned(i - v.begin());
+    };
+    angEta[p] = findOrAdd(etas, a[2]);
+    angZl[p] = findOrAdd(zls, std::array<double,2>{{a[0], a[1]}});
+    angNorm[p] = std::pow(2., 1 - a[0]);
+  }
+
+  // neighbor lists within the cutoff, with the vectors to the neighbors, the distances and the cutoff values computed once
+  std::vector<Vec3> pts(nAtoms);
+  for (unsigned a = 0; a < nAtoms; a++)
+    pts[a] = Vec3(coords[3*a], coords[3*a + 1], coords[3*a + 2]);
+  struct Nbr {
+    Vec3     v;
+    double   r;
+    double   fc;
+  };
+  std::vector<std::vector<Nbr>> nbrs(nAtoms);
+  auto addPair = [&](unsigned a, unsigned b, const Vec3 &v, double dist2) {
+    auto r = std::sqrt(dist2);
+    if (r >= Rc || r == 0)
+      return;
+    auto f = fc(r);
+    nbrs[a].push_back({v, r, f});
+    nbrs[b].push_back({-v, r, f});
+  };
+  if (lattice)
+    lattice->forEachPairWithin(pts, Rc, addPair);
+  else if (nAtoms > 0) {
+    NeighborGrid grid(pts, Rc);
+    grid.forEachPairWithin(Rc, [&](unsigned a, unsigned b, double dist2) {
+      addPair(a, b, pts[b] - pts[a], dist2);
+    });
+  }
+
+  std::unique_ptr<LAMatrixD> res(new LAMatrixD(nRadial + nAngular, nAtoms));
+  res->setZero();
+  std::vector<double> expEta(etas.size()), powZl(zls.size());
+  for (unsigned a = 0; a < nAtoms; a++) {
+    auto col = res->col(a);
+    auto &na = nbrs[a];
+    // radial
+    for (auto &b : na)
+      for (unsigned p = 0; p < nRadial; p++) {
+        auto d = b.r - params.radial[p][1];
+        col(p) += std::exp(-params.radial[p][0]*d*d)*b.fc;
+      }
+    // angular: pairs of neighbors, the third side should also be within the cutoff
+    if (nAngular == 0)
+      continue;
+    for (unsigned ib = 0, ie = na.size(); ib < ie; ib++) {
+      auto &b = na[ib];
+      for (unsigned ig = ib + 1; ig < ie; ig++) {
+        auto &g = na[ig];
+        auto rbg2 = (g.v - b.v).len2();
+        auto rbg = std::sqrt(rbg2);
+        if (rbg >= Rc)
+          continue;
+        auto fcs = b.fc*g.fc*fc(rbg);
+        auto cosTheta = (b.v*g.v)/(b.r*g.r);
+        auto sumR2 = b.r*b.r + g.r*g.r + rbg2;
+        for (unsigned e = 0, ee = etas.size(); e < ee; e++)
+          expEta[e] = std::exp(-etas[e]*sumR2)*fcs;
+        for (unsigned z = 0, ze = zls.size(); z < ze; z++)
+          powZl[z] = powi(1 + zls[z][1]*cosTheta, unsigned(zls[z][0]));
+        for (unsigned p = 0; p < nAngular; p++)
+          col(nRadial + p) += powZl[angZl[p]]*expEta[angEta[p]];
+      }
+    }
+    for (unsigned p = 0; p < nAngular; p++)
+      col(nRadial + p) *= angNorm[p];
+  }
+
+  return res.release();
+}
+
+}; // Op
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "mytypes.h"
+
+#include <vector>
+#include <array>
+
+class Lattice;
+
+namespace Op {
+
+//
+// Behler-Parrinello atom-centered symmetry functions (descriptors of the atomic environments)
+//   radial:  G2_a = sum_b exp(-eta*(r_ab-Rs)^2)*fc(r_ab)
+//   angular: G4_a = 2^(1-zeta) sum_{b<g} (1+lambda*cos(theta_bag))^zeta * exp(-eta*(r_ab^2+r_ag^2+r_bg^2)) * fc(r_ab)*fc(r_ag)*fc(r_bg)
+//   with the cutoff function fc(r) = (cos(pi*r/Rc)+1)/2 for r<Rc
+//
+
+struct SymmetryFunctionParams {
+  double                             cutoff;  // Rc
+  std::vector<std::array<double,2>>  radial;  // {eta, Rs}
+  std::vector<std::array<double,3>>  angular; // {zeta, lambda, eta}
+}; // SymmetryFunctionParams
+
+// coords are x,y,z triplets, returns the matrix with one column per atom and one row per function, radial functions first
+// with the lattice the neighbors are the periodic images of the atoms
+LAMatrixD* computeSymmetryFunctions(const std::vector<double> &coords, const SymmetryFunctionParams &params, const Lattice *lattice = nullptr);
+
+}; // Op
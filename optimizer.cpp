@@ -0,0 +1,260 @@
+#include "optimizer.h"
+#include "Vec3-ext.h"
+#include "xerror.h"
+
+#include <cmath>
+#include <deque>
+#include <algorithm>
+
+/// internals
+
+namespace {
+
+double dot(const std::vector<double> &a, const std::vector<double> &b) {
+  double sum = 0;
+  for (size_t i = 0, ie = a.size(); i < ie; i++)
+    sum += a[i]*b[i];
+  return sum;
+}
+
+Float maxAtomNorm(const std::vector<double> &v) { // the largest length of the x,y,z triplets
+  Float max2 = 0;
+  for (size_t i = 0, ie = v.size(); i < ie; i += 3)
+    max2 = std::max(max2, v[i]*v[i] + v[i+1]*v[i+1] + v[i+2]*v[i+2]);
+  return std::sqrt(max2);
+}
+
+}
+
+class Optimizer::Problem { // the objective with the restraints added and the frozen atoms masked out
+  const Objective                      &objective;
+  const Params                         &params;
+  std::vector<bool>                     frozen;  // by coordinate
+  std::vector<Float>                    phi0;    // by frozen torsion
+public:
+  unsigned                              evaluations;
+  Problem(const Objective &newObjective, const Params &newParams, const std::vector<double> &x)
+  : objective(newObjective), params(newParams), frozen(x.size(), false), evaluations(0) {
+    auto numAtoms = x.size()/3;
+    for (auto a : params.frozenAtoms) {
+      if (a >= numAtoms)
+        ERROR("Optimizer: frozen atom index " << a << " is out of range, there are " << numAtoms << " atoms")
+      frozen[3*a] = frozen[3*a+1] = frozen[3*a+2] = true;
+    }
+    for (auto &t : params.frozenTorsions) {
+      for (auto a : t)
+        if (a >= numAtoms)
+          ERROR("Optimizer: frozen torsion atom index " << a << " is out of range, there are " << numAtoms << " atoms")
+      Float phi;
+      if (!Vec3Extra::dihedral(pos(x, t[0]), pos(x, t[1]), pos(x, t[2]), pos(x, t[3]), phi, nullptr))
+        ERROR("Optimizer: frozen torsion " << t[0] << "-" << t[1] << "-" << t[2] << "-" << t[3] << " is undefined, its atoms are collinear")
+      phi0.push_back(phi);
+    }
+  }
+  Float eval(const std::vector<double> &x, std::vector<double> &grad) {
+    evaluations++;
+    grad.assign(x.size(), 0);
+    auto E = objective(x, grad);
+    if (grad.size() != x.size())
+      ERROR("Optimizer: the gradient has " << grad.size() << " elements, expected " << x.size())
+    // torsion restraints
+    std::array<Vec3,4> dphi;
+    for (unsigned r = 0; r < phi0.size(); r++) {
+      auto &t = params.frozenTorsions[r];
+      Float phi;
+      if (!Vec3Extra::dihedral(pos(x, t[0]), pos(x, t[1]), pos(x, t[2]), pos(x, t[3]), phi, &dphi))
+        continue;
+      auto delta = std::remainder(phi - phi0[r], 2*M_PI);
+      E += params.torsionRestraint*delta*delta;
+      for (unsigned k = 0; k < 4; k++)
+        for (unsigned d = 0; d < 3; d++)
+          grad[3*t[k] + d] += 2*params.torsionRestraint*delta*dphi[k][d];
+    }
+    // frozen atoms
+    for (size_t i = 0, ie = grad.size(); i < ie; i++)
+      if (frozen[i])
+        grad[i] = 0;
+    return E;
+  }
+private:
+  static Vec3 pos(const std::vector<double> &x, unsigned a) {return Vec3(x[3*a], x[3*a+1], x[3*a+2]);}
+}; // Optimizer::Problem
+
+/// Optimizer
+
+Optimizer::Result Optimizer::minimize(std::vector<double> &x, const Objective &objective, const Params &params) {
+  if (x.size() % 3 != 0)
+    ERROR("Optimizer: coordinates array has " << x.size() << " elements, expected x,y,z triplets")
+  if (!(params.maxStep > 0))
+    ERROR("Optimizer: maxStep should be positive, got " << params.maxStep)
+  Problem problem(objective, params, x);
+  switch (params.method) {
+  case LBFGS:
+    return minimizeLbfgs(problem, x, params);
+  case FIRE:
+    return minimizeFire(problem, x, params);
+  }
+  ERROR("Optimizer: unknown method " << params.method)
+}
+
+Optimizer::Result Optimizer::minimizeLbfgs(Problem &problem, std::vector<double> &x, const Params &params) {
+  Result res{0, 0, 0, 0, false};
+  auto n = x.size();
+  std::vector<double> g, xNew(n), gNew, d(n);
+  struct Correction {
+    std::vector<double> s, y;
+    double              rho, alpha;
+  }; // Correction
+  std::deque<Correction> history;
+
+  auto f = problem.eval(x, g);
+  while (std::isfinite(f) && res.iterations < params.maxIterations) {
+    if (maxAtomNorm(g) <= params.gradTolerance) {
+      res.converged = true;
+      break;
+    }
+    res.iterations++;
+
+    // direction: the two-loop recursion
+    d = g;
+    for (auto c = history.rbegin(); c != history.rend(); c++) {
+      c->alpha = c->rho*dot(c->s, d);
+      for (size_t i = 0; i < n; i++)
+        d[i] -= c->alpha*c->y[i];
+    }
+    if (!history.empty()) {
+      auto &c = history.back();
+      auto gamma = dot(c.s, c.y)/dot(c.y, c.y);
+      for (auto &v : d)
+        v *= gamma;
+    }
+    for (auto &c : history) {
+      auto beta = c.rho*dot(c.y, d);
+      for (size_t i = 0; i < n; i++)
+        d[i] += c.s[i]*(c.alpha - beta);
+    }
+    for (auto &v : d)
+      v = -v;
+    if (dot(d, g) >= 0) { // not a descent direction: restart from the steepest descent
+      history.clear();
+      for (size_t i = 0; i < n; i++)
+        d[i] = -g[i];
+    }
+    auto dMax = maxAtomNorm(d);
+    if (dMax > params.maxStep)
+      for (auto &v : d)
+        v *= params.maxStep/dMax;
+
+    // backtracking line search with the Armijo condition
+    auto dg = dot(d, g);
+    double alpha = 1;
+    Float fNew = f;
+    bool accepted = false;
+    for (unsigned ls = 0; ls < 30 && !accepted; ls++, alpha /= 2) {
+      for (size_t i = 0; i < n; i++)
+        xNew[i] = x[i] + alpha*d[i];
+      fNew = problem.eval(xNew, gNew);
+      if (!std::isfinite(fNew))
+        break;
+      accepted = fNew <= f + 1e-4*alpha*dg;
+    }
+    if (!std::isfinite(fNew)) {
+      f = fNew;
+      break;
+    }
+    if (!accepted) {
+      if (history.empty())
+        break; // even the steepest descent doesn't decrease the energy
+      history.clear();
+      continue;
+    }
+
+    // update the corrections
+    Correction c{std::vector<double>(n), std::vector<double>(n), 0, 0};
+    for (size_t i = 0; i < n; i++) {
+      c.s[i] = xNew[i] - x[i];
+      c.y[i] = gNew[i] - g[i];
+    }
+    auto sy = dot(c.s, c.y);
+    if (sy > 1e-12) {
+      c.rho = 1/sy;
+      history.push_back(std::move(c));
+      if (history.size() > params.memory)
+        history.pop_front();
+    }
+
+    auto df = f - fNew;
+    std::copy(xNew.begin(), xNew.end(), x.begin()); // x can be shared with the molecule, its buffer stays
+    g.swap(gNew);
+    f = fNew;
+    if (params.energyTolerance > 0 && std::abs(df) < params.energyTolerance) {
+      res.converged = true;
+      break;
+    }
+  }
+
+  res.energy = f;
+  res.maxGrad = maxAtomNorm(g);
+  res.evaluations = problem.evaluations;
+  return res;
+}
+
+Optimizer::Result Optimizer::minimizeFire(Problem &problem, std::vector<double> &x, const Params &params) {
+  // parameters from Bitzek et al., Phys. Rev. Lett. 97, 170201 (2006)
+  const unsigned Nmin = 5;
+  const Float finc = 1.1, fdec = 0.5, alpha0 = 0.1, falpha = 0.99;
+
+  Result res{0, 0, 0, 0, false};
+  auto n = x.size();
+  std::vector<double> g, v(n, 0), dx(n);
+  Float dt = params.fireDt, alpha = alpha0;
+  unsigned numPositive = 0;
+
+  auto f = problem.eval(x, g);
+  while (std::isfinite(f) && res.iterations < params.maxIterations) {
+    auto gNorm = std::sqrt(dot(g, g));
+    if (maxAtomNorm(g) <= params.gradTolerance) {
+      res.converged = true;
+      break;
+    }
+    res.iterations++;
+
+    // mix the velocity towards the force while going downhill, stop when going uphill
+    if (-dot(g, v) > 0) {
+      auto vNorm = std::sqrt(dot(v, v));
+      for (size_t i = 0; i < n; i++)
+        v[i] = (1 - alpha)*v[i] - alpha*vNorm*g[i]/gNorm;
+      if (++numPositive > Nmin) {
+        dt = std::min(dt*finc, params.fireDtMax);
+        alpha *= falpha;
+      }
+    } else {
+      std::fill(v.begin(), v.end(), 0);
+      numPositive = 0;
+      dt *= fdec;
+      alpha = alpha0;
+    }
+
+    // semi-implicit Euler step with the unit masses
+    for (size_t i = 0; i < n; i++) {
+      v[i] -= dt*g[i];
+      dx[i] = dt*v[i];
+    }
+    auto dxMax = maxAtomNorm(dx);
+    for (size_t i = 0; i < n; i++)
+      x[i] += dxMax > params.maxStep ? dx[i]*params.maxStep/dxMax : dx[i];
+
+    auto fNew = problem.eval(x, g);
+    auto df = f - fNew;
+    f = fNew;
+    if (params.energyTolerance > 0 && std::abs(df) < params.energyTolerance) {
+      res.converged = true;
+      break;
+    }
+  }
+
+  res.energy = f;
+  res.maxGrad = maxAtomNorm(g);
+  res.evaluations = problem.evaluations;
+  return res;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Vec3.h"
+
+#include <vector>
+#include <array>
+#include <functional>
+
+//
+// Optimizer: local minimization of an energy over flat coordinate arrays (x,y,z for each atom, like Molecule::coords)
+//            L-BFGS with the backtracking line search, or FIRE (fast inertial relaxation engine) as the alternative.
+//            The energy and its gradient come from any provider: ForceField, a script callback, etc.
+//            Frozen atoms don't move, frozen torsions are held by the harmonic restraints at their initial values.
+//
+
+class Optimizer {
+public:
+  enum Method {LBFGS, FIRE};
+  typedef std::function<Float(const std::vector<double> &x, std::vector<double> &grad)> Objective; // returns the energy and fills grad, non-finite energy aborts
+  struct Params {
+    Method              method;
+    unsigned            maxIterations;
+    Float               gradTolerance;     // converged when the largest per-atom gradient is below it
+    Float               energyTolerance;   // ... or when the energy changes less than this, 0 disables it
+    Float               maxStep;           // the largest displacement of any atom in one iteration
+    unsigned            memory;            // L-BFGS: the number of the correction pairs kept
+    Float               fireDt;            // FIRE: the initial and the maximum time steps, the atoms have unit masses
+    Float               fireDtMax;
+    std::vector<unsigned> frozenAtoms;
+    std::vector<std::array<unsigned,4>> frozenTorsions;
+    Float               torsionRestraint;  // E = k*(phi-phi0)^2, phi in radians
+    Params() : method(LBFGS), maxIterations(1000), gradTolerance(1e-3), energyTolerance(0), maxStep(0.2), memory(8),
+               fireDt(0.02), fireDtMax(0.1), torsionRestraint(1000) { }
+  }; // Params
+  struct Result {
+    Float    energy;     // the final energy including the restraints
+    Float    maxGrad;    // the largest per-atom gradient
+    unsigned iterations;
+    unsigned evaluations;
+    bool     converged;
+  }; // Result
+public: // iface
+  static Result minimize(std::vector<double> &x, const Objective &objective, const Params &params); // x is updated to the minimum found
+private: // internals
+  class Problem;
+  static Result minimizeLbfgs(Problem &problem, std::vector<double> &x, const Params &params);
+  static Result minimizeFire(Problem &problem, std::vector<double> &x, const Params &params);
+}; // Optimizer
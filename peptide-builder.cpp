@@ -0,0 +1,97 @@
+#include "peptide-builder.h"
+#include "xerror.h"
+
+/// PeptideBuilder
+
+PeptideBuilder::PeptideBuilder() : numResidues(0) {
+}
+
+void PeptideBuilder::setResidue(char code, const Molecule &aa) {
+  if (code < 0)
+    ERROR("PeptideBuilder::setResidue: invalid amino acid code " << int(code))
+  auto &r = residues[code];
+  r.molecule.reset(new Molecule(aa));
+  r.nterm = r.molecule->findAaBackboneFirst();
+  r.cterm = r.molecule->findAaBackboneLast();
+  if (!r.nterm.isNterm() || !r.cterm.isCterm())
+    ERROR("PeptideBuilder::setResidue: the amino acid '" << code << "' needs to have both N-term and C-term free")
+}
+
+void PeptideBuilder::append(char code, const std::vector<Angle> &angles) {
+  auto &r = getResidue(code);
+
+  // the first residue begins the chain
+  if (!chain) {
+    chain.reset(new Molecule(*r.molecule));
+    cterm = mapBackbone(r.cterm, chain->atoms, 0);
+    numResidues = 1;
+    return;
+  }
+
+  Molecule::AaAngles::checkAngles(angles, "PeptideBuilder::append");
+
+  // copy the template and place it at the C-term of the chain
+  Molecule aa(*r.molecule);
+  auto aaNterm = mapBackbone(r.nterm, aa.atoms, 0);
+  auto aaCterm = mapBackbone(r.cterm, aa.atoms, 0);
+  Molecule::placeAminoAcid(cterm, aa, aaNterm, aaCterm, angles);
+
+  // remove atoms that are excluded by the connection: 1xO and 2xH atoms, same choice as in appendAsAminoAcidChain
+  auto aCoo = cterm.Coo;
+  chain->removeAtEnd(cterm.O1);
+  chain->removeAtEnd(cterm.Ho);
+  auto aHremoved = aaNterm.HCn1->elt == H ? aaNterm.HCn1 : aaNterm.Hn2;
+  if (aaCterm.HCn1 == aHremoved) { // the C-term backbone of a single residue is the N-term one, the remaining H becomes the inner one
+    aaCterm.HCn1 = aaCterm.Hn2;
+    aaCterm.Hn2 = nullptr;
+  } else if (aaCterm.Hn2 == aHremoved) {
+    aaCterm.Hn2 = nullptr;
+  }
+  aa.removeAtBegin(aHremoved);
+
+  // append aa: its bonds are copied, and the only new bond is the peptide bond
+  auto offset = chain->numAtoms();
+  if (chain->atoms.capacity() < offset + aa.numAtoms())
+    chain->reserve(2*(offset + aa.numAtoms()));
+  chain->add(aa, false/*doDetectBonds*/);
+  aCoo->link(chain->atoms[offset + aaNterm.N->index]);
+  cterm = mapBackbone(aaCterm, chain->atoms, offset);
+  numResidues++;
+}
+
+void PeptideBuilder::appendSequence(const std::string &codes, const std::vector<std::vector<Angle>> &angles) {
+  // angles are per junction: the first residue only has them when it is appended to an existing chain
+  unsigned numJunctions = codes.size() - (chain || codes.empty() ? 0 : 1);
+  if (!angles.empty() && angles.size() != numJunctions)
+    ERROR("PeptideBuilder::appendSequence: unmatching angles array provided, angles.size=" << angles.size() << ", expected " << numJunctions)
+  static const std::vector<Angle> noAngles;
+  unsigned junction = 0;
+  for (auto code : codes)
+    if (!chain)
+      append(code, noAngles);
+    else
+      append(code, angles.empty() ? noAngles : angles[junction++]);
+}
+
+Molecule* PeptideBuilder::takeMolecule() {
+  if (!chain)
+    ERROR("PeptideBuilder::takeMolecule: the chain is empty")
+  numResidues = 0;
+  return chain.release();
+}
+
+/// internals
+
+const PeptideBuilder::Residue& PeptideBuilder::getResidue(char code) const {
+  if (!hasResidue(code))
+    ERROR("PeptideBuilder: no amino acid template for the code '" << code << "'")
+  return residues[code];
+}
+
+Molecule::AaBackbone PeptideBuilder::mapBackbone(const AaBackbone &b, const std::vector<Atom*> &atoms, unsigned offset) {
+  // same atoms in a copy of the molecule: they are at the same indexes after offset
+  auto map = [&atoms,offset](Atom *a) {
+    return a ? atoms[offset + a->index] : nullptr;
+  };
+  return {map(b.N), map(b.HCn1), map(b.Hn2), map(b.Cmain), map(b.Hc), map(b.Coo), map(b.O2), map(b.O1), map(b.Ho), map(b.payload)};
+}
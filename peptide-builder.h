@@ -0,0 +1,40 @@
+#pragma once
+
+#include "molecule.h"
+
+#include <string>
+#include <vector>
+#include <array>
+#include <memory>
+
+//
+// PeptideBuilder: grows a peptide chain residue by residue from the amino acid templates,
+//                 the C-terminal backbone of the chain and the backbones of the templates are found once and kept,
+//                 so that every append only touches the atoms of the new residue and of the junction
+//
+
+class PeptideBuilder {
+  typedef Molecule::Angle Angle;
+  typedef Molecule::AaBackbone AaBackbone;
+  struct Residue {
+    std::unique_ptr<Molecule> molecule;
+    AaBackbone                nterm; // backbones in the template
+    AaBackbone                cterm;
+  }; // Residue
+  std::array<Residue,128>   residues; // templates by the one-letter code
+  std::unique_ptr<Molecule> chain;
+  AaBackbone                cterm;    // C-terminal backbone of the chain
+  unsigned                  numResidues;
+public: // constr/iface
+  PeptideBuilder();
+  void setResidue(char code, const Molecule &aa); // aa is an amino acid with both terms free
+  bool hasResidue(char code) const {return code >= 0 && residues[code].molecule;}
+  void append(char code, const std::vector<Angle> &angles); // angles at the new junction, like in Molecule::appendAsAminoAcidChain
+  void appendSequence(const std::string &codes, const std::vector<std::vector<Angle>> &angles); // angles are empty or one per junction
+  unsigned size() const {return numResidues;}
+  const Molecule* getMolecule() const {return chain.get();}
+  Molecule* takeMolecule(); // the builder begins a new chain
+private: // internals
+  const Residue& getResidue(char code) const;
+  static AaBackbone mapBackbone(const AaBackbone &b, const std::vector<Atom*> &atoms, unsigned offset);
+}; // PeptideBuilder
@@ -25,4 +25,5 @@ public: // iface
   static const PeriodicTableData& get() {return singleInstance;}
   const ElementData& operator()(unsigned elt) const;
   unsigned elementFromSymbol(const std::string &sym) const;
+  unsigned numElements() const {return data.size();}
 }; // PeriodicTableData
@@ -0,0 +1,78 @@
+// tests the traversals over the bond graph: it should follow the bond edits
+
+exports.run = function() {
+  var AminoAcids = require('amino-acids')
+  var m = Moleculex.fromXyzOne(AminoAcids.codeToFile("W"))
+
+  // reference traversals over Atom.getBonds, atoms are identified by their index
+  function indexOf(m) {
+    var idx = {}
+    m.getAtoms().forEach(function(a, i) {idx[a.id()] = i})
+    return idx
+  }
+  function reach(m, idx, from, seen) {
+    var found = [], todo = [from]
+    while (todo.length > 0)
+      m.getAtom(todo.pop()).getBonds().forEach(function(b) {
+        var i = idx[b.id()]
+        if (!seen[i]) {
+          seen[i] = true
+          found.push(i)
+          todo.push(i)
+        }
+      })
+    return found
+  }
+  function sortedIdxs(atoms, idx) {
+    return atoms.map(function(a) {return idx[a.id()]}).sort(function(a, b) {return a - b}).join(",")
+  }
+  function check(m) { // both traversals agree with the reference
+    var idx = indexOf(m)
+    var seen = [], components = []
+    for (var i = 0; i < m.numAtoms(); i++)
+      if (!seen[i]) {
+        seen[i] = true
+        components.push([i].concat(reach(m, idx, i, seen)).sort(function(a, b) {return a - b}).join(","))
+      }
+    var found = m.findComponents()
+    if (found.length != components.length)
+      return false
+    for (var c = 0; c < found.length; c++)
+      if (sortedIdxs(found[c], idx) != components[c])
+        return false
+    for (var i = 0; i < m.numAtoms(); i++) {
+      var bonds = m.getAtom(i).getBonds()
+      var except = bonds.length > 0 ? bonds[0] : undefined
+      var seenN = []
+      seenN[i] = true
+      if (except)
+        seenN[idx[except.id()]] = true
+      var expected = reach(m, idx, i, seenN).concat([i]).sort(function(a, b) {return a - b}).join(",")
+      if (sortedIdxs(Moleculex.listNeighborsHierarchically(m.getAtom(i), true, except, undefined), idx) != expected)
+        return false
+    }
+    return true
+  }
+
+  if (!check(m) || m.findComponents().length != 1)
+    return ["FAIL", "initial"]
+
+  // the side chain is split off by the removed bond and joined back
+  var cAlpha = m.getAtom(1), cBeta = m.getAtom(5)
+  if (!cAlpha.hasBond(cBeta))
+    return "FAIL"
+  cAlpha.unlink(cBeta)
+  if (!check(m) || m.findComponents().length != 2)
+    return ["FAIL", "after unlink"]
+  cAlpha.link(cBeta)
+  if (!check(m) || m.findComponents().length != 1)
+    return ["FAIL", "after link"]
+
+  // added atoms are separate components until they are bonded
+  m.addAtom(new Atom("H", [10, 10, 10]))
+  var h = m.getAtom(m.numAtoms() - 1)
+  if (!check(m) || m.findComponents().length != 2)
+    return ["FAIL", "after addAtom"]
+  h.link(m.getAtom(0))
+  return check(m) && m.findComponents().length == 1 ? "OK" : ["FAIL", "after the new bond"]
+}
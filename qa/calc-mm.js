@@ -0,0 +1,83 @@
+// tests the built-in molecular mechanics calculation engine
+
+exports.run = function() {
+  var Engine = require('calc-mm').create()
+  var SM = require('stock-molecules')
+
+  var m = SM.h2o_wiki()
+  m.detectBonds()
+  var ff = new ForceField(m)
+  if (ff.numBonds() != 2 || ff.numAngles() != 1 || ff.numTorsions() != 0)
+    return "FAIL"
+
+  // the energy through the engine is the same, and it agrees with the sum of its terms
+  var gradients = []
+  var energy = Engine.calcEnergy(m, undefined, gradients)
+  var terms = ff.calcEnergyTerms(m)
+  var eps = 0.000001
+  if (Math.abs(energy - ff.calcEnergy(m)) > eps || Math.abs(terms.total - (terms.bond + terms.angle + terms.torsion + terms.vdw + terms.coulomb)) > eps)
+    return "FAIL"
+  if (gradients.length != 3 || terms.coulomb != 0)
+    return "FAIL"
+
+  // gradients agree with the finite differences, and the forces sum to zero
+  var h = 0.000001
+  var a = m.getAtom(1)
+  var pos = a.getPos()
+  a.setPos(Vec3.plus(pos, [h, 0, 0]))
+  var ep = ff.calcEnergy(m)
+  a.setPos(Vec3.minus(pos, [h, 0, 0]))
+  var em = ff.calcEnergy(m)
+  a.setPos(pos)
+  if (Math.abs((ep - em)/(2*h) - gradients[1][0]) > 0.0001)
+    return "FAIL"
+  var sum = Vec3.plus(Vec3.plus(gradients[0], gradients[1]), gradients[2])
+  if (Vec3.length(sum) > eps)
+    return "FAIL"
+
+  // gauche butane has torsions: every gradient component agrees with the finite differences
+  var butane = new Molecule
+  var butaneAtoms = [
+    ["C", [0.0000, 0.0000, 0.0000]],
+    ["C", [1.5300, 0.0000, 0.0000]],
+    ["C", [2.0783, -1.4284, 0.0000]],
+    ["C", [1.7112, -2.1566, -1.2946]],
+    ["H", [-0.3728, -0.5121, 0.8870]],
+    ["H", [-0.3728, 1.0243, 0.0000]],
+    ["H", [-0.3728, -0.5121, -0.8870]],
+    ["H", [1.8839, 0.5160, 0.8925]],
+    ["H", [1.8839, 0.5160, -0.8925]],
+    ["H", [3.1640, -1.3917, 0.0898]],
+    ["H", [1.6536, -1.9715, 0.8442]],
+    ["H", [2.1286, -1.6274, -2.1512]],
+    ["H", [2.1093, -3.1712, -1.2773]],
+    ["H", [0.6275, -2.2036, -1.4014]]
+  ]
+  butaneAtoms.forEach(function(a) {butane.addAtom(new Atom(a[0], a[1]))})
+  butane.detectBonds()
+  var ffButane = new ForceField(butane)
+  if (ffButane.numTorsions() == 0 || ffButane.calcEnergyTerms(butane).torsion == 0)
+    return "FAIL"
+  var gradButane = []
+  Engine.calcEnergy(butane, undefined, gradButane)
+  for (var i = 0; i < butane.numAtoms(); i++)
+    for (var d = 0; d < 3; d++) {
+      var b = butane.getAtom(i)
+      var p = b.getPos(), dp = [0, 0, 0]
+      dp[d] = 0.00001
+      b.setPos(Vec3.plus(p, dp))
+      var bp = ffButane.calcEnergy(butane)
+      b.setPos(Vec3.minus(p, dp))
+      var bm = ffButane.calcEnergy(butane)
+      b.setPos(p)
+      if (Math.abs((bp - bm)/(2*dp[d]) - gradButane[i][d]) > 0.0001*(1 + Math.abs(gradButane[i][d])))
+        return ["FAIL", "butane atom#"+i+" gradient#"+d]
+    }
+
+  // charges add the Coulomb term between the non-bonded atoms
+  var ions = new Molecule
+  ions.addAtom(new Atom("Na", [0, 0, 0]))
+  ions.addAtom(new Atom("Cl", [5, 0, 0]))
+  var neutral = Engine.calcEnergy(ions)
+  return Math.abs(Engine.calcEnergy(ions, {charges: [1, -1]}) - neutral + 332.0637/5) < eps ? "OK" : "FAIL"
+}
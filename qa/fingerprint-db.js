@@ -0,0 +1,22 @@
+exports.run = function() {
+  var SM = require('stock-molecules')
+  function withBonds(m) {
+    m.detectBonds()
+    return m
+  }
+  var h2 = new Molecule
+  h2.addAtom(new Atom("H", [0,0,0]))
+  h2.addAtom(new Atom("H", [0.74,0,0]))
+
+  var fdb = new FingerprintDb
+  fdb.add(withBonds(SM.h2o_wiki()), "water")
+  fdb.add(withBonds(h2), "hydrogen")
+  fdb.add(withBonds(SM.h2o_dimer_2000()), "water-dimer")
+
+  // water dimer has the same neighborhoods as water, ties are ordered by the position in the db
+  var hits = fdb.search(withBonds(SM.h2o_wiki()), 2, 0)
+  if (fdb.size() != 3 || hits.length != 2 || hits[0][0] != "water" || hits[0][1] != 1 || hits[1][0] != "water-dimer" || hits[1][1] != 1)
+    return "FAIL"
+  var sim = FingerprintDb.tanimoto(withBonds(SM.h2o_wiki()), h2)
+  return sim < 1 && fdb.search(h2, 10, 1).length == 3 && fdb.search(h2, 10, 1)[0][0] == "hydrogen" ? "OK" : "FAIL"
+}
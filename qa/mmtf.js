@@ -1,11 +1,12 @@
-
 exports.run = function() {
   var Url = require('url')
 
   var pdbRecord = "4HHB"
-  var m = Mmtf.readBuffer(gunzip(downloadUrl(Url.pdb.getMmtfGzipped(pdbRecord))))
+  var buf = gunzip(downloadUrl(Url.pdb.getMmtfGzipped(pdbRecord)))
+  var m = Mmtf.readBuffer(buf)
+  var mp = Mmtf.readBufferParallel(buf, 0, true)
 
-  if (m[0].numAtoms() == 4779)
+  if (m[0].numAtoms() == 4779 && mp.length == m.length && mp[0].numAtoms() == 4779 && mp[0].getAtoms()[0].getNumBonds() > 0)
     return "OK"
   else
     return "FAIL"
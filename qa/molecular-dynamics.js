@@ -0,0 +1,37 @@
+// tests the native molecular dynamics and its binary trajectory
+
+exports.run = function() {
+  var SM = require('stock-molecules')
+  var fname = "/tmp/test-molecular-dynamics-tm"+Time.now()+".traj"
+
+  var m = SM.h2o_wiki()
+  m.detectBonds()
+  var ff = new ForceField(m)
+
+  // without the thermostat the total energy is conserved
+  var md = new MolecularDynamics(m, ff, {timeStep: 0.25, temperature: 300, thermostatTau: 0, trajectoryFile: fname, frameInterval: 10})
+  var s0 = md.run(m, 0)
+  if (Math.abs(s0.temperature - 300) > 0.001)
+    return "FAIL"
+  var s = md.run(m, 1000)
+  if (s.step != 1000 || Math.abs(s.time - 250) > 0.000001 || Math.abs(s.potential + s.kinetic - s0.potential - s0.kinetic) > 0.05)
+    return "FAIL"
+
+  // the last frame is the current geometry within the trajectory precision
+  var traj = new TrajectoryReader(fname)
+  if (traj.numAtoms() != 3 || traj.numFrames() != 100 || traj.readStep(99) != 1000 || traj.getElements().getByte(0) != 8)
+    return "FAIL"
+  var coords = traj.readFrame(99)
+  for (var i = 0; i < 9; i++)
+    if (Math.abs(coords.get(i) - m.getCoords().get(i)) > traj.getPrecision()/2 + 0.000001)
+      return "FAIL"
+  File.unlink(fname)
+
+  // velocities can be replaced, zero velocities at the minimum stay zero
+  var v = md.getVelocities()
+  if (v.size() != 9)
+    return "FAIL"
+  Optimizer.minimize(m, ff)
+  md.setVelocities([0,0,0, 0,0,0, 0,0,0])
+  return md.run(m, 100).kinetic < 0.001 ? "OK" : "FAIL"
+}
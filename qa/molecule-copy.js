@@ -0,0 +1,45 @@
+// tests the molecule copy: the bonds are copied by index, the copy is independent from the original
+
+function bondPairs(m) { // "i-j" strings, the lower index first
+  var b = m.getBondPairs(), res = []
+  for (var i = 0; i < b.size()/4; i += 2)
+    res.push(b.getUInt(4*i)+"-"+b.getUInt(4*(i+1)))
+  return res.join(",")
+}
+
+exports.run = function() {
+  var AminoAcids = require('amino-acids')
+  var m = Moleculex.fromXyzOne(AminoAcids.codeToFile("W"))
+  var numAtoms = m.numAtoms()
+
+  // the bond removed by hand stays removed in the copy: bonds aren't re-detected
+  var a0 = m.getAtom(0), removed = a0.getBonds()[0]
+  a0.unlink(removed)
+  var pairs = bondPairs(m)
+  var c = m.dupl()
+  if (c.numAtoms() != numAtoms || bondPairs(c) != pairs || c.getAtom(0).getNumBonds() != a0.getNumBonds())
+    return "FAIL"
+  for (var i = 0; i < numAtoms; i++)
+    if (c.getAtom(i).getElement() != m.getAtom(i).getElement() || !Vec3.almostEquals(c.getAtom(i).getPos(), m.getAtom(i).getPos(), 0))
+      return "FAIL"
+  var redetected = m.dupl()
+  redetected.detectBonds()
+  if (bondPairs(redetected) == pairs)
+    return "FAIL"
+
+  // adding and removing in the copy doesn't change the original
+  c.addAtom(new Atom("H", Vec3.plus(c.getAtom(0).getPos(), [0, 0, 5])))
+  c.getAtom(numAtoms).link(c.getAtom(0))
+  var c1 = c.getAtom(1)
+  c1.unlink(c1.getBonds()[0])
+  c1.setPos(Vec3.plus(c1.getPos(), [1, 0, 0]))
+  if (c.numAtoms() != numAtoms + 1 || bondPairs(c) == pairs)
+    return "FAIL"
+  if (m.numAtoms() != numAtoms || bondPairs(m) != pairs || Vec3.almostEquals(m.getAtom(1).getPos(), c1.getPos(), 0.5))
+    return "FAIL"
+
+  // ... and the other way around
+  var cPairs = bondPairs(c)
+  m.getAtom(2).unlink(m.getAtom(2).getBonds()[0])
+  return bondPairs(c) == cPairs ? "OK" : "FAIL"
+}
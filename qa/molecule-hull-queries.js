@@ -0,0 +1,38 @@
+// tests the hull-based queries: diameter, minWidth, orientedBoundingBox
+
+exports.run = function() {
+  // rotated 5x3x2 lattice with the unit spacing: the box is 4x2x1
+  var rot = Mat3.rotate(Vec3.muln([0.6, 0, 0.8], 0.7)) // axis*angle
+  var m = new Molecule
+  for (var i = 0; i < 5; i++)
+    for (var j = 0; j < 3; j++)
+      for (var k = 0; k < 2; k++)
+        m.addAtom(new Atom("C", Mat3.mulv(rot, [i, j, k])))
+  var eps = 0.000001
+
+  // the furthest pair is between the opposite corners
+  var furthest = m.findFurthestAtoms()
+  var diam = Math.sqrt(4*4 + 2*2 + 1*1)
+  if (Math.abs(m.diameter() - diam) > eps || Math.abs(m.getAtom(furthest[0]).distance(m.getAtom(furthest[1])) - diam) > eps ||
+      Math.abs(m.maxDistBetweenAtoms() - diam) > eps)
+    return "FAIL"
+  if (m.findConvexHullVertices().length > m.numAtoms())
+    return "FAIL"
+
+  if (Math.abs(m.minWidth() - 1) > eps)
+    return "FAIL"
+
+  // the regular tetrahedron is the narrowest between its opposite edges: a/sqrt(2) = 2 with a = 2*sqrt(2), not across a facet
+  var tetra = new Molecule
+  tetra.addAtom(new Atom("C", [1, 1, 1]))
+  tetra.addAtom(new Atom("C", [1, -1, -1]))
+  tetra.addAtom(new Atom("C", [-1, 1, -1]))
+  tetra.addAtom(new Atom("C", [-1, -1, 1]))
+  if (Math.abs(tetra.minWidth() - 2) > eps)
+    return ["FAIL", "tetrahedron width "+tetra.minWidth()]
+
+  var box = m.orientedBoundingBox()
+  var extents = box.extents.slice().sort(function(a, b) {return a - b})
+  return Math.abs(extents[0] - 1) < eps && Math.abs(extents[1] - 2) < eps && Math.abs(extents[2] - 4) < eps &&
+         Vec3.almostEquals(box.center, Mat3.mulv(rot, [2, 1, 0.5]), eps) ? "OK" : "FAIL"
+}
@@ -0,0 +1,63 @@
+// tests the periodic molecules: lattice, minimum image distances, periodic bonds and contacts, supercells
+
+function numBonds(m) {
+  var n = 0
+  for (var a = 0; a < m.numAtoms(); a++)
+    n += m.getAtom(a).getBonds().length
+  return n/2
+}
+
+exports.run = function() {
+  var eps = 0.000001
+
+  // the H-H chain along a: the bond across the cell face only exists when periodic
+  var cell = new Molecule
+  cell.addAtom(new Atom("H", [0, 0, 0]))
+  cell.addAtom(new Atom("H", [0.74, 0, 0]))
+  if (cell.isPeriodic() || cell.getLattice() !== undefined)
+    return "FAIL"
+  cell.setLattice([[1.48, 0, 0], [0, 10, 0], [0, 0, 10]])
+  if (!cell.isPeriodic() || !Vec3.almostEquals(cell.getLattice()[0], [1.48, 0, 0], eps))
+    return "FAIL"
+  var chain = cell.supercell(3, 1, 1)
+  if (chain.numAtoms() != 6 || !chain.isPeriodic() || !Vec3.almostEquals(chain.getLattice()[0], [3*1.48, 0, 0], eps))
+    return "FAIL"
+  chain.detectBonds()
+  if (numBonds(chain) != 6)
+    return ["FAIL", "periodic chain has "+numBonds(chain)+" bonds"]
+  chain.setLattice(undefined)
+  chain.detectBonds()
+  if (chain.isPeriodic() || numBonds(chain) != 5)
+    return ["FAIL", "non-periodic chain has "+numBonds(chain)+" bonds"]
+
+  // the minimum image distance and the wrapping
+  var box = new Molecule
+  box.addAtom(new Atom("C", [0.5, 0.5, 0.5]))
+  box.addAtom(new Atom("C", [9.5, 0.5, 13.5]))
+  box.setLattice([[10, 0, 0], [0, 10, 0], [0, 0, 10]])
+  if (Math.abs(box.distance(0, 1) - Math.sqrt(1*1 + 0 + 3*3)) > eps)
+    return "FAIL"
+  box.wrapAtoms()
+  if (!Vec3.almostEquals(box.getAtom(1).getPos(), [9.5, 0.5, 3.5], eps))
+    return "FAIL"
+
+  // contacts and clashes across the cell faces
+  if (box.findContacts(3).size() != 0 || box.findContacts(3.2).size() != 2*4 || box.hasClash(3) || !box.hasClash(3.2))
+    return "FAIL"
+
+  // the supercell of the periodic cell has the same descriptors as the cell
+  var fcc = new Molecule
+  fcc.addAtom(new Atom("Ar", [0,   0,   0]))
+  fcc.addAtom(new Atom("Ar", [0,   2.6, 2.6]))
+  fcc.addAtom(new Atom("Ar", [2.6, 0,   2.6]))
+  fcc.addAtom(new Atom("Ar", [2.6, 2.6, 0]))
+  fcc.setLattice([[5.2, 0, 0], [0, 5.2, 0], [0, 0, 5.2]])
+  var radial = [[0.5, 0], [0.5, 3.7]], angular = [[1, 1, 0.1], [2, -1, 0.1]]
+  var sfCell = SymmetryFunctions.compute(fcc, 6, radial, angular)
+  var sfSuper = SymmetryFunctions.compute(fcc.supercell(2, 2, 2), 6, radial, angular)
+  for (var a = 0; a < sfSuper.cols(); a++)
+    for (var f = 0; f < sfCell.rows(); f++)
+      if (Math.abs(sfSuper.get(f, a) - sfCell.get(f, a % 4)) > 1e-9*(1 + Math.abs(sfCell.get(f, a % 4))))
+        return ["FAIL", "atom#"+a+" function#"+f+": "+sfSuper.get(f, a)+" vs. "+sfCell.get(f, a % 4)]
+  return "OK"
+}
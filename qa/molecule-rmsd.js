@@ -0,0 +1,20 @@
+exports.run = function() {
+  var SM = require('stock-molecules')
+  var eps = 0.000001
+
+  // the same molecule rotated and shifted, and one with a displaced atom
+  var m1 = SM.h2o_wiki()
+  var m2 = m1.dupl()
+  m2.getCoordsView().mulMat3PlusVec3(Mat3.rotate([0,0,1.2]), [1,2,3])
+  var m3 = m1.dupl()
+  m3.getAtom(1).setPos(Vec3.plus(m3.getAtom(1).getPos(), [0.3,0,0]))
+
+  var mat = Moleculex.rmsdMatrix([m1, m2, m3], 2)
+  var vec = Moleculex.rmsdOneToMany(m1, [m1, m2, m3], 0)
+  if (mat.rows() != 3 || mat.cols() != 3 || vec.size() != 3)
+    return "FAIL"
+  if (Math.abs(mat.get(0,1)) > eps || Math.abs(mat.get(1,1)) > eps || Math.abs(mat.get(0,2) - mat.get(2,0)) > eps)
+    return "FAIL"
+  // agrees with the Kabsch-based rmsd
+  return Math.abs(vec.get(2) - Moleculex.rmsd(m1, m3)) < eps && Math.abs(vec.get(2) - mat.get(1,2)) < eps ? "OK" : "FAIL"
+}
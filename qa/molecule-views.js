@@ -0,0 +1,60 @@
+
+exports.run = function() {
+  var SM = require('stock-molecules')
+  var m = SM.h2o_wiki()
+  var eps = 0.000001
+
+  // coordinates are shared: transforming the view moves the atoms
+  var coords = m.getCoordsView()
+  if (coords.size() != 3*m.numAtoms())
+    return "FAIL"
+  coords.mulMat3PlusVec3(Mat3.identity(), [1,2,3])
+  if (!Vec3.almostEquals(m.getAtom(0).getPos(), [1,2,3], eps))
+    return "FAIL"
+
+  // and so are elements: one byte per atom
+  var elements = m.getElementsView()
+  if (elements.size() != m.numAtoms() || elements.getByte(0) != 8/*O*/)
+    return "FAIL"
+
+  // views can't be resized, the elements view can't be modified
+  var throws = function(fn) {
+    try {
+      fn()
+    } catch (e) {
+      return true
+    }
+    return false
+  }
+  if (!throws(function() {coords.append(1)}) || !throws(function() {coords.resize(0)}) ||
+      !throws(function() {elements.clear()}) || !throws(function() {elements.putByte(0, 6)}) ||
+      coords.size() != 3*m.numAtoms() || elements.getByte(0) != 8)
+    return "FAIL"
+
+  // bulk copies and setters
+  var c = m.getCoords()
+  c.set(0, 5)
+  if (m.getAtom(0).getPos()[0] != 1)
+    return "FAIL"
+  m.setCoords(c)
+  if (m.getAtom(0).getPos()[0] != 5)
+    return "FAIL"
+  var e = m.getElements()
+  e.putByte(1, 2/*He*/)
+  m.setElements(e)
+  if (m.getAtom(1).getElement() != "He" || m.allElements().join() != "O,He,H")
+    return "FAIL"
+  var chains = new Binary
+  for (var i = 0; i < m.numAtoms(); i++)
+    chains.appendUInt(i == 0 ? 1 : 0)
+  m.setChains(chains)
+  if (m.numChains() != 2 || m.getAtom(0).getChain() != 1 || m.getChains().getUInt(4) != 0)
+    return "FAIL"
+
+  // bond pairs: two indexes per bond, the lower one first
+  var w = SM.h2o_wiki()
+  w.detectBonds()
+  var pairs = w.getBondPairs()
+  return pairs.size() == 2*2*4 && pairs.getUInt(0) == 0 && pairs.getUInt(4) == 1 && pairs.getUInt(8) == 0 && pairs.getUInt(12) == 2 &&
+         w.rmsd(w.dupl()) < eps ? "OK" : "FAIL"
+}
@@ -0,0 +1,58 @@
+
+exports.run = function() {
+  // 4x4x4 cubic lattice of carbons with the bond-length spacing
+  var N = 4
+  var D = 1.45
+  var m = new Molecule
+  for (var i = 0; i < N; i++)
+    for (var j = 0; j < N; j++)
+      for (var k = 0; k < N; k++)
+        m.addAtom(new Atom("C", [i*D, j*D, k*D]))
+  var atoms = m.getAtoms()
+
+  // all pairs within the radius, computed directly
+  var radius = 2.1 // includes face diagonals
+  var pairs = []
+  for (var i = 0; i < atoms.length; i++)
+    for (var j = i+1; j < atoms.length; j++)
+      if (atoms[i].distance(atoms[j]) <= radius)
+        pairs.push([i,j])
+
+  var grid = m.buildNeighborGrid(1.0) // cells smaller than the radius
+  if (JSON.stringify(grid.findPairs(radius)) != JSON.stringify(pairs))
+    return "FAIL"
+  if (grid.findNeighbors(0, radius).length != pairs.filter(function(p) {return p[0] == 0}).length)
+    return "FAIL"
+
+  // contacts are the same pairs, clashes are strictly closer than the distance
+  var contacts = m.findContacts(radius)
+  if (contacts.size() != 2*4*pairs.length || contacts.getUInt(0) != pairs[0][0] || contacts.getUInt(4) != pairs[0][1])
+    return "FAIL"
+  if (m.hasClash(D) || !m.hasClash(1.01*D))
+    return "FAIL"
+  var other = new Molecule
+  other.addAtom(new Atom("H", [0, 0, -1]))
+  contacts = m.findContacts(1.5, other)
+  if (!m.hasClash(1.01, other) || contacts.size() != 2*4 || contacts.getUInt(0) != 0 || contacts.getUInt(4) != 0)
+    return "FAIL"
+
+  // bonds: only the lattice edges
+  var countBonds = function() {
+    var nbonds = 0
+    for (var i = 0; i < atoms.length; i++)
+      nbonds += atoms[i].getNumBonds()
+    return nbonds
+  }
+  m.detectBonds()
+  if (countBonds() != 2*3*N*N*(N-1))
+    return "FAIL"
+
+  // moving the corner atom away drops its 3 bonds, moving it back restores them
+  atoms[0].setPos([-10, -10, -10])
+  m.updateBonds([0])
+  if (atoms[0].getNumBonds() != 0 || countBonds() != 2*3*N*N*(N-1) - 2*3)
+    return "FAIL"
+  atoms[0].setPos([0, 0, 0])
+  m.updateBonds([0])
+  return countBonds() == 2*3*N*N*(N-1) ? "OK" : "FAIL"
+}
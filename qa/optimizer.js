@@ -0,0 +1,67 @@
+// tests the native geometry optimizer
+
+exports.run = function() {
+  var SM = require('stock-molecules')
+
+  // a script objective: E = sum((x-c)^2), both methods find c
+  var target = [1, -2, 3, 0.5, 0.25, -1]
+  var objective = function(x, grad) {
+    var E = 0
+    for (var i = 0; i < target.length; i++) {
+      var d = x.get(i) - target[i]
+      E += d*d
+      grad.set(i, 2*d)
+    }
+    return E
+  }
+  var methods = ["lbfgs", "fire"]
+  for (var k = 0; k < methods.length; k++) {
+    var x = new FloatArray8
+    x.resize(target.length)
+    var res = Optimizer.minimize(x, objective, {method: methods[k], gradTolerance: 0.00001, maxIterations: 5000})
+    if (!res.converged || res.energy > 0.0000001 || Math.abs(x.get(2) - 3) > 0.0001)
+      return "FAIL"
+  }
+
+  // the arrays passed to the objective can be kept after minimize returns
+  var kept = []
+  var x = new FloatArray8
+  x.resize(2)
+  Optimizer.minimize(x, function(x, grad) {
+    kept = [x, grad]
+    var d = x.get(0) - 1
+    grad.set(0, 2*d)
+    grad.set(1, 0)
+    return d*d
+  })
+  if (kept[0].size() != 2 || kept[1].size() != 2 || Math.abs(kept[0].get(0) - 1) > 0.001)
+    return "FAIL"
+
+  // the stretched water relaxes with the force field, the frozen oxygen stays in place
+  var m = SM.h2o_wiki()
+  m.detectBonds()
+  m.getAtom(1).setPos(Vec3.muln(m.getAtom(1).getPos(), 1.3))
+  var ff = new ForceField(m)
+  var e0 = ff.calcEnergy(m)
+  var o = m.getAtom(0).getPos()
+  var res = Optimizer.minimize(m, ff, {frozenAtoms: [0]})
+  if (!res.converged || res.energy >= e0 || Math.abs(res.energy - ff.calcEnergy(m)) > 0.000001)
+    return "FAIL"
+  if (!Vec3.almostEquals(m.getAtom(0).getPos(), o, 0.000001))
+    return "FAIL"
+
+  // the coordinates should match the force field
+  try {
+    Optimizer.minimize(new FloatArray8, ff)
+    return "FAIL"
+  } catch (e) {
+  }
+
+  // errors in the objective propagate
+  try {
+    Optimizer.minimize(new FloatArray8, function(x, grad) {throw "stop"})
+    return "FAIL"
+  } catch (e) {
+    return e == "stop" ? "OK" : "FAIL"
+  }
+}
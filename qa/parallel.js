@@ -0,0 +1,41 @@
+exports.run = function() {
+  var SM = require('stock-molecules')
+
+  if (!(System.numCPUs() >= 1))
+    return "FAIL"
+
+  // plain values and molecules are passed to the workers and back
+  var items = [1, "two", {x: [3]}, SM.h2o_wiki()]
+  var res = Parallel.map(items, "function(item, idx) {return [idx, typeof item == 'object' && item.numAtoms ? item.dupl() : item]}", 0)
+  if (res.length != 4 || res[1][0] != 1 || res[1][1] != "two" || res[2][1].x[0] != 3 || res[3][1].numAtoms() != 3)
+    return "FAIL"
+
+  // matrices are returned from the workers
+  var mats = Parallel.map([SM.h2o_wiki()], "function(m) {return SymmetryFunctions.compute(m, 6, [[0.5, 0]], [])}", 0)
+  if (mats[0].rows() != 1 || mats[0].cols() != 3 || !(mats[0].get(0, 0) > 0))
+    return "FAIL"
+
+  // values that can't be passed are rejected both ways
+  var rejected = function(items, fnSource) {
+    try {
+      Parallel.map(items, fnSource, 0)
+    } catch (e) {
+      return true
+    }
+    return false
+  }
+  var water = SM.h2o_wiki()
+  water.detectBonds()
+  if (!rejected([new ForceField(water)], "function(item) {return 1}") ||
+      !rejected([1], "function(item) {return function() {}}") ||
+      !rejected([water], "function(m) {return m.getAtom(0)}"))
+    return "FAIL"
+
+  // errors in workers are reported to the caller
+  try {
+    Parallel.map([1, 2], "function(item) {if (item == 2) throw 'bad item'; return item}", 2)
+  } catch (e) {
+    return "OK"
+  }
+  return "FAIL"
+}
@@ -0,0 +1,28 @@
+function atomLine(serial, name, altLoc, x, elt) { // ALA A 1 with the given atom name and altLoc, y=z=0
+  function pad(s, n, left) {
+    s = ""+s
+    while (s.length < n)
+      s = left ? " "+s : s+" "
+    return s
+  }
+  return "ATOM  "+pad(serial, 5, true)+" "+pad(name, 4, false)+altLoc+"ALA A   1    "+pad(x.toFixed(3), 8, true)+"   0.000   0.000  0.50 10.00          "+pad(elt, 2, true)+"\n"
+}
+
+exports.run = function() {
+  var Url = require('url')
+
+  // alternate locations: the first one of each atom is kept, whatever its label is
+  var alt = Pdb.readBuffer(atomLine(1, " N", " ", 0, "N")+atomLine(2, " CA", "A", 1.5, "C")+atomLine(3, " CA", "B", 1.6, "C")+
+                           atomLine(4, " CB", "B", 3.0, "C")+atomLine(5, " CB", "C", 3.1, "C"))
+  if (alt.length != 1 || alt[0].numAtoms() != 3 || alt[0].getAtom(1).getPos()[0] != 1.5 || alt[0].getAtom(2).getPos()[0] != 3.0)
+    return "FAIL"
+
+  var pdbRecord = "4HHB"
+  var m = Pdb.readBuffer(gunzip(downloadUrl(Url.pdb.getPdbGzipped(pdbRecord))))
+
+  var a = m[0].getAtom(0)
+  if (m.length == 1 && m[0].numAtoms() == 4779 && a.getName() == "N" && a.getChain() == 1 && a.getGroup() == 1 && !a.getHetAtm())
+    return "OK"
+  else
+    return "FAIL"
+}
@@ -0,0 +1,41 @@
+exports.run = function() {
+  var AminoAcids = require('amino-acids')
+  function aa(code) {
+    return Moleculex.fromXyzOne(AminoAcids.codeToFile(code))
+  }
+  // every junction removes O and H from the chain and H from the appended amino acid
+  function expectedNumAtoms(peptide) {
+    var numAtoms = 0
+    AminoAcids.decodePeptide(peptide, function(i,code) {
+      numAtoms += aa(code).numAtoms()
+    })
+    return numAtoms - 3*(peptide.length-1)
+  }
+
+  var peptide = "GASG"
+  var chain = AminoAcids.combine(peptide)
+  if (chain.numAtoms() != expectedNumAtoms(peptide) || chain.findAaBackbones().length != peptide.length)
+    return "FAIL"
+
+  // same atoms as appending one amino acid at a time
+  var chain1 = aa(peptide.charAt(0))
+  for (var i = 1; i < peptide.length; i++)
+    chain1.appendAminoAcid(aa(peptide.charAt(i)), undefined)
+  var atoms = chain.getAtoms(), atoms1 = chain1.getAtoms()
+  for (var i = 0; i < atoms.length; i++)
+    if (atoms[i].getElement() != atoms1[i].getElement())
+      return "FAIL"
+  // ... at the same positions after the superposition, with the same backbone angles
+  if (Moleculex.rmsd(chain, chain1) > 0.0001)
+    return ["FAIL", "rmsd="+Moleculex.rmsd(chain, chain1)]
+  var aaBackbones = chain.findAaBackbonesSorted(), aaBackbones1 = chain1.findAaBackbonesSorted()
+  for (var j = 0; j+1 < peptide.length; j++)
+    for (var angleId = 0; angleId < 3; angleId++) { // omega, phi, psi
+      var d = Math.abs(chain.getAminoAcidSingleAngle(aaBackbones, j, angleId) - chain1.getAminoAcidSingleAngle(aaBackbones1, j, angleId)) % 360
+      if (Math.min(d, 360 - d) > 0.001)
+        return ["FAIL", "junction#"+j+" angle#"+angleId]
+    }
+
+  // the builder keeps the templates after the chain is taken
+  return AminoAcids.combine("AG").numAtoms() == expectedNumAtoms("AG") ? "OK" : "FAIL"
+}
@@ -2,19 +2,20 @@
 
 // the list of cases
 
-var all_tests = ["xyz",
-                 "vec3-ops", "vec3-rmsd",
+var all_tests = ["xyz", "xyz-frames",
+                 "neighbor-grid", "molecule-views", "molecule-copy", "bond-graph", "structure-db", "fingerprint-db", "substructure", "peptide-builder", "torsion-tree",
+                 "vec3-ops", "vec3-rmsd", "molecule-rmsd", "symmetry-functions",
                  "mat3-ops", "mat3-rotate",
                  "binary",
-                 "computeConvexHullFacets", "computeConvexHullFacets+furthestdist",
-                 "gzip", "mmtf",
-                 "fs",
+                 "computeConvexHullFacets", "computeConvexHullFacets+furthestdist", "molecule-hull-queries", "molecule-periodic",
+                 "gzip", "mmtf", "pdb",
+                 "fs", "parallel",
                  "http-protocol",
                  "sqlite3",
                  "image",
                  "animate",
                  "web-ui-http", "web-ui-https", "web-ui-url",
-                 "calc-erkale", "calc-nwchem"
+                 "calc-mm", "optimizer", "molecular-dynamics", "trajectory", "calc-erkale", "calc-nwchem"
                 ]
 
 // helper functions
@@ -0,0 +1,73 @@
+exports.run = function() {
+  // build a molecule from the [element, position] list, bonds are detected
+  function mk(atoms) {
+    var m = new Molecule
+    atoms.forEach(function(a) {m.addAtom(new Atom(a[0], a[1]))})
+    m.detectBonds()
+    return m
+  }
+  var O = ["O", [0,0,0]], H1 = ["H", [0.58708,0.75754,0]], H2 = ["H", [0.58708,-0.75754,0]]
+  var h2o = mk([O, H1, H2])
+  var h2oPermuted = mk([H2, O, H1])
+  var h2 = mk([["H", [0,0,0]], ["H", [0.74,0,0]]])
+
+  var db = new StructureDb
+  if (!db.add(h2o, "water") || db.add(h2oPermuted, "water-2") || !db.add(h2, "hydrogen") || db.size() != 2)
+    return "FAIL"
+  if (db.moleculeSignature(h2o) != db.moleculeSignature(h2oPermuted) || db.moleculeSignature(h2o) == db.moleculeSignature(h2))
+    return "FAIL"
+  if (db.find(h2o) != "water-2" || db.find(h2) != "hydrogen" || db.find(mk([O])) != "")
+    return "FAIL"
+
+  // save, append a segment, and open it again
+  var fname = "/tmp/test-structure-db-tm"+Time.now()+".sdb"
+  db.save(fname)
+  var o = mk([O])
+  db.add(o, "oxygen")
+  db.save(fname)
+  var db2 = StructureDb.open(fname)
+  if (db2.size() != 3 || db2.find(h2oPermuted) != "water-2" || db2.find(o) != "oxygen")
+    return "FAIL"
+
+  // more append segments than MAX_APPEND_SEGMENTS=4 start the background merge into the main file,
+  // the db opened during the merge and after it should have all structures
+  function carbonChain(n) {
+    var atoms = []
+    for (var i = 0; i < n; i++)
+      atoms.push(["C", [1.5*i, 0, 0]])
+    return mk(atoms)
+  }
+  var numChains = 6
+  for (var n = 2; n < 2 + numChains; n++) {
+    db.add(carbonChain(n), "chain-"+n)
+    db.save(fname)
+  }
+  function hasAll(d) {
+    if (d.find(h2oPermuted) != "water-2" || d.find(h2) != "hydrogen" || d.find(o) != "oxygen")
+      return false
+    for (var n = 2; n < 2 + numChains; n++)
+      if (d.find(carbonChain(n)) != "chain-"+n)
+        return false
+    return true
+  }
+  if (!hasAll(StructureDb.open(fname)))
+    return ["FAIL", "while merging"]
+  for (var t = 0; t < 60 && File.exists(fname+".1"); t++) // the merge removes the merged segments
+    sleep(1)
+  if (File.exists(fname+".1"))
+    return ["FAIL", "no merge"]
+  if (!hasAll(StructureDb.open(fname)))
+    return ["FAIL", "after the merge"]
+  // the saver continues after the merged file
+  var c = carbonChain(2 + numChains)
+  db.add(c, "chain-last")
+  db.save(fname)
+  var db3 = StructureDb.open(fname)
+  var ok = hasAll(db3) && db3.find(c) == "chain-last" && db3.size() == 4 + numChains
+
+  File.unlink(fname)
+  for (var no = 1; no <= 2 + numChains; no++)
+    if (File.exists(fname+"."+no))
+      File.unlink(fname+"."+no)
+  return ok ? "OK" : "FAIL"
+}
@@ -0,0 +1,32 @@
+exports.run = function() {
+  var SM = require('stock-molecules')
+  function mk(atoms) {
+    var m = new Molecule
+    atoms.forEach(function(a) {m.addAtom(new Atom(a[0], a[1]))})
+    m.detectBonds()
+    return m
+  }
+  var dimer = SM.h2o_dimer_2000()
+  dimer.detectBonds()
+  var ring = mk([["C", [0,0,0]], ["C", [1.5,0,0]], ["C", [0.75,1.3,0]], ["O", [-1.3,-0.5,0]]])
+
+  // H-O-H matches each water molecule twice, once as an atom set
+  var hoh = new Substructure(mk([["H", [0.59,0.76,0]], ["O", [0,0,0]], ["H", [0.59,-0.76,0]]]))
+  if (hoh.findMatches(dimer, 0, false).length != 4 || hoh.findMatches(dimer, 0, true).length != 2 || hoh.matches(ring))
+    return "FAIL"
+
+  // any element in a ring bonded to O
+  var xo = new Substructure(mk([["C", [0,0,0]], ["O", [1.4,0,0]]]))
+  xo.setElement(0, "*")
+  xo.setRing(0, 1)
+  var m = xo.findMatches(ring, 0, true)
+  if (m.length != 1 || m[0][0] != 0 || m[0][1] != 3 || xo.matches(dimer))
+    return "FAIL"
+
+  // search in StructureDb
+  var db = new StructureDb
+  db.add(dimer, "dimer")
+  db.add(ring, "ring")
+  var found = db.findSubstructure(hoh, 0)
+  return found.length == 1 && found[0] == "dimer" && db.findSubstructure(xo, 0)[0] == "ring" ? "OK" : "FAIL"
+}
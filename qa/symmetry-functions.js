@@ -0,0 +1,16 @@
+exports.run = function() {
+  var argsMapper = require("compute-arguments-symmetry-functions-by-Behler+coworkers")
+  var atoms = [["C", [0,0,0]], ["H", [1.09,0,0]], ["H", [-0.36,1.03,0]], ["H", [-0.36,-0.51,0.89]], ["O", [3.1,0.4,-0.7]], ["H", [7,7,7]]]
+
+  // the native kernel agrees with the JS implementation
+  var all = argsMapper.computeArgumentsForAll(atoms)
+  for (var a = 0; a < atoms.length; a++) {
+    var ref = argsMapper.computeArguments(a, atoms)
+    if (all[a].length != ref.length)
+      return "FAIL"
+    for (var f = 0; f < ref.length; f++)
+      if (Math.abs(all[a][f] - ref[f]) > 1e-9*(1 + Math.abs(ref[f])))
+        return ["FAIL", "atom#"+a+" function#"+f+": "+all[a][f]+" vs. "+ref[f]]
+  }
+  return "OK"
+}
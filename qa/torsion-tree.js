@@ -0,0 +1,25 @@
+exports.run = function() {
+  var AminoAcids = require('amino-acids')
+  var OMEGA = 0, PHI = 1, PSI = 2
+  function near(a1, a2) {
+    var d = Math.abs(a1 - a2) % 360
+    return Math.min(d, 360 - d) < 1e-6
+  }
+
+  // angles set in the tree are measured in the molecule after apply()
+  var m = AminoAcids.combine("GAPS")
+  var aaBackbones = m.findAaBackbonesSorted()
+  var tree = new TorsionTree(m, aaBackbones)
+  if (tree.numJunctions() != 3 || tree.isRotatable(1, PHI) || !tree.isRotatable(1, PSI)) // proline's phi is in the ring
+    return "FAIL"
+  tree.setAngles(0, [170, -60, -45])
+  tree.setAngle(2, PSI, 120)
+  tree.apply()
+  if (!near(m.getAminoAcidSingleAngle(aaBackbones, 0, OMEGA), 170) || !near(m.getAminoAcidSingleAngle(aaBackbones, 0, PHI), -60) ||
+      !near(m.getAminoAcidSingleAngle(aaBackbones, 0, PSI), -45) || !near(m.getAminoAcidSingleAngle(aaBackbones, 2, PSI), 120))
+    return "FAIL"
+
+  // same through the Molecule functions
+  m.setAminoAcidSequenceAngles(aaBackbones, [0, 2], [[180, -120, 130], [175]])
+  return near(m.getAminoAcidSingleAngle(aaBackbones, 0, PSI), 130) && near(m.getAminoAcidSingleAngle(aaBackbones, 2, OMEGA), 175) ? "OK" : "FAIL"
+}
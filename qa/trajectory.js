@@ -0,0 +1,37 @@
+// tests the compressed binary trajectory: precision, chunks and the random access to frames
+
+exports.run = function() {
+  var SM = require('stock-molecules')
+  var fname = "/tmp/test-trajectory-tm"+Time.now()+".traj"
+  var m = SM.h2o_wiki()
+
+  // frames drift the atoms away from the origin, every frame is kept to compare with
+  var frames = []
+  var w = new TrajectoryWriter(fname, m, {precision: 0.01, framesPerChunk: 4})
+  for (var f = 0; f < 10; f++) {
+    for (var a = 0; a < m.numAtoms(); a++)
+      m.getAtom(a).setPos(Vec3.plus(m.getAtom(a).getPos(), [0.123*a, -0.0567*f, 1.5]))
+    frames.push(m.getCoords())
+    if (f % 2 == 0)
+      w.write(100*f, m)
+    else
+      w.write(100*f, m.getCoords())
+  }
+  w.flush()
+
+  var traj = new TrajectoryReader(fname)
+  if (traj.numAtoms() != 3 || traj.numFrames() != 10 || traj.getPrecision() != 0.01 || traj.getElements().getByte(0) != 8)
+    return "FAIL"
+  var coords = new FloatArray8
+  var order = [9, 0, 5, 6, 7, 3, 3, 8, 1]
+  for (var k = 0; k < order.length; k++) {
+    var f = order[k]
+    if (traj.readStep(f) != 100*f || traj.readFrame(f, coords) !== coords)
+      return "FAIL"
+    for (var i = 0; i < 9; i++)
+      if (Math.abs(coords.get(i) - frames[f].get(i)) > 0.005 + 0.000001)
+        return ["FAIL", "frame#"+f+" coordinate#"+i+": "+coords.get(i)+" vs. "+frames[f].get(i)]
+  }
+  File.unlink(fname)
+  return "OK"
+}
@@ -0,0 +1,26 @@
+
+exports.run = function() {
+  var fname = "/tmp/test-xyz-frames-tm"+Time.now()+".xyz"
+  var xyz = ""
+  for (var f = 0; f < 3; f++)
+    xyz += "3\nframe "+f+"\nO 0.0 0.0 "+f+"\nH 0.96 0.0 "+f+"\nH 0.0 0.96 "+f+"\n"
+  File.write(xyz, fname)
+
+  // coordinates only: the same array is refilled for every frame
+  var zs = []
+  var nframes = Moleculex.forEachXyzFrameCoords(fname, function(coords, descr, idx) {
+    if (coords.size() != 9 || descr != "frame "+idx)
+      throw "bad frame "+idx
+    zs.push(coords.get(8))
+  })
+  if (nframes != 3 || zs.join(",") != "0,1,2")
+    return "FAIL"
+
+  // molecules with bonds, stopping after the second frame
+  var nbonds = 0
+  nframes = Moleculex.forEachXyzFrame(fname, true, function(m, idx) {
+    nbonds += m.getAtom(0).getNumBonds()
+    return idx < 1
+  })
+  return nframes == 2 && nbonds == 4 ? "OK" : "FAIL"
+}
@@ -3,6 +3,7 @@
 // StlExt module contains simple extentions of stl types
 
 #include <vector>
+#include <cstddef>
 
 namespace std_ext {
 
@@ -20,4 +21,16 @@ public:
   const_iterator end() const {return it2;}
 }; // vector_range
 
+template<class T>
+class array_range { // range of elements in contiguous memory
+  T *b;
+  T *e;
+public:
+  array_range(T *newB, T *newE) : b(newB), e(newE) { }
+  T* begin() const {return b;}
+  T* end() const {return e;}
+  size_t size() const {return e - b;}
+  T& operator[](size_t i) const {return b[i];}
+}; // array_range
+
 }; // std_ext
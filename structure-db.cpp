@@ -1,119 +1,714 @@
 #include "structure-db.h"
+#include "xerror.h"
+#include "util.h"
 
 #include <algorithm>
+#include <fstream>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+
+static_assert(sizeof(unsigned) == 4, "segment files store atom indexes as 32-bit numbers");
+
+/// segment file format: the header followed by the arrays of Entries in the order of the fields of FileHeader below,
+/// the arrays are ordered by the element size so that they don't need padding, numbers are in the native byte order
+
+namespace {
+
+struct FileHeader {
+  char     magic[8];
+  uint32_t version;
+  uint32_t numEntries;
+  uint32_t numShadowing;
+  uint32_t lastMergedNo; // the main file: the last append segment merged into it, 0 for the append segments
+  uint64_t numAtoms;
+  uint64_t numNbrs;
+  uint64_t idsSize;
+}; // FileHeader
 
-StructureDb::StructureDb() {
 }
 
-void StructureDb::add(const Molecule *m, const std::string &id) {
-  const MoleculeSignature signature = computeMoleculeSignature(m);
-  signatures[signature] = id;
+static const char fileMagic[8] = {'C', 'W', 'S', 'T', 'R', 'D', 'B', 0};
+enum {FILE_VERSION = 1};
+
+static uint64_t fileSize(const FileHeader &h) {
+  uint64_t numEntries = h.numEntries;
+  return sizeof(FileHeader)
+         + 8*(numEntries + 3*(numEntries + 1) + h.numAtoms)  // hashes, atomStart, nbrStart, idStart, colors
+         + 4*(h.numAtoms + numEntries + h.numNbrs)           // nbrOffsets, nbrs
+         + h.numAtoms + h.idsSize;                           // elements, idChars
 }
 
-std::string StructureDb::find(const Molecule *m) {
-  auto it = signatures.find(computeMoleculeSignature(m));
-  return it != signatures.end() ? it->second : "";
+/// local helpers
+
+static unsigned countDistinct(const std::vector<uint64_t> &values, std::vector<uint64_t> &buf) {
+  buf.assign(values.begin(), values.end());
+  std::sort(buf.begin(), buf.end());
+  return std::unique(buf.begin(), buf.end()) - buf.begin();
 }
 
-/// internals
+/// StructureDb
 
-const StructureDb::MoleculeSignature StructureDb::computeMoleculeSignature(const Molecule *m) {
-  MoleculeSignature moleculeSignature;
-  for (auto a : m->atoms)
-    moleculeSignature.push_back(computeAtomSignature(a));
-  moleculeSignature.sort();
-  return moleculeSignature;
-}
-
-const StructureDb::AtomSignature StructureDb::computeAtomSignature(const Atom *a) {
-  // top-level atom defines a stack that neighbors are checked against
-  std::array<const Atom*, STACK_SZ> stack;
-  stack[0] = a;
-  // similar to computeAtomNeighborSignature here
-  AtomSignature atomSignature(a->elt);
-  for (auto neighbor : a->bonds)
-    atomSignature.addNeighbor(computeAtomNeighborSignature(neighbor, stack, 1/*current depth*/, STACK_SZ));
-  return atomSignature;
-}
-
-const StructureDb::AtomSignature StructureDb::computeAtomNeighborSignature(const Atom *a, std::array<const Atom*, STACK_SZ> &stack, unsigned depth, unsigned maxDepth) {
-  AtomSignature atomSignature(a->elt);
-  if (depth < maxDepth) {
-    stack[depth] = a;
-    for (auto neighbor : a->bonds) {
-      // exclude neighbors that we've seen in stack
-      bool seen = false;
-      for (unsigned d = 0; d < depth; d++)
-        if (neighbor == stack[d]) {
-          seen = true;
-          break;
-        }
-      if (seen)
+StructureDb::StructureDb()
+: lastSegmentNo(0),
+  atomStart(1, 0),
+  nbrStart(1, 0),
+  numShadowing(0),
+  numMerging(0),
+  mergeDone(false)
+{
+}
+
+StructureDb::~StructureDb() {
+  if (merger.joinable())
+    merger.join();
+}
+
+StructureDb* StructureDb::open(const std::string &path) {
+  std::unique_ptr<StructureDb> db(new StructureDb);
+  db->path = path;
+  // the background merge of the saving process replaces the main file and then removes the append segments merged into it:
+  // the segments already in the mapped main file are skipped, and when the main file was replaced while the append segments
+  // were listed some of them could be gone, so it starts over then
+  do {
+    db->segments.clear();
+    db->segments.emplace_back(new Segment(path));
+    db->lastSegmentNo = db->segments[0]->getLastMergedNo();
+    for (auto &ns : listAppendSegments(path)) {
+      if (ns.first <= db->segments[0]->getLastMergedNo())
         continue;
-      atomSignature.addNeighbor(computeAtomNeighborSignature(neighbor, stack, depth+1, STACK_SZ));
+      int fd = ::open(ns.second.c_str(), O_RDONLY);
+      if (fd == -1) {
+        if (errno == ENOENT)
+          continue; // merged and removed: the main file isn't current then
+        ERROR_SYSCALL1(open, "can't open the structure-db file for reading: " << ns.second)
+      }
+      db->segments.emplace_back(new Segment(ns.second, fd));
+      db->lastSegmentNo = ns.first;
     }
+  } while (!db->segments[0]->isCurrentFile());
+  return db.release();
+}
+
+void StructureDb::save(const std::string &newPath) {
+  adoptMerged();
+  if (newPath == path) { // append the in-memory entries as the next segment
+    if (hashes.empty())
+      return;
+    auto appendSegments = listAppendSegments(path);
+    auto numAppendSegments = appendSegments.size() + 1;
+    auto nextNo = std::max(lastSegmentNo, appendSegments.empty() ? 0 : appendSegments.back().first) + 1;
+    std::vector<std::pair<unsigned,unsigned>> sorted;
+    for (unsigned e = 0; e < hashes.size(); e++)
+      sorted.push_back({0, e});
+    std::stable_sort(sorted.begin(), sorted.end(), [this](const std::pair<unsigned,unsigned> &e1, const std::pair<unsigned,unsigned> &e2) {
+      return hashes[e1.second] < hashes[e2.second];
+    });
+    auto mem = memEntries();
+    auto fname = path + "." + std::to_string(nextNo);
+    writeSegment(fname, {&mem}, sorted, numShadowing, 0/*lastMergedNo*/);
+    segments.emplace_back(new Segment(fname));
+    lastSegmentNo = nextNo;
+    clearMemory();
+    if (numAppendSegments > MAX_APPEND_SEGMENTS)
+      mergeInBackground();
+  } else { // everything into one file
+    joinMerger();
+    auto mem = memEntries();
+    std::vector<const Entries*> sources = {&mem};
+    for (auto it = segments.rbegin(); it != segments.rend(); it++)
+      sources.push_back(&(*it)->getEntries());
+    writeMerged(newPath, sources, 0/*lastMergedNo*/);
+    for (auto &ns : listAppendSegments(newPath)) // left from the db that was saved there before
+      if (::unlink(ns.second.c_str()) == -1)
+        ERROR_SYSCALL1(unlink, ns.second)
+    segments.clear();
+    segments.emplace_back(new Segment(newPath));
+    lastSegmentNo = 0;
+    clearMemory();
+    path = newPath;
   }
-  return atomSignature;
 }
 
-/// StructureDb::MoleculeSignature methods
+bool StructureDb::add(const Molecule *m, const std::string &id) {
+  adoptMerged();
+  auto hash = refineColors(m, scratch);
+  auto g = moleculeGraph(m, scratch.colors.data());
+  auto e = findInMemory(g, hash);
+  if (e != NONE) {
+    ids[e] = id;
+    return false;
+  }
+  unsigned seg;
+  bool isShadowing = findInSegments(g, hash, seg, e); // segments are read-only, the new entry will replace the id
+
+  // append the entry
+  e = hashes.size();
+  hashes.push_back(hash);
+  ids.push_back(id);
+  elements.insert(elements.end(), m->elements.begin(), m->elements.end());
+  colors.insert(colors.end(), scratch.colors.begin(), scratch.colors.end());
+  atomStart.push_back(elements.size());
+  nbrOffsets.insert(nbrOffsets.end(), g.offsets, g.offsets + g.numAtoms + 1);
+  nbrs.insert(nbrs.end(), g.nbrs, g.nbrs + g.offsets[g.numAtoms]);
+  nbrStart.push_back(nbrs.size());
+  if (isShadowing)
+    numShadowing++;
+  featureIndex.add(e, memEntries().graph(e));
+
+  // index it: entries with the same hash are chained, the newest first
+  nextSameHash.push_back(NONE);
+  auto it = index.emplace(hash, e);
+  if (!it.second) {
+    nextSameHash[e] = it.first->second;
+    it.first->second = e;
+  }
+
+  return !isShadowing;
+}
+
+std::string StructureDb::find(const Molecule *m) {
+  adoptMerged();
+  auto hash = refineColors(m, scratch);
+  auto g = moleculeGraph(m, scratch.colors.data());
+  auto e = findInMemory(g, hash);
+  if (e != NONE)
+    return ids[e];
+  unsigned seg;
+  if (findInSegments(g, hash, seg, e))
+    return segments[seg]->getEntries().id(e);
+  return "";
+}
 
-bool StructureDb::MoleculeSignature::operator<(const StructureDb::MoleculeSignature &other) const {
-  if (size() < other.size())
+std::vector<std::string> StructureDb::findSubstructure(const Substructure &pattern, unsigned maxResults) {
+  adoptMerged();
+  std::vector<std::pair<uint32_t,unsigned>> required;
+  pattern.requiredFeatures(required);
+  std::vector<std::string> res;
+  std::vector<unsigned> cands;
+  // in-memory entries first, then segments from the newest, entries replaced by the newer ones are skipped
+  auto search = [&](const Entries &entries, const FeatureIndex &fi, unsigned seg) { // returns false when done
+    fi.findCandidates(required, entries.numEntries, cands);
+    for (auto e : cands) {
+      auto g = entries.graph(e);
+      if (!pattern.matches(Substructure::Target{g.numAtoms, g.elements, g.offsets, g.nbrs}))
+        continue;
+      if (seg != NONE && isShadowed(seg, entries.hashes[e], g))
+        continue;
+      res.push_back(entries.id(e));
+      if (maxResults != 0 && res.size() >= maxResults)
+        return false;
+    }
     return true;
-  else if (size() > other.size())
-    return false;
-  return false; // equal?
+  };
+  if (search(memEntries(), featureIndex, NONE))
+    for (auto seg = segments.size(); seg-- > 0;)
+      if (!search(segments[seg]->getEntries(), segments[seg]->getFeatureIndex(), seg))
+        break;
+  return res;
 }
 
-void StructureDb::MoleculeSignature::sort() {
-  // sort individual AtomSignatures
-  for (auto &as : *this)
-    as.sort();
-  // sort the array
-  std::sort(begin(), end());
+size_t StructureDb::size() const {
+  size_t sz = hashes.size() - numShadowing;
+  for (auto &s : segments)
+    sz += s->numUnique();
+  return sz;
 }
 
-std::ostream& operator<<(std::ostream &os, const StructureDb::MoleculeSignature &ms) {
-  os << "[" << ms[0];
-  for (unsigned i = 1; i < ms.size(); i++)
-    os << "," << ms[i];
-  os << "]";
-  return os;
+uint64_t StructureDb::computeMoleculeSignature(const Molecule *m) {
+  Scratch scratch;
+  return refineColors(m, scratch);
 }
 
-/// StructureDb::AtomSignature methods
+/// internals
+
+StructureDb::Entries StructureDb::memEntries() const {
+  return Entries{(unsigned)hashes.size(), hashes.data(), atomStart.data(), nbrStart.data(), nullptr,
+                 colors.data(), nbrOffsets.data(), nbrs.data(), elements.data(), nullptr, ids.data()};
+}
 
-bool StructureDb::AtomSignature::operator<(const StructureDb::AtomSignature &other) const {
-  if (elt < other.elt)
+unsigned StructureDb::findInMemory(const Graph &g, uint64_t hash) {
+  auto it = index.find(hash);
+  if (it == index.end())
+    return NONE;
+  auto mem = memEntries();
+  for (auto e = it->second; e != NONE; e = nextSameHash[e])
+    if (isIsomorphic(g, mem.graph(e), scratch))
+      return e;
+  return NONE; // hash collision
+}
+
+bool StructureDb::findInSegments(const Graph &g, uint64_t hash, unsigned &seg, unsigned &e) {
+  for (seg = segments.size(); seg-- > 0;) // newest first
+    if ((e = segments[seg]->find(g, hash, scratch)) != NONE)
+      return true;
+  return false;
+}
+
+bool StructureDb::isShadowed(unsigned seg, uint64_t hash, const Graph &g) {
+  if (findInMemory(g, hash) != NONE)
     return true;
-  else if (elt > other.elt)
+  for (auto s = seg + 1; s < segments.size(); s++)
+    if (segments[s]->find(g, hash, scratch) != NONE)
+      return true;
+  return false;
+}
+
+void StructureDb::clearMemory() {
+  hashes.clear();
+  atomStart.assign(1, 0);
+  nbrStart.assign(1, 0);
+  colors.clear();
+  nbrOffsets.clear();
+  nbrs.clear();
+  elements.clear();
+  ids.clear();
+  numShadowing = 0;
+  index.clear();
+  nextSameHash.clear();
+  featureIndex.clear();
+}
+
+void StructureDb::mergeInBackground() {
+  joinMerger();
+  // the merge maps the files itself, segments of this object stay valid because unlinked files remain mapped,
+  // they are all merged: this process is the only one saving into the path
+  std::vector<std::string> fnames = {path};
+  for (unsigned s = 1; s < segments.size(); s++)
+    fnames.push_back(segments[s]->getFname());
+  numMerging = segments.size();
+  mergeDone = false;
+  auto lastMergedNo = lastSegmentNo;
+  merger = std::thread([this,fnames,lastMergedNo]() {
+    std::vector<std::unique_ptr<Segment>> merged;
+    std::vector<const Entries*> sources;
+    for (auto it = fnames.rbegin(); it != fnames.rend(); it++) {
+      merged.emplace_back(new Segment(*it));
+      sources.push_back(&merged.back()->getEntries());
+    }
+    writeMerged(fnames[0], sources, lastMergedNo);
+    for (unsigned i = 1; i < fnames.size(); i++)
+      if (::unlink(fnames[i].c_str()) == -1)
+        ERROR_SYSCALL1(unlink, fnames[i])
+    mergeDone = true;
+  });
+}
+
+void StructureDb::joinMerger() {
+  if (!merger.joinable())
+    return;
+  merger.join();
+  mergeDone = false;
+  segments.erase(segments.begin(), segments.begin() + numMerging);
+  segments.emplace(segments.begin(), new Segment(path));
+}
+
+std::vector<std::pair<unsigned,std::string>> StructureDb::listAppendSegments(const std::string &path) {
+  auto slash = path.rfind('/');
+  auto dir = slash == std::string::npos ? std::string(".") : path.substr(0, slash + 1);
+  auto prefix = (slash == std::string::npos ? path : path.substr(slash + 1)) + ".";
+  std::vector<std::pair<unsigned,std::string>> found;
+  auto d = ::opendir(dir.c_str());
+  if (d == nullptr)
+    ERROR_SYSCALL1(opendir, dir)
+  while (auto de = ::readdir(d)) {
+    std::string name(de->d_name);
+    if (name.size() <= prefix.size() || name.size() > prefix.size() + 9 || name.compare(0, prefix.size(), prefix) != 0)
+      continue;
+    auto no = name.substr(prefix.size());
+    if (std::all_of(no.begin(), no.end(), [](char c) {return c >= '0' && c <= '9';}))
+      found.push_back({std::stoul(no), path + "." + no});
+  }
+  ::closedir(d);
+  std::sort(found.begin(), found.end());
+  return found;
+}
+
+void StructureDb::writeSegment(const std::string &fname, const std::vector<const Entries*> &sources,
+                               const std::vector<std::pair<unsigned,unsigned>> &entries, unsigned numShadowing, unsigned lastMergedNo)
+{
+  // write into a temporary file and rename it so that readers never see a partial file
+  auto tmpFname = fname + ".tmp";
+  std::ofstream file(tmpFname, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file)
+    ERROR("can't open the file for writing: " << tmpFname)
+  auto write = [&file](const void *p, size_t bytes) {
+    file.write((const char*)p, bytes);
+  };
+  auto numAtoms = [&sources](const std::pair<unsigned,unsigned> &se) {
+    return sources[se.first]->atomStart[se.second + 1] - sources[se.first]->atomStart[se.second];
+  };
+  auto numNbrs = [&sources](const std::pair<unsigned,unsigned> &se) {
+    return sources[se.first]->nbrStart[se.second + 1] - sources[se.first]->nbrStart[se.second];
+  };
+  auto idSize = [&sources](const std::pair<unsigned,unsigned> &se) {
+    return (uint64_t)sources[se.first]->idSize(se.second);
+  };
+
+  // header
+  FileHeader h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, fileMagic, sizeof(fileMagic));
+  h.version = FILE_VERSION;
+  h.numEntries = entries.size();
+  h.numShadowing = numShadowing;
+  h.lastMergedNo = lastMergedNo;
+  for (auto &se : entries) {
+    h.numAtoms += numAtoms(se);
+    h.numNbrs += numNbrs(se);
+    h.idsSize += idSize(se);
+  }
+  write(&h, sizeof(h));
+
+  // arrays
+  for (auto &se : entries)
+    write(&sources[se.first]->hashes[se.second], sizeof(uint64_t));
+  auto writeStarts = [&](auto len) {
+    uint64_t start = 0;
+    write(&start, sizeof(start));
+    for (auto &se : entries) {
+      start += len(se);
+      write(&start, sizeof(start));
+    }
+  };
+  writeStarts(numAtoms);
+  writeStarts(numNbrs);
+  writeStarts(idSize);
+  for (auto &se : entries)
+    write(sources[se.first]->colors + sources[se.first]->atomStart[se.second], numAtoms(se)*sizeof(uint64_t));
+  for (auto &se : entries)
+    write(sources[se.first]->nbrOffsets + sources[se.first]->atomStart[se.second] + se.second, (numAtoms(se) + 1)*sizeof(unsigned));
+  for (auto &se : entries)
+    write(sources[se.first]->nbrs + sources[se.first]->nbrStart[se.second], numNbrs(se)*sizeof(unsigned));
+  for (auto &se : entries)
+    write(sources[se.first]->elements + sources[se.first]->atomStart[se.second], numAtoms(se));
+  for (auto &se : entries)
+    write(sources[se.first]->idData(se.second), idSize(se));
+
+  file.close();
+  if (!file)
+    ERROR("failed to write the file " << tmpFname)
+  if (::rename(tmpFname.c_str(), fname.c_str()) == -1)
+    ERROR_SYSCALL1(rename, tmpFname << " -> " << fname)
+}
+
+void StructureDb::writeMerged(const std::string &fname, const std::vector<const Entries*> &sources, unsigned lastMergedNo) {
+  // sources are sorted by the hash except for the in-memory one
+  std::vector<std::vector<unsigned>> orders(sources.size()); // empty when already sorted
+  for (unsigned s = 0; s < sources.size(); s++)
+    if (sources[s]->idStrings) {
+      auto &src = *sources[s];
+      auto &order = orders[s];
+      for (unsigned e = 0; e < src.numEntries; e++)
+        order.push_back(e);
+      std::stable_sort(order.begin(), order.end(), [&src](unsigned e1, unsigned e2) {return src.hashes[e1] < src.hashes[e2];});
+    }
+  auto entryAt = [&orders](unsigned s, unsigned pos) {return orders[s].empty() ? pos : orders[s][pos];};
+
+  // k-way merge, among the isomorphic entries only the one from the newest source is kept
+  Scratch scratch;
+  std::vector<unsigned> pos(sources.size(), 0);
+  std::vector<std::pair<unsigned,unsigned>> merged;
+  std::vector<std::pair<unsigned,unsigned>> group;
+  while (true) {
+    bool any = false;
+    uint64_t hash = 0;
+    for (unsigned s = 0; s < sources.size(); s++)
+      if (pos[s] < sources[s]->numEntries) {
+        auto h = sources[s]->hashes[entryAt(s, pos[s])];
+        if (!any || h < hash) {
+          hash = h;
+          any = true;
+        }
+      }
+    if (!any)
+      break;
+    group.clear();
+    for (unsigned s = 0; s < sources.size(); s++)
+      for (; pos[s] < sources[s]->numEntries && sources[s]->hashes[entryAt(s, pos[s])] == hash; pos[s]++) {
+        auto e = entryAt(s, pos[s]);
+        auto g = sources[s]->graph(e);
+        if (std::none_of(group.begin(), group.end(), [&](const std::pair<unsigned,unsigned> &ge) {
+              return isIsomorphic(g, sources[ge.first]->graph(ge.second), scratch);
+            }))
+          group.push_back({s, e});
+      }
+    merged.insert(merged.end(), group.begin(), group.end());
+  }
+
+  writeSegment(fname, sources, merged, 0/*numShadowing*/, lastMergedNo);
+}
+
+StructureDb::Graph StructureDb::moleculeGraph(const Molecule *m, const uint64_t *colors) {
+  auto &graph = m->getBondGraph();
+  return Graph{m->numAtoms(), m->elements.data(), graph.offsets.data(), graph.nbrs.data(), colors};
+}
+
+uint64_t StructureDb::refineColors(const Molecule *m, Scratch &scratch) {
+  // iterative neighborhood refinement (Weisfeiler-Lehman): the color of an atom is repeatedly combined with the sorted colors
+  // of its neighbors until the number of distinct colors stops growing, which doesn't depend on the order of atoms
+  auto &graph = m->getBondGraph();
+  auto n = m->numAtoms();
+  auto &c = scratch.colors;
+  auto &nc = scratch.nextColors;
+  auto &buf = scratch.sorted;
+  c.resize(n);
+  nc.resize(n);
+  for (unsigned a = 0; a < n; a++)
+    c[a] = Util::mix64((uint64_t(m->elements[a]) << 32) + graph.degree(a) + 1);
+  auto numColors = countDistinct(c, buf);
+  unsigned rounds = 0;
+  while (numColors < n) { // all atoms being distinct can't be refined further
+    for (unsigned a = 0; a < n; a++) {
+      buf.clear();
+      for (auto nb : graph.neighbors(a))
+        buf.push_back(c[nb]);
+      std::sort(buf.begin(), buf.end());
+      auto h = c[a];
+      for (auto nbc : buf)
+        h = Util::mix64(h ^ nbc);
+      nc[a] = h;
+    }
+    auto newNumColors = countDistinct(nc, buf);
+    if (newNumColors == numColors)
+      break; // stable partition
+    c.swap(nc);
+    numColors = newNumColors;
+    rounds++;
+  }
+
+  // combine the colors independently of the order of atoms
+  uint64_t sum = 0;
+  for (auto ac : c)
+    sum += Util::mix64(ac);
+  return Util::mix64(Util::mix64(Util::mix64(sum) ^ n) ^ ((uint64_t(graph.numBonds()) << 32) + rounds));
+}
+
+bool StructureDb::isIsomorphic(const Graph &g1, const Graph &g2, Scratch &scratch) {
+  auto n = g1.numAtoms;
+  if (n != g2.numAtoms)
     return false;
-  if (neighbors.size() < other.neighbors.size())
+  if (n == 0)
     return true;
-  else if (neighbors.size() > other.neighbors.size())
+  if (g1.offsets[n] - g1.offsets[0] != g2.offsets[n] - g2.offsets[0])
     return false;
-  for (unsigned i = 0; i < neighbors.size(); i++)
-    if (neighbors[i] < other.neighbors[i])
+
+  // order atoms of g1 breadth-first so that every atom but the component roots has an earlier mapped neighbor
+  auto &order = scratch.order;
+  auto &orderParent = scratch.orderParent;
+  auto &map = scratch.map;   // g1 -> g2
+  auto &rmap = scratch.rmap; // g2 -> g1
+  auto &candPos = scratch.candPos;
+  order.clear();
+  orderParent.clear();
+  map.assign(n, NONE);
+  for (unsigned r = 0; r < n; r++)
+    if (map[r] == NONE) {
+      map[r] = 0; // visited
+      order.push_back(r);
+      orderParent.push_back(NONE);
+      for (auto k = order.size() - 1; k < order.size(); k++)
+        for (auto p = g1.offsets[order[k]], pe = g1.offsets[order[k]+1]; p < pe; p++)
+          if (map[g1.nbrs[p]] == NONE) {
+            map[g1.nbrs[p]] = 0;
+            order.push_back(g1.nbrs[p]);
+            orderParent.push_back(order[k]);
+          }
+    }
+  map.assign(n, NONE);
+  rmap.assign(n, NONE);
+  candPos.assign(n, 0);
+
+  // backtracking without recursion: candidates for an atom are the neighbors of its parent's image, or all atoms for roots
+  unsigned k = 0;
+  while (true) {
+    if (k == n)
       return true;
-    else if (other.neighbors[i] < neighbors[i])
+    auto q = order[k];
+    auto parent = orderParent[k];
+    unsigned numCands = parent != NONE ? g2.degree(map[parent]) : n;
+    bool found = false;
+    while (candPos[k] < numCands) {
+      auto c = parent != NONE ? g2.nbrs[g2.offsets[map[parent]] + candPos[k]] : candPos[k];
+      candPos[k]++;
+      if (rmap[c] != NONE || g1.colors[q] != g2.colors[c] || g1.elements[q] != g2.elements[c] || g1.degree(q) != g2.degree(c))
+        continue;
+      // bonds to the already mapped atoms have to be preserved
+      bool consistent = true;
+      for (auto p = g1.offsets[q], pe = g1.offsets[q+1]; p < pe && consistent; p++) {
+        auto qn = g1.nbrs[p];
+        if (map[qn] != NONE && !g2.isBond(c, map[qn]))
+          consistent = false;
+      }
+      if (consistent) {
+        map[q] = c;
+        rmap[c] = q;
+        found = true;
+        break;
+      }
+    }
+    if (found) {
+      if (++k < n)
+        candPos[k] = 0;
+      continue;
+    }
+    // backtrack
+    if (k == 0)
       return false;
-  return false; // equal?
+    k--;
+    rmap[map[order[k]]] = NONE;
+    map[order[k]] = NONE;
+  }
 }
 
-void StructureDb::AtomSignature::sort() {
-  std::sort(neighbors.begin(), neighbors.end());
+/// StructureDb::Graph
+
+bool StructureDb::Graph::isBond(unsigned i, unsigned j) const {
+  for (auto p = offsets[i], pe = offsets[i+1]; p < pe; p++)
+    if (nbrs[p] == j)
+      return true;
+  return false;
 }
 
-std::ostream& operator<<(std::ostream &os, const StructureDb::AtomSignature &as) {
-  os << "{elt: \"" << as.elt << "\"";
-  if (!as.neighbors.empty()) {
-    os << ", n: [" << as.neighbors[0];
-    for (unsigned i = 1; i < as.neighbors.size(); i++)
-      os << "," << as.neighbors[i];
-    os << "]";
+/// StructureDb::Entries
+
+StructureDb::Graph StructureDb::Entries::graph(unsigned e) const {
+  auto a = atomStart[e];
+  return Graph{unsigned(atomStart[e+1] - a), elements + a, nbrOffsets + a + e, nbrs + nbrStart[e], colors + a};
+}
+
+/// StructureDb::FeatureIndex
+
+void StructureDb::FeatureIndex::add(unsigned e, const Graph &g) {
+  std::vector<uint32_t> features;
+  for (unsigned a = 0; a < g.numAtoms; a++) {
+    features.push_back(Substructure::elementFeature(g.elements[a]));
+    for (auto p = g.offsets[a], pe = g.offsets[a+1]; p < pe; p++)
+      if (a < g.nbrs[p])
+        features.push_back(Substructure::bondFeature(g.elements[a], g.elements[g.nbrs[p]]));
+  }
+  std::sort(features.begin(), features.end());
+  for (unsigned i = 0, j; i < features.size(); i = j) {
+    for (j = i + 1; j < features.size() && features[j] == features[i]; j++) { }
+    postings[features[i]].push_back({e, j - i});
+  }
+}
+
+void StructureDb::FeatureIndex::findCandidates(const std::vector<std::pair<uint32_t,unsigned>> &required, unsigned numEntries, std::vector<unsigned> &cands) const {
+  cands.clear();
+  if (required.empty()) {
+    for (unsigned e = 0; e < numEntries; e++)
+      cands.push_back(e);
+    return;
+  }
+  // walk the shortest posting list and look the entries up in the other ones
+  std::vector<const std::vector<std::pair<unsigned,unsigned>>*> lists;
+  unsigned shortest = 0;
+  for (auto &r : required) {
+    auto it = postings.find(r.first);
+    if (it == postings.end())
+      return; // no entry has this feature
+    if (lists.empty() || it->second.size() < lists[shortest]->size())
+      shortest = lists.size();
+    lists.push_back(&it->second);
+  }
+  for (auto &ec : *lists[shortest]) {
+    if (ec.second < required[shortest].second)
+      continue;
+    bool ok = true;
+    for (unsigned i = 0; i < lists.size() && ok; i++)
+      if (i != shortest) {
+        auto it = std::lower_bound(lists[i]->begin(), lists[i]->end(), std::make_pair(ec.first, 0u));
+        ok = it != lists[i]->end() && it->first == ec.first && it->second >= required[i].second;
+      }
+    if (ok)
+      cands.push_back(ec.first);
   }
-  os << "}";
-  return os;
 }
 
+/// StructureDb::Segment
+
+StructureDb::Segment::Segment(const std::string &newFname, int fd)
+: fname(newFname),
+  addr(nullptr),
+  size(0)
+{
+  if (fd == -1)
+    fd = ::open(fname.c_str(), O_RDONLY);
+  if (fd == -1)
+    ERROR_SYSCALL1(open, "can't open the structure-db file for reading: " << fname)
+  struct stat st;
+  if (::fstat(fd, &st) == -1)
+    ERROR_SYSCALL1(fstat, "file " << fname)
+  size = st.st_size;
+  dev = st.st_dev;
+  ino = st.st_ino;
+  if (size < sizeof(FileHeader))
+    ERROR("the structure-db file " << fname << " is too short")
+  addr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0); // shared: processes use the same page cache
+  if (addr == MAP_FAILED)
+    ERROR_SYSCALL1(mmap, "file " << fname)
+  ::madvise(addr, size, MADV_RANDOM); // only a hint: lookups touch few pages
+  ::close(fd);
+
+  // validate the header
+  auto &h = *(const FileHeader*)addr;
+  if (std::memcmp(h.magic, fileMagic, sizeof(fileMagic)) != 0)
+    ERROR("not a structure-db file: " << fname)
+  if (h.version != FILE_VERSION)
+    ERROR("the structure-db file " << fname << " has the unsupported version " << h.version)
+  if (fileSize(h) != size)
+    ERROR("the structure-db file " << fname << " has the size " << size << ", expected " << fileSize(h))
+  numShadowing = h.numShadowing;
+  lastMergedNo = h.lastMergedNo;
+
+  // arrays
+  auto p = (const uint8_t*)addr + sizeof(FileHeader);
+  auto take = [&p](uint64_t bytes) {
+    auto a = p;
+    p += bytes;
+    return a;
+  };
+  entries.numEntries = h.numEntries;
+  entries.hashes     = (const uint64_t*)take(8*uint64_t(h.numEntries));
+  entries.atomStart  = (const uint64_t*)take(8*(uint64_t(h.numEntries) + 1));
+  entries.nbrStart   = (const uint64_t*)take(8*(uint64_t(h.numEntries) + 1));
+  entries.idStart    = (const uint64_t*)take(8*(uint64_t(h.numEntries) + 1));
+  entries.colors     = (const uint64_t*)take(8*h.numAtoms);
+  entries.nbrOffsets = (const unsigned*)take(4*(h.numAtoms + h.numEntries));
+  entries.nbrs       = (const unsigned*)take(4*h.numNbrs);
+  entries.elements   = take(h.numAtoms);
+  entries.idChars    = (const char*)take(h.idsSize);
+  entries.idStrings  = nullptr;
+}
+
+StructureDb::Segment::~Segment() {
+  ::munmap(addr, size);
+}
+
+bool StructureDb::Segment::isCurrentFile() const {
+  struct stat st;
+  return ::stat(fname.c_str(), &st) == 0 && uint64_t(st.st_dev) == dev && uint64_t(st.st_ino) == ino;
+}
+
+unsigned StructureDb::Segment::find(const Graph &g, uint64_t hash, Scratch &scratch) const {
+  auto b = entries.hashes, e = b + entries.numEntries;
+  for (auto it = std::lower_bound(b, e, hash); it < e && *it == hash; it++)
+    if (isIsomorphic(g, entries.graph(it - b), scratch))
+      return it - b;
+  return NONE;
+}
+
+const StructureDb::FeatureIndex& StructureDb::Segment::getFeatureIndex() const {
+  if (!featureIndex) {
+    featureIndex.reset(new FeatureIndex);
+    for (unsigned e = 0; e < entries.numEntries; e++)
+      featureIndex->add(e, entries.graph(e));
+  }
+  return *featureIndex;
+}
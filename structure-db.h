@@ -1,43 +1,135 @@
 #pragma once
 
 #include "molecule.h"
+#include "substructure.h"
 
 #include <string>
 #include <vector>
-#include <map>
-#include <ostream>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include <cstdint>
+
+//
+// StructureDb: set of molecular structures (bond graphs with elements) identified up to the order of atoms,
+//              every structure has a 64-bit canonical hash, hash hits are verified with the exact graph isomorphism check
+//
+//              Structures are kept in memory and in the read-only memory-mapped segment files sorted by the hash:
+//              the main file <path> and the append segments <path>.1, <path>.2, ... written by save(),
+//              append segments are merged into the main file in background when there are too many of them.
+//              Append segment numbers grow across merges, the main file records the last number merged into it.
+//              Only one process should save into the same path, any number of processes can open it.
+//
 
 class StructureDb {
-  enum {STACK_SZ = 3}; // how far are we looking out
-private: // structs
-  class AtomSignature;
-  class MoleculeSignature : public std::vector<AtomSignature> { // an array of AtomSignature objects
+  enum {NONE = ~0u};
+  enum {MAX_APPEND_SEGMENTS = 4};
+  struct Graph { // flat view of a bond graph, of either a stored entry or a query molecule
+    unsigned        numAtoms;
+    const uint8_t  *elements;
+    const unsigned *offsets; // neighbors of the atom i are nbrs[offsets[i]..offsets[i+1])
+    const unsigned *nbrs;
+    const uint64_t *colors;  // refined atom colors
+    unsigned degree(unsigned i) const {return offsets[i+1] - offsets[i];}
+    bool isBond(unsigned i, unsigned j) const;
+  }; // Graph
+  struct Scratch { // buffers reused between the computations so that add/find don't allocate
+    std::vector<uint64_t> colors;
+    std::vector<uint64_t> nextColors;
+    std::vector<uint64_t> sorted;
+    std::vector<unsigned> order, orderParent, map, rmap, candPos;
+  }; // Scratch
+  struct Entries { // flat arrays of the entries, either in memory or in a segment file
+    unsigned           numEntries;
+    const uint64_t    *hashes;
+    const uint64_t    *atomStart;   // numEntries+1, into colors and elements
+    const uint64_t    *nbrStart;    // numEntries+1, into nbrs
+    const uint64_t    *idStart;     // numEntries+1, into idChars
+    const uint64_t    *colors;      // per atom
+    const unsigned    *nbrOffsets;  // numAtoms+1 per entry, relative to nbrStart of the entry
+    const unsigned    *nbrs;        // entry-local atom indexes
+    const uint8_t     *elements;    // per atom
+    const char        *idChars;
+    const std::string *idStrings;   // in-memory entries have ids here instead of idStart/idChars
+    Graph graph(unsigned e) const;
+    const char* idData(unsigned e) const {return idStrings ? idStrings[e].data() : idChars + idStart[e];}
+    size_t idSize(unsigned e) const {return idStrings ? idStrings[e].size() : idStart[e+1] - idStart[e];}
+    std::string id(unsigned e) const {return std::string(idData(e), idSize(e));}
+  }; // Entries
+  class FeatureIndex { // inverted index of entries by the counts of elements and bond element pairs, for the substructure search
+    std::unordered_map<uint32_t, std::vector<std::pair<unsigned,unsigned>>> postings; // feature -> (entry, count) in the order of entries
   public:
-    bool operator<(const MoleculeSignature &other) const;
-    void sort();
-    friend std::ostream& operator<<(std::ostream &os, const MoleculeSignature &ms);
-  }; // MoleculeSignature
-  class AtomSignature {
-    Element elt;           // atom element
-    std::vector<AtomSignature> neighbors;
+    void add(unsigned e, const Graph &g);
+    void findCandidates(const std::vector<std::pair<uint32_t,unsigned>> &required, unsigned numEntries, std::vector<unsigned> &cands) const;
+    void clear() {postings.clear();}
+  }; // FeatureIndex
+  class Segment { // read-only memory-mapped segment file, entries are sorted by the hash
+    std::string fname;
+    void       *addr;
+    size_t      size;
+    Entries     entries;
+    unsigned    numShadowing; // entries that replace the ids of the isomorphic entries in the older segments
+    unsigned    lastMergedNo; // the main file: the last append segment merged into it
+    uint64_t    dev, ino;     // of the mapped file
+    mutable std::unique_ptr<FeatureIndex> featureIndex; // built on the first substructure search
   public:
-    AtomSignature(Element newElt) : elt(newElt) { }
-    void addNeighbor(const AtomSignature &neighbor) {neighbors.push_back(neighbor);}
-    bool operator<(const AtomSignature &other) const;
-    void sort();
-    friend std::ostream& operator<<(std::ostream &os, const AtomSignature &as);
-  }; // AtomSignature
+    Segment(const std::string &newFname, int fd = -1); // takes over fd when it's given
+    Segment(const Segment&) = delete;
+    ~Segment();
+    const std::string& getFname() const {return fname;}
+    const Entries& getEntries() const {return entries;}
+    unsigned getLastMergedNo() const {return lastMergedNo;}
+    bool isCurrentFile() const; // the file name still refers to the mapped file
+    unsigned numUnique() const {return entries.numEntries - numShadowing;}
+    unsigned find(const Graph &g, uint64_t hash, Scratch &scratch) const;
+    const FeatureIndex& getFeatureIndex() const;
+  }; // Segment
 private: // data
-  std::map<MoleculeSignature, std::string> signatures;
+  std::string                           path;         // file that the db was opened from or saved into, empty when it is only in memory
+  std::vector<std::unique_ptr<Segment>> segments;     // the main file first, then append segments
+  unsigned                              lastSegmentNo; // the last append segment number used
+  // in-memory entries in the order of addition, in the Entries layout
+  std::vector<uint64_t>    hashes;
+  std::vector<uint64_t>    atomStart;
+  std::vector<uint64_t>    nbrStart;
+  std::vector<uint64_t>    colors;
+  std::vector<unsigned>    nbrOffsets;
+  std::vector<unsigned>    nbrs;
+  std::vector<uint8_t>     elements;
+  std::vector<std::string> ids;
+  unsigned                 numShadowing;
+  std::unordered_map<uint64_t, unsigned> index; // hash -> the first in-memory entry with this hash
+  std::vector<unsigned>    nextSameHash; // per entry, chains entries with equal hashes
+  FeatureIndex             featureIndex; // of the in-memory entries
+  Scratch                  scratch;     // makes add/find not thread-safe
+  std::thread              merger;      // background merge of the segment files
+  unsigned                 numMerging;  // the first segments that are being merged
+  std::atomic<bool>        mergeDone;
 public: // constr/iface
   StructureDb();
-  void add(const Molecule *m, const std::string &id);
-  std::string find(const Molecule *m);
-  size_t size() const {return signatures.size();}
-  static const MoleculeSignature computeMoleculeSignature(const Molecule *m);
+  ~StructureDb();
+  static StructureDb* open(const std::string &path); // O(1): only maps the segment files
+  void save(const std::string &path); // appends a segment when saved to the same path again, otherwise writes everything into one file
+  bool add(const Molecule *m, const std::string &id); // returns false when the structure was already present, its id is replaced then
+  std::string find(const Molecule *m); // returns the empty string when not found
+  std::vector<std::string> findSubstructure(const Substructure &pattern, unsigned maxResults); // ids of the structures containing the pattern, maxResults=0 is unlimited
+  size_t size() const;
+  static uint64_t computeMoleculeSignature(const Molecule *m); // canonical hash, doesn't depend on the order of atoms
 private: // internals
-  static const AtomSignature computeAtomSignature(const Atom *m);
-  static const AtomSignature computeAtomNeighborSignature(const Atom *m, std::array<const Atom*, STACK_SZ> &stack, unsigned depth, unsigned maxDepth);
-  friend std::ostream& operator<<(std::ostream &os, const MoleculeSignature &ms);
-  friend std::ostream& operator<<(std::ostream &os, const AtomSignature &as);
+  Entries memEntries() const;
+  unsigned findInMemory(const Graph &g, uint64_t hash);
+  bool findInSegments(const Graph &g, uint64_t hash, unsigned &seg, unsigned &e);
+  void clearMemory();
+  void mergeInBackground();
+  void joinMerger(); // the merged file replaces the segments it was merged from
+  void adoptMerged() {if (mergeDone) joinMerger();}
+  static std::vector<std::pair<unsigned,std::string>> listAppendSegments(const std::string &path); // (number, file name) in the order of numbers
+  static void writeSegment(const std::string &fname, const std::vector<const Entries*> &sources,
+                           const std::vector<std::pair<unsigned,unsigned>> &entries, unsigned numShadowing, unsigned lastMergedNo);
+  static void writeMerged(const std::string &fname, const std::vector<const Entries*> &sources, unsigned lastMergedNo); // sources are newest first
+  bool isShadowed(unsigned seg, uint64_t hash, const Graph &g);
+  static Graph moleculeGraph(const Molecule *m, const uint64_t *colors);
+  static uint64_t refineColors(const Molecule *m, Scratch &scratch); // leaves the colors in scratch.colors, returns the hash
+  static bool isIsomorphic(const Graph &g1, const Graph &g2, Scratch &scratch);
 }; // StructureDb
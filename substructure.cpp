@@ -0,0 +1,211 @@
+#include "substructure.h"
+
+#include <set>
+
+enum {NONE = ~0u};
+
+/// Substructure
+
+Substructure::Substructure(const Molecule *pattern) {
+  auto &graph = pattern->getBondGraph();
+  for (unsigned a = 0, ae = pattern->numAtoms(); a < ae; a++)
+    atoms.push_back(AtomConstraint{pattern->elements[a], ANY, ANY});
+  offsets.assign(graph.offsets.begin(), graph.offsets.end());
+  nbrs.assign(graph.nbrs.begin(), graph.nbrs.end());
+}
+
+std::vector<std::vector<unsigned>> Substructure::findMatches(const Molecule *m, unsigned maxMatches, bool uniqueAtomSets) const {
+  auto &graph = m->getBondGraph();
+  return findMatches(Target{m->numAtoms(), m->elements.data(), graph.offsets.data(), graph.nbrs.data()}, maxMatches, uniqueAtomSets);
+}
+
+std::vector<std::vector<unsigned>> Substructure::findMatches(const Target &t, unsigned maxMatches, bool uniqueAtomSets) const {
+  std::vector<std::vector<unsigned>> res;
+  unsigned n = atoms.size();
+  if (n == 0 || n > t.numAtoms)
+    return res;
+
+  // target ring membership is only computed when it is constrained
+  std::vector<bool> inRing;
+  if (std::any_of(atoms.begin(), atoms.end(), [](const AtomConstraint &ac) {return ac.ring != ANY;}))
+    inRing = findRingAtoms(t);
+  auto atomMatches = [this,&t,&inRing](unsigned q, unsigned c) {
+    auto &ac = atoms[q];
+    auto tdegree = t.offsets[c+1] - t.offsets[c];
+    return (ac.elt == 0 || ac.elt == t.elements[c])
+           && (ac.degree == ANY ? tdegree >= degree(q) : tdegree == (unsigned)ac.degree)
+           && (ac.ring == ANY || inRing[c] == (ac.ring != 0));
+  };
+  auto isBond = [&t](unsigned i, unsigned j) {
+    for (auto p = t.offsets[i], pe = t.offsets[i+1]; p < pe; p++)
+      if (t.nbrs[p] == j)
+        return true;
+    return false;
+  };
+
+  std::vector<unsigned> order, orderParent;
+  computeOrder(order, orderParent);
+
+  // depth-first search over the partial mappings without recursion: candidates for an atom are the unused neighbors
+  // of its parent's image that satisfy the atom constraints and have bonds to the images of all mapped pattern neighbors
+  std::vector<unsigned> map(n, NONE), candPos(n, 0);
+  std::vector<bool> used(t.numAtoms, false);
+  std::set<std::vector<unsigned>> atomSets;
+  unsigned k = 0;
+  while (true) {
+    if (k == n) { // complete match
+      if (uniqueAtomSets) {
+        auto atomSet = map;
+        std::sort(atomSet.begin(), atomSet.end());
+        if (atomSets.insert(atomSet).second)
+          res.push_back(map);
+      } else {
+        res.push_back(map);
+      }
+      if (maxMatches != 0 && res.size() >= maxMatches)
+        break;
+      // look for the next one
+      k--;
+      used[map[order[k]]] = false;
+      map[order[k]] = NONE;
+      continue;
+    }
+    auto q = order[k];
+    auto parent = orderParent[k];
+    unsigned numCands = parent != NONE ? t.offsets[map[parent]+1] - t.offsets[map[parent]] : t.numAtoms;
+    bool found = false;
+    while (candPos[k] < numCands) {
+      auto c = parent != NONE ? t.nbrs[t.offsets[map[parent]] + candPos[k]] : candPos[k];
+      candPos[k]++;
+      if (used[c] || !atomMatches(q, c))
+        continue;
+      bool consistent = true;
+      for (auto p = offsets[q], pe = offsets[q+1]; p < pe && consistent; p++)
+        if (map[nbrs[p]] != NONE && !isBond(c, map[nbrs[p]]))
+          consistent = false;
+      if (consistent) {
+        map[q] = c;
+        used[c] = true;
+        found = true;
+        break;
+      }
+    }
+    if (found) {
+      if (++k < n)
+        candPos[k] = 0;
+      continue;
+    }
+    // backtrack
+    if (k == 0)
+      break;
+    k--;
+    used[map[order[k]]] = false;
+    map[order[k]] = NONE;
+  }
+
+  return res;
+}
+
+void Substructure::requiredFeatures(std::vector<std::pair<uint32_t,unsigned>> &features) const {
+  std::vector<uint32_t> all;
+  for (unsigned a = 0; a < atoms.size(); a++)
+    if (atoms[a].elt != 0) {
+      all.push_back(elementFeature(atoms[a].elt));
+      for (auto p = offsets[a], pe = offsets[a+1]; p < pe; p++)
+        if (a < nbrs[p] && atoms[nbrs[p]].elt != 0)
+          all.push_back(bondFeature(atoms[a].elt, atoms[nbrs[p]].elt));
+    }
+  std::sort(all.begin(), all.end());
+  features.clear();
+  for (unsigned i = 0; i < all.size(); i++)
+    if (i == 0 || all[i] != all[i-1])
+      features.push_back({all[i], 1});
+    else
+      features.back().second++;
+}
+
+std::vector<bool> Substructure::findRingAtoms(const Target &t) {
+  // atoms with at least one bond that isn't a bridge
+  auto inRingBond = findRingBonds(t);
+  std::vector<bool> inRing(t.numAtoms, false);
+  for (unsigned a = 0; a < t.numAtoms; a++)
+    for (auto p = t.offsets[a], pe = t.offsets[a+1]; p < pe && !inRing[a]; p++)
+      inRing[a] = inRingBond[p];
+  return inRing;
+}
+
+std::vector<bool> Substructure::findRingBonds(const Target &t) {
+  // bonds that aren't bridges, bridges are found by the iterative Tarjan's lowlink search
+  auto n = t.numAtoms;
+  std::vector<bool> inRing(t.offsets[n], false);
+  std::vector<unsigned> disc(n, NONE), low(n), parent(n, NONE), parentSlot(n), next(n), stack;
+  auto markBoth = [&t,&inRing](unsigned a, unsigned p) { // the slot p of a, and the reverse one
+    inRing[p] = true;
+    auto b = t.nbrs[p];
+    for (auto q = t.offsets[b], qe = t.offsets[b+1]; q < qe; q++)
+      if (t.nbrs[q] == a)
+        inRing[q] = true;
+  };
+  unsigned time = 0;
+  for (unsigned r = 0; r < n; r++) {
+    if (disc[r] != NONE)
+      continue;
+    disc[r] = low[r] = time++;
+    next[r] = t.offsets[r];
+    stack.push_back(r);
+    while (!stack.empty()) {
+      auto v = stack.back();
+      if (next[v] < t.offsets[v+1]) {
+        auto p = next[v]++;
+        auto w = t.nbrs[p];
+        if (disc[w] == NONE) {
+          parent[w] = v;
+          parentSlot[w] = p;
+          disc[w] = low[w] = time++;
+          next[w] = t.offsets[w];
+          stack.push_back(w);
+        } else if (w != parent[v]) { // back bond: always on a cycle
+          low[v] = std::min(low[v], disc[w]);
+          markBoth(v, p);
+        }
+      } else {
+        stack.pop_back();
+        auto p = parent[v];
+        if (p != NONE) {
+          low[p] = std::min(low[p], low[v]);
+          if (low[v] <= disc[p]) // the bond p-v is on a cycle
+            markBoth(p, parentSlot[v]);
+        }
+      }
+    }
+  }
+  return inRing;
+}
+
+/// internals
+
+void Substructure::computeOrder(std::vector<unsigned> &order, std::vector<unsigned> &orderParent) const {
+  // breadth-first from the most selective atom of every component: a specific uncommon element, then more bonds
+  auto n = atoms.size();
+  auto selectivity = [this](unsigned a) {
+    auto elt = atoms[a].elt;
+    return (elt != 0 ? 2000 : 0) + (elt != 0 && elt != uint8_t(C) && elt != uint8_t(H) ? 1000 : 0) + degree(a);
+  };
+  std::vector<bool> visited(n, false);
+  while (order.size() < n) {
+    unsigned root = NONE;
+    for (unsigned a = 0; a < n; a++)
+      if (!visited[a] && (root == NONE || selectivity(a) > selectivity(root)))
+        root = a;
+    visited[root] = true;
+    order.push_back(root);
+    orderParent.push_back(NONE);
+    for (auto k = order.size() - 1; k < order.size(); k++)
+      for (auto p = offsets[order[k]], pe = offsets[order[k]+1]; p < pe; p++)
+        if (!visited[nbrs[p]]) {
+          visited[nbrs[p]] = true;
+          order.push_back(nbrs[p]);
+          orderParent.push_back(order[k]);
+        }
+  }
+}
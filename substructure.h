@@ -0,0 +1,53 @@
+#pragma once
+
+#include "molecule.h"
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+
+//
+// Substructure: pattern graph with the atom constraints matched against bond graphs (VF2-style subgraph monomorphism):
+//               pattern atoms map to distinct atoms, pattern bonds have to be present, other bonds are allowed
+//
+
+class Substructure {
+public:
+  enum {ANY = -1};
+  struct Target { // flat bond graph to search in, neighbors of the atom i are nbrs[offsets[i]..offsets[i+1])
+    unsigned        numAtoms;
+    const uint8_t  *elements;
+    const unsigned *offsets;
+    const unsigned *nbrs;
+  }; // Target
+  struct AtomConstraint {
+    uint8_t elt;    // 0 matches any element
+    int     degree; // ANY: at least the number of pattern bonds, otherwise the exact number of bonds
+    int     ring;   // ANY, 0: not in a ring, 1: in a ring
+  }; // AtomConstraint
+private:
+  std::vector<AtomConstraint> atoms;
+  std::vector<unsigned>       offsets; // pattern bonds in the CSR form
+  std::vector<unsigned>       nbrs;
+public: // constr/iface
+  Substructure(const Molecule *pattern); // elements and bonds of the pattern, any degree and ring membership
+  unsigned numAtoms() const {return atoms.size();}
+  void setElement(unsigned a, uint8_t elt) {atoms[a].elt = elt;}
+  void setDegree(unsigned a, int degree) {atoms[a].degree = degree;}
+  void setRing(unsigned a, int ring) {atoms[a].ring = ring;}
+  // matches as the target atom for every pattern atom, maxMatches=0 is unlimited,
+  // uniqueAtomSets leaves one match per set of atoms, otherwise symmetric patterns match the same atoms several times
+  std::vector<std::vector<unsigned>> findMatches(const Molecule *m, unsigned maxMatches, bool uniqueAtomSets) const;
+  std::vector<std::vector<unsigned>> findMatches(const Target &t, unsigned maxMatches, bool uniqueAtomSets) const;
+  bool matches(const Target &t) const {return !findMatches(t, 1, false).empty();}
+  // features that every matching target has at least as many times: elements and element pairs of bonds
+  void requiredFeatures(std::vector<std::pair<uint32_t,unsigned>> &features) const;
+  static uint32_t elementFeature(uint8_t elt) {return elt;}
+  static uint32_t bondFeature(uint8_t e1, uint8_t e2) {return 256 + 256*std::min(e1, e2) + std::max(e1, e2);}
+  static std::vector<bool> findRingAtoms(const Target &t);
+  static std::vector<bool> findRingBonds(const Target &t); // per entry of nbrs: the bond isn't a bridge
+private: // internals
+  unsigned degree(unsigned a) const {return offsets[a+1] - offsets[a];}
+  void computeOrder(std::vector<unsigned> &order, std::vector<unsigned> &orderParent) const;
+}; // Substructure
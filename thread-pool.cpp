@@ -0,0 +1,57 @@
+#include "thread-pool.h"
+
+#include <unistd.h>
+
+/// ThreadPool
+
+ThreadPool::ThreadPool(unsigned nworkers)
+: stopping(false)
+{
+  for (unsigned t = 0; t < nworkers; t++)
+    threads.emplace_back([this]() {workerLoop();});
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    stopping = true;
+  }
+  cv.notify_all();
+  for (auto &t : threads)
+    t.join();
+}
+
+ThreadPool& ThreadPool::get() {
+  static ThreadPool pool(numCPUs() - 1);
+  return pool;
+}
+
+unsigned ThreadPool::numCPUs() {
+  auto n = ::sysconf(_SC_NPROCESSORS_ONLN);
+  if (n < 1)
+    n = std::thread::hardware_concurrency();
+  return n >= 1 ? n : 1;
+}
+
+void ThreadPool::submit(std::function<void()> &&task) {
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    tasks.push_back(std::move(task));
+  }
+  cv.notify_one();
+}
+
+void ThreadPool::workerLoop() {
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      cv.wait(lock, [this]() {return stopping || !tasks.empty();});
+      if (tasks.empty())
+        return; // stopping
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+    task();
+  }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+//
+// ThreadPool: fixed set of worker threads executing the queued tasks
+//             parallelFor runs the loop also on the calling thread, so it can be nested and called from the pool's own tasks
+//
+
+class ThreadPool {
+  std::vector<std::thread>          threads;
+  std::deque<std::function<void()>> tasks;
+  std::mutex                        mtx;
+  std::condition_variable           cv;
+  bool                              stopping;
+public: // constr/iface
+  ThreadPool(unsigned nworkers);
+  ThreadPool(const ThreadPool&) = delete;
+  ~ThreadPool(); // finishes the queued tasks
+  static ThreadPool& get(); // process-wide pool with numCPUs()-1 workers, created on first use
+  static unsigned numCPUs();
+  unsigned numWorkers() const {return threads.size();}
+  void submit(std::function<void()> &&task);
+  template<typename Fn>
+  void parallelFor(unsigned n, unsigned nthreads, Fn &&fn) { // fn(i) for i=0..n-1 on up to nthreads threads including the calling one, nthreads=0 uses all
+    if (nthreads == 0 || nthreads > numWorkers() + 1)
+      nthreads = numWorkers() + 1;
+    nthreads = std::min(nthreads, n);
+    if (nthreads <= 1) {
+      for (unsigned i = 0; i < n; i++)
+        fn(i);
+      return;
+    }
+    struct Loop {
+      std::atomic<unsigned>   next;
+      unsigned                done;
+      std::mutex              mtx;
+      std::condition_variable cv;
+    };
+    auto loop = std::make_shared<Loop>();
+    loop->next = 0;
+    loop->done = 0;
+    auto pfn = &fn;
+    auto run = [loop,n,pfn]() { // late helpers find no indexes left and never touch fn, which only lives until all indexes are done
+      unsigned cnt = 0;
+      for (unsigned i; (i = loop->next++) < n; cnt++)
+        (*pfn)(i);
+      if (cnt) {
+        std::unique_lock<std::mutex> lock(loop->mtx);
+        loop->done += cnt;
+        loop->cv.notify_all();
+      }
+    };
+    for (unsigned t = 1; t < nthreads; t++)
+      submit(run);
+    run();
+    std::unique_lock<std::mutex> lock(loop->mtx);
+    loop->cv.wait(lock, [&loop,n]() {return loop->done == n;});
+  }
+private: // internals
+  void workerLoop();
+}; // ThreadPool
@@ -0,0 +1,171 @@
+#include "torsion-tree.h"
+#include "substructure.h"
+#include "xerror.h"
+
+#include <cmath>
+
+enum {NONE = ~0u};
+
+/// TorsionTree
+
+TorsionTree::TorsionTree(Molecule *newMolecule, const std::vector<AaBackbone> &aaBackbones)
+: molecule(newMolecule), firstDirty(NONE) {
+  typedef AaAngles A;
+  if (aaBackbones.size() < 2)
+    ERROR("TorsionTree: aaBackbones should have at least 2 elements, but it has " << aaBackbones.size() << " elements")
+  for (auto &bb : aaBackbones)
+    if (bb.N->molecule != molecule)
+      ERROR("TorsionTree: aaBackbones should belong to the molecule")
+  auto n = molecule->numAtoms();
+  auto &graph = molecule->getBondGraph();
+  refPos.assign(molecule->positions().begin(), molecule->positions().end());
+
+  // rotatable bonds: backbone bonds that aren't in rings (proline's phi is in a ring), per entry of graph.nbrs
+  auto inRing = Substructure::findRingBonds(Substructure::Target{n, molecule->elements.data(), graph.offsets.data(), graph.nbrs.data()});
+  std::vector<unsigned> slotTorsion(graph.nbrs.size(), NONE); // junction*NUM_TORSIONS + angleId
+  auto markTorsion = [&graph,&inRing,&slotTorsion](const Atom *a1, const Atom *a2, unsigned torsion) {
+    for (auto p = graph.offsets[a1->index], pe = graph.offsets[a1->index+1]; p < pe; p++)
+      if (graph.nbrs[p] == a2->index && !inRing[p])
+        slotTorsion[p] = torsion;
+    for (auto p = graph.offsets[a2->index], pe = graph.offsets[a2->index+1]; p < pe; p++)
+      if (graph.nbrs[p] == a1->index && !inRing[p])
+        slotTorsion[p] = torsion;
+  };
+  for (unsigned j = 0; j+1 < aaBackbones.size(); j++) {
+    auto &cterm = aaBackbones[j];
+    auto &nterm = aaBackbones[j+1];
+    markTorsion(cterm.Coo, nterm.N,     j*NUM_TORSIONS + A::OMEGA);
+    markTorsion(nterm.N, nterm.Cmain,   j*NUM_TORSIONS + A::PHI);
+    markTorsion(nterm.Cmain, nterm.Coo, j*NUM_TORSIONS + A::PSI);
+  }
+  junctionSegments.assign(aaBackbones.size()-1, {{NONE, NONE, NONE}});
+
+  // flood-fill the segments beginning from the N-term, every rotatable bond leading to the unvisited atom begins a new segment
+  std::vector<unsigned> atomSegment(n, NONE), seeds, stack;
+  struct Boundary {
+    unsigned a1, a2, torsion;
+  }; // Boundary
+  std::vector<Boundary> boundaries;
+  auto addSegment = [this,&atomSegment,&seeds](unsigned parent, const Vec3 &origin, const Vec3 &axis, unsigned seed) {
+    atomSegment[seed] = segments.size();
+    seeds.push_back(seed);
+    segments.push_back(Segment{parent, origin, axis, 0, 0, Mat3::identity(), Vec3(0,0,0)});
+  };
+  addSegment(NONE, Vec3(0,0,0), Vec3(0,0,1), aaBackbones[0].N->index); // the root doesn't move
+  for (unsigned s = 0; s < segments.size(); s++) {
+    boundaries.clear();
+    stack.push_back(seeds[s]);
+    while (!stack.empty()) {
+      auto a = stack.back();
+      stack.pop_back();
+      for (auto p = graph.offsets[a], pe = graph.offsets[a+1]; p < pe; p++) {
+        auto b = graph.nbrs[p];
+        if (slotTorsion[p] != NONE)
+          boundaries.push_back({a, b, slotTorsion[p]});
+        else if (atomSegment[b] == NONE) {
+          atomSegment[b] = s;
+          stack.push_back(b);
+        }
+      }
+    }
+    for (auto &bd : boundaries)
+      if (atomSegment[bd.a2] == NONE) { // otherwise it is the bond to the parent
+        junctionSegments[bd.torsion/NUM_TORSIONS][bd.torsion%NUM_TORSIONS] = segments.size();
+        addSegment(s, refPos[bd.a1], (refPos[bd.a2] - refPos[bd.a1]).normalize(), bd.a2);
+      }
+  }
+  for (auto &s : atomSegment) // atoms not connected to the chain stay in place
+    if (s == NONE)
+      s = 0;
+
+  // the angles in the reference coordinates
+  for (unsigned j = 0; j+1 < aaBackbones.size(); j++) {
+    auto &cterm = aaBackbones[j];
+    auto &nterm = aaBackbones[j+1];
+    auto &js = junctionSegments[j];
+    if (js[A::OMEGA] != NONE)
+      segments[js[A::OMEGA]].refAngle = AaAngles::omega(cterm, nterm).angle;
+    if (js[A::PHI] != NONE)
+      segments[js[A::PHI]].refAngle = AaAngles::phi(cterm, nterm).angle;
+    if (js[A::PSI] != NONE)
+      segments[js[A::PSI]].refAngle = AaAngles::psi(cterm, nterm).angle;
+  }
+
+  // atoms by segment
+  segOffsets.assign(segments.size() + 1, 0);
+  for (auto s : atomSegment)
+    segOffsets[s+1]++;
+  for (unsigned s = 0; s < segments.size(); s++)
+    segOffsets[s+1] += segOffsets[s];
+  segAtoms.resize(n);
+  auto fill = segOffsets;
+  for (unsigned a = 0; a < n; a++)
+    segAtoms[fill[atomSegment[a]]++] = a;
+}
+
+bool TorsionTree::isRotatable(unsigned junction, AaAngles::Type angleId) const {
+  if (junction >= junctionSegments.size() || unsigned(angleId) >= NUM_TORSIONS)
+    ERROR("TorsionTree: junction=" << junction << " angleId=" << angleId << " is out of range")
+  return junctionSegments[junction][angleId] != NONE;
+}
+
+TorsionTree::Angle TorsionTree::getAngle(unsigned junction, AaAngles::Type angleId) const {
+  auto &seg = segments[findSegment(junction, angleId)];
+  auto angle = std::fmod(seg.refAngle + seg.delta, 360.);
+  return angle > 180 ? angle - 360 : angle <= -180 ? angle + 360 : angle;
+}
+
+TorsionTree::Angle TorsionTree::setAngle(unsigned junction, AaAngles::Type angleId, Angle newAngle) {
+  checkMolecule();
+  if (!(-180 <= newAngle && newAngle <= 180))
+    ERROR("TorsionTree: angle is out-of-bounds: angle=" << newAngle << " bounds: -180..180")
+  auto s = findSegment(junction, angleId);
+  auto prior = getAngle(junction, angleId);
+  segments[s].delta = newAngle - segments[s].refAngle;
+  firstDirty = std::min(firstDirty, s);
+  return prior;
+}
+
+void TorsionTree::setAngles(unsigned junction, const std::vector<Angle> &newAngles) {
+  if (newAngles.size() > NUM_TORSIONS)
+    ERROR("TorsionTree: only omega, phi and psi can be set, got " << newAngles.size() << " angles")
+  for (unsigned t = 0; t < newAngles.size(); t++)
+    setAngle(junction, AaAngles::Type(t), newAngles[t]);
+}
+
+void TorsionTree::apply() {
+  checkMolecule();
+  if (firstDirty == NONE)
+    return;
+  // frames: segments after the first changed one, each is its parent's frame composed with the rotation about its bond
+  for (auto s = std::max(firstDirty, 1u); s < segments.size(); s++) {
+    auto &seg = segments[s];
+    auto &par = segments[seg.parent];
+    auto Rk = Mat3::rotate(seg.axis, Vec3::degToRad(seg.delta));
+    seg.R = par.R*Rk;
+    seg.T = par.R*(seg.origin - Rk*seg.origin) + par.T;
+  }
+  // positions of their atoms
+  auto pos = molecule->positions();
+  for (auto s = firstDirty; s < segments.size(); s++) {
+    auto &seg = segments[s];
+    for (auto i = segOffsets[s], ie = segOffsets[s+1]; i < ie; i++) {
+      auto a = segAtoms[i];
+      pos[a] = seg.R*refPos[a] + seg.T;
+    }
+  }
+  firstDirty = NONE;
+}
+
+/// internals
+
+unsigned TorsionTree::findSegment(unsigned junction, AaAngles::Type angleId) const {
+  if (!isRotatable(junction, angleId))
+    ERROR("TorsionTree: angleId=" << angleId << " at junction=" << junction << " isn't rotatable: the bond is in a ring")
+  return junctionSegments[junction][angleId];
+}
+
+void TorsionTree::checkMolecule() const {
+  if (molecule->numAtoms() != refPos.size())
+    ERROR("TorsionTree: the molecule has " << molecule->numAtoms() << " atoms, the tree was built for " << refPos.size() << " atoms")
+}
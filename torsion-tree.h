@@ -0,0 +1,55 @@
+#pragma once
+
+#include "molecule.h"
+#include "Vec3.h"
+#include "Mat3.h"
+
+#include <vector>
+#include <array>
+
+//
+// TorsionTree: internal coordinates of a peptide chain for the fast changes of the omega/phi/psi angles
+//              Atoms are split into rigid segments at the rotatable backbone bonds, segments form a tree rooted at the N-term.
+//              Every segment keeps the rotation of its bond from the reference coordinates taken when the tree was built,
+//              positions are reconstructed from the reference coordinates by composing the segment frames down the tree.
+//              Changing angles only records them, apply() writes the positions of the affected segments into the molecule.
+//              Atoms, bonds and the coordinates of the molecule shouldn't be changed by other means while the tree is used,
+//              a changed number of atoms is reported.
+//
+
+class TorsionTree {
+public:
+  typedef Molecule::Angle Angle;
+  typedef Molecule::AaBackbone AaBackbone;
+  typedef Molecule::AaAngles AaAngles;
+  enum {NUM_TORSIONS = AaAngles::MAX_RAM+1}; // omega, phi, psi
+private:
+  struct Segment {
+    unsigned parent;   // segment index, parents precede children
+    Vec3     origin;   // the rotatable bond in the reference coordinates: the atom in the parent
+    Vec3     axis;     // ... and the direction into this segment
+    Angle    refAngle; // the dihedral in the reference coordinates
+    Angle    delta;    // rotation from the reference coordinates
+    Mat3     R;        // frame: reference position x goes to R*x + T
+    Vec3     T;
+  }; // Segment
+  Molecule                *molecule;
+  std::vector<Vec3>        refPos;          // positions when the tree was built
+  std::vector<Segment>     segments;
+  std::vector<unsigned>    segOffsets;      // atoms of the segment s are segAtoms[segOffsets[s]..segOffsets[s+1])
+  std::vector<unsigned>    segAtoms;
+  std::vector<std::array<unsigned,NUM_TORSIONS>> junctionSegments; // segment rotated by each torsion of a junction, NONE when it isn't rotatable
+  unsigned                 firstDirty;      // the first segment with the outdated frame
+public: // constr/iface
+  TorsionTree(Molecule *newMolecule, const std::vector<AaBackbone> &aaBackbones); // aaBackbones are sorted from the N-term, see Molecule::findAaBackbonesSorted
+  unsigned numJunctions() const {return junctionSegments.size();}
+  unsigned numSegments() const {return segments.size();}
+  bool isRotatable(unsigned junction, AaAngles::Type angleId) const;
+  Angle getAngle(unsigned junction, AaAngles::Type angleId) const;
+  Angle setAngle(unsigned junction, AaAngles::Type angleId, Angle newAngle); // returns the prior angle
+  void setAngles(unsigned junction, const std::vector<Angle> &newAngles); // omega, phi, psi: up to NUM_TORSIONS angles
+  void apply(); // updates the positions in the molecule
+private: // internals
+  unsigned findSegment(unsigned junction, AaAngles::Type angleId) const; // fails when the bond isn't rotatable
+  void checkMolecule() const; // fails when atoms were added to or removed from the molecule
+}; // TorsionTree
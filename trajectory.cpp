@@ -0,0 +1,226 @@
+#include "trajectory.h"
+#include "xerror.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+/// file format: FileHeader, the elements (one byte per atom), then the chunks: ChunkHeader, uint64 step for each frame,
+/// and the frame data: zigzag-encoded LEB128 varint for each quantized coordinate difference,
+/// numbers are in the native byte order
+
+namespace {
+
+struct FileHeader {
+  char     magic[8];
+  uint32_t version;
+  uint32_t numAtoms;
+  double   precision;
+}; // FileHeader
+
+struct ChunkHeader {
+  uint64_t dataSize;
+  uint32_t numFrames;
+  uint32_t reserved;
+}; // ChunkHeader
+
+const char fileMagic[8] = {'C', 'W', 'T', 'R', 'A', 'J', 0, 0};
+enum {FILE_VERSION = 2};
+
+const double maxQuantized = 4e18; // fits int64 with the room for the differences
+
+void putVarint(std::vector<uint8_t> &data, int64_t v) {
+  auto u = (uint64_t(v) << 1) ^ uint64_t(v >> 63); // zigzag: small negative numbers become small positive numbers
+  while (u >= 0x80) {
+    data.push_back(uint8_t(u) | 0x80);
+    u >>= 7;
+  }
+  data.push_back(uint8_t(u));
+}
+
+bool getVarint(const std::vector<uint8_t> &data, size_t &pos, int64_t &v) {
+  uint64_t u = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    if (pos >= data.size())
+      return false;
+    auto b = data[pos++];
+    u |= uint64_t(b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      v = int64_t(u >> 1) ^ -int64_t(u & 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+}
+
+/// TrajectoryWriter
+
+TrajectoryWriter::TrajectoryWriter(const std::string &fname, const Molecule &m, const Params &newParams)
+: file(fname, std::ios::out | std::ios::binary | std::ios::trunc),
+  numAtoms(m.numAtoms()),
+  params(newParams),
+  prev(3*m.numAtoms()),
+  cur(3*m.numAtoms())
+{
+  if (!(params.precision > 0))
+    ERROR("TrajectoryWriter: precision should be positive, got " << params.precision)
+  if (params.framesPerChunk == 0)
+    ERROR("TrajectoryWriter: framesPerChunk should be positive")
+  if (!file)
+    ERROR("can't open the file for writing: " << fname)
+  FileHeader h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, fileMagic, sizeof(fileMagic));
+  h.version = FILE_VERSION;
+  h.numAtoms = numAtoms;
+  h.precision = params.precision;
+  file.write((const char*)&h, sizeof(h));
+  file.write((const char*)m.elements.data(), m.elements.size());
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+  writeChunk();
+}
+
+void TrajectoryWriter::write(uint64_t step, const std::vector<double> &coords) {
+  if (coords.size() != 3*numAtoms)
+    ERROR("TrajectoryWriter: coordinates array has " << coords.size() << " elements, expected " << 3*numAtoms)
+  for (unsigned i = 0, ie = coords.size(); i < ie; i++) {
+    auto q = std::round(coords[i]/params.precision);
+    if (!(std::abs(q) < maxQuantized))
+      ERROR("TrajectoryWriter: the coordinate " << coords[i] << " of the step " << step << " can't be stored with the precision " << params.precision)
+    cur[i] = int64_t(q);
+  }
+
+  // the first frame of the chunk is delta-encoded between atoms, others between frames
+  if (chunkSteps.empty())
+    for (unsigned i = 0, ie = cur.size(); i < ie; i++)
+      putVarint(chunkData, i >= 3 ? cur[i] - cur[i-3] : cur[i]);
+  else
+    for (unsigned i = 0, ie = cur.size(); i < ie; i++)
+      putVarint(chunkData, cur[i] - prev[i]);
+  chunkSteps.push_back(step);
+  std::swap(prev, cur);
+
+  if (chunkSteps.size() == params.framesPerChunk)
+    writeChunk();
+  if (!file)
+    ERROR("TrajectoryWriter: failed to write the frame for the step " << step)
+}
+
+void TrajectoryWriter::flush() {
+  writeChunk();
+  file.flush();
+  if (!file)
+    ERROR("TrajectoryWriter: failed to write the trajectory file")
+}
+
+/// internals
+
+void TrajectoryWriter::writeChunk() { // doesn't report errors because it is also called from the destructor
+  if (chunkSteps.empty())
+    return;
+  ChunkHeader h;
+  std::memset(&h, 0, sizeof(h));
+  h.dataSize = chunkData.size();
+  h.numFrames = chunkSteps.size();
+  file.write((const char*)&h, sizeof(h));
+  file.write((const char*)chunkSteps.data(), chunkSteps.size()*sizeof(uint64_t));
+  file.write((const char*)chunkData.data(), chunkData.size());
+  chunkSteps.clear();
+  chunkData.clear();
+}
+
+/// TrajectoryReader
+
+TrajectoryReader::TrajectoryReader(const std::string &fname)
+: file(fname, std::ios::in | std::ios::binary),
+  curChunk(-1),
+  nextFrame(0),
+  dataPos(0)
+{
+  if (!file)
+    ERROR("can't open the file for reading: " << fname)
+  FileHeader h;
+  if (!file.read((char*)&h, sizeof(h)) || std::memcmp(h.magic, fileMagic, sizeof(fileMagic)) != 0)
+    ERROR("not a trajectory file: " << fname)
+  if (h.version != FILE_VERSION)
+    ERROR("unsupported trajectory file version " << h.version << " in " << fname)
+  if (!(h.precision > 0))
+    ERROR("invalid precision " << h.precision << " in the trajectory file " << fname)
+  precision = h.precision;
+  elements.resize(h.numAtoms);
+  if (!file.read((char*)elements.data(), elements.size()))
+    ERROR("the trajectory file is truncated: " << fname)
+  cur.resize(3*elements.size());
+
+  // index the chunks, the incomplete chunk of the file that is still being written is ignored
+  auto offset = std::streamoff(file.tellg());
+  file.seekg(0, std::ios::end);
+  auto fileSize = std::streamoff(file.tellg());
+  while (true) {
+    ChunkHeader ch;
+    file.seekg(offset);
+    if (!file.read((char*)&ch, sizeof(ch)) || ch.numFrames == 0)
+      break;
+    auto dataOffset = offset + std::streamoff(sizeof(ch) + ch.numFrames*sizeof(uint64_t));
+    if (dataOffset + std::streamoff(ch.dataSize) > fileSize)
+      break;
+    chunks.push_back(Chunk{dataOffset, ch.dataSize, unsigned(steps.size()), ch.numFrames});
+    steps.resize(steps.size() + ch.numFrames);
+    if (!file.read((char*)&steps[steps.size() - ch.numFrames], ch.numFrames*sizeof(uint64_t)))
+      ERROR("failed to read the trajectory file: " << fname)
+    offset = dataOffset + ch.dataSize;
+  }
+  file.clear();
+}
+
+uint64_t TrajectoryReader::readFrame(unsigned idx, std::vector<double> &coords) {
+  checkFrameIdx(idx);
+  auto c = unsigned(std::upper_bound(chunks.begin(), chunks.end(), idx, [](unsigned i, const Chunk &ch) {return i < ch.firstFrame;}) - chunks.begin()) - 1;
+  auto frameInChunk = idx - chunks[c].firstFrame;
+  if (int(c) != curChunk || frameInChunk < nextFrame)
+    loadChunk(c);
+  while (nextFrame <= frameInChunk)
+    decodeFrame();
+  coords.resize(cur.size());
+  for (unsigned i = 0, ie = cur.size(); i < ie; i++)
+    coords[i] = cur[i]*precision;
+  return steps[idx];
+}
+
+uint64_t TrajectoryReader::readStep(unsigned idx) const {
+  checkFrameIdx(idx);
+  return steps[idx];
+}
+
+/// internals
+
+void TrajectoryReader::checkFrameIdx(unsigned idx) const {
+  if (idx >= steps.size())
+    ERROR("TrajectoryReader: frame index " << idx << " is out of range, there are " << steps.size() << " frames")
+}
+
+void TrajectoryReader::loadChunk(unsigned c) {
+  auto &ch = chunks[c];
+  data.resize(ch.dataSize);
+  file.clear();
+  file.seekg(ch.offset);
+  if (!file.read((char*)data.data(), data.size()))
+    ERROR("TrajectoryReader: failed to read the frames #" << ch.firstFrame << ".." << ch.firstFrame + ch.numFrames - 1)
+  curChunk = c;
+  nextFrame = 0;
+  dataPos = 0;
+}
+
+void TrajectoryReader::decodeFrame() {
+  int64_t d;
+  for (unsigned i = 0, ie = cur.size(); i < ie; i++) {
+    if (!getVarint(data, dataPos, d))
+      ERROR("TrajectoryReader: the frame #" << chunks[curChunk].firstFrame + nextFrame << " is corrupt")
+    cur[i] = nextFrame == 0 ? (i >= 3 ? cur[i-3] + d : d) : cur[i] + d;
+  }
+  nextFrame++;
+}
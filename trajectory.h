@@ -0,0 +1,75 @@
+#pragma once
+
+#include "molecule.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+
+//
+// Trajectory: compact binary trajectory files
+//             The topology (elements) is written once in the header, then the frames are grouped into chunks.
+//             Coordinates are quantized with the given precision (like XTC), the first frame of the chunk
+//             stores the differences between the consecutive atoms, the following frames store the differences
+//             from the previous frame, all as variable length integers. Chunk headers hold the step numbers
+//             and serve as the frame index: any frame is decoded from the beginning of its chunk.
+//
+
+class TrajectoryWriter {
+public:
+  struct Params {
+    double      precision;      // A: the quantization step of the coordinates
+    unsigned    framesPerChunk; // longer chunks compress better, shorter chunks are faster to read at random
+    Params() : precision(0.001), framesPerChunk(16) { }
+  }; // Params
+private:
+  std::ofstream         file;
+  unsigned              numAtoms;
+  Params                params;
+  std::vector<uint64_t> chunkSteps; // frames of the chunk that isn't written yet
+  std::vector<uint8_t>  chunkData;
+  std::vector<int64_t>  prev;       // quantized coordinates of the previous frame
+  std::vector<int64_t>  cur;
+public: // constr/iface
+  TrajectoryWriter(const std::string &fname, const Molecule &m, const Params &newParams = Params()); // the file is overwritten, the topology is taken from m
+  ~TrajectoryWriter(); // writes the incomplete chunk
+  unsigned getNumAtoms() const {return numAtoms;}
+  const Params& getParams() const {return params;}
+  void write(uint64_t step, const std::vector<double> &coords); // coords are x,y,z for each atom
+  void flush(); // writes the incomplete chunk, the following frames begin the new chunk
+private: // internals
+  void writeChunk();
+}; // TrajectoryWriter
+
+class TrajectoryReader {
+  struct Chunk {
+    std::streamoff offset;     // of the frame data
+    uint64_t       dataSize;
+    unsigned       firstFrame;
+    unsigned       numFrames;
+  }; // Chunk
+  std::ifstream         file;
+  std::vector<uint8_t>  elements;
+  double                precision;
+  std::vector<Chunk>    chunks;
+  std::vector<uint64_t> steps;      // of all frames
+  // decoder state: frames are decoded sequentially within the chunk, so reading the consecutive frames doesn't restart the chunk
+  int                   curChunk;
+  unsigned              nextFrame;  // in the current chunk
+  size_t                dataPos;
+  std::vector<uint8_t>  data;
+  std::vector<int64_t>  cur;        // quantized coordinates of the last decoded frame
+public: // constr/iface
+  TrajectoryReader(const std::string &fname);
+  unsigned numAtoms() const {return elements.size();}
+  unsigned numFrames() const {return steps.size();}
+  double getPrecision() const {return precision;}
+  const std::vector<uint8_t>& getElements() const {return elements;}
+  uint64_t readFrame(unsigned idx, std::vector<double> &coords); // returns the step number of the frame
+  uint64_t readStep(unsigned idx) const;
+private: // internals
+  void checkFrameIdx(unsigned idx) const;
+  void loadChunk(unsigned c);
+  void decodeFrame();
+}; // TrajectoryReader
@@ -3,6 +3,9 @@
 
 #include <boost/algorithm/string.hpp> 
 
+#include <cstdlib>
+#include <cstdint>
+
 
 namespace Util {
 
@@ -15,4 +18,62 @@ bool strAsBool(const std::string &str) {
   ERROR("the string '" << str << "' can't be converted to boolean")
 }
 
+static bool isDigitChar(char c) {return c >= '0' && c <= '9';}
+
+bool parseDouble(const char *&p, const char *e, double &res) {
+  static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  auto start = p;
+  bool neg = false;
+  if (p < e && (*p == '-' || *p == '+'))
+    neg = *p++ == '-';
+  // mantissa: up to 19 significant digits fit into uint64_t
+  uint64_t mant = 0;
+  int nsig = 0, exp10 = 0;
+  bool anyDigits = false;
+  for (; p < e && isDigitChar(*p); p++, anyDigits = true)
+    if (nsig < 19) {
+      mant = mant*10 + (*p - '0');
+      nsig += mant != 0;
+    } else {
+      exp10++;
+    }
+  if (p < e && *p == '.')
+    for (p++; p < e && isDigitChar(*p); p++, anyDigits = true)
+      if (nsig < 19) {
+        mant = mant*10 + (*p - '0');
+        nsig += mant != 0;
+        exp10--;
+      }
+  if (!anyDigits) {
+    p = start;
+    return false;
+  }
+  if (p < e && (*p == 'e' || *p == 'E')) {
+    auto q = p + 1;
+    bool expNeg = false;
+    if (q < e && (*q == '-' || *q == '+'))
+      expNeg = *q++ == '-';
+    if (q < e && isDigitChar(*q)) {
+      int ex = 0;
+      for (; q < e && isDigitChar(*q); q++)
+        if (ex < 100000)
+          ex = ex*10 + (*q - '0');
+      exp10 += expNeg ? -ex : ex;
+      p = q;
+    }
+  }
+  // exact when both the mantissa and the power of 10 are exactly representable, otherwise leave it to strtod
+  if (mant < (uint64_t(1) << 53) && exp10 >= -22 && exp10 <= 22) {
+    res = exp10 < 0 ? double(mant)/pow10[-exp10] : double(mant)*pow10[exp10];
+  } else {
+    std::string s(start, p);
+    res = std::strtod(s.c_str(), nullptr);
+    return true; // strtod handles the sign
+  }
+  if (neg)
+    res = -res;
+  return true;
+}
+
 }; // Util
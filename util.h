@@ -6,6 +6,7 @@
 #include <sstream>
 #include <fstream>
 #include <cstring>
+#include <cstdint>
 
 namespace Util {
 
@@ -74,6 +75,18 @@ inline bool realEof(std::ifstream &f) {
 
 bool strAsBool(const std::string &str);
 
+inline uint64_t mix64(uint64_t x) { // splitmix64 finalizer: a fast well-mixing hash of integers
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+// parses a floating point number at p (not past e) and advances p, gives the same results as strtod, but doesn't need a null-terminated string
+bool parseDouble(const char *&p, const char *e, double &res);
+
 // DoubleMap maps objects of two types back and forth
 template<typename T1, typename T2>
 class DoubleMap {
@@ -0,0 +1,123 @@
+#include "xyz-reader.h"
+#include "periodic-table-data.h"
+#include "xerror.h"
+#include "util.h"
+
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static bool isSpace(char c) {return c == ' ' || c == '\t' || c == '\r';}
+static bool isDigit(char c) {return c >= '0' && c <= '9';}
+
+static void skipSpaces(const char *&p, const char *e) {
+  while (p < e && isSpace(*p))
+    p++;
+}
+
+/// XyzFrameReader
+
+XyzFrameReader::XyzFrameReader(const std::string &newFname)
+: fname(newFname),
+  data(nullptr),
+  size(0),
+  lineNo(1)
+{
+  int fd = ::open(fname.c_str(), O_RDONLY);
+  if (fd == -1)
+    ERROR_SYSCALL1(open, "can't open the xyz file for reading: " << fname)
+  struct stat st;
+  if (::fstat(fd, &st) == -1)
+    ERROR_SYSCALL1(fstat, "file " << fname)
+  size = st.st_size;
+  if (size > 0) {
+    auto addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED)
+      ERROR_SYSCALL1(mmap, "file " << fname)
+    ::madvise(addr, size, MADV_SEQUENTIAL); // only a hint
+    data = (const char*)addr;
+  }
+  ::close(fd);
+  cur = data;
+}
+
+XyzFrameReader::~XyzFrameReader() {
+  if (data)
+    ::munmap((void*)data, size);
+}
+
+bool XyzFrameReader::next(XyzFrame &frame) {
+  if (atEof())
+    return false;
+
+  // number of atoms
+  auto le = lineEnd();
+  auto p = cur;
+  skipSpaces(p, le);
+  unsigned natoms = 0;
+  if (p == le || !isDigit(*p))
+    ERROR("no natoms in the xyz file " << fname << " at line " << lineNo)
+  while (p < le && isDigit(*p))
+    natoms = natoms*10 + (*p++ - '0');
+  skipSpaces(p, le);
+  if (p != le)
+    ERROR("garbage in the end of the line " << lineNo << " in the xyz file " << fname << ": " << std::string(p, le))
+  nextLine(le);
+
+  // description
+  le = lineEnd();
+  frame.descr.assign(cur, le > cur && le[-1] == '\r' ? le - 1 : le);
+  nextLine(le);
+
+  // atoms
+  auto &ptd = PeriodicTableData::get();
+  frame.elements.resize(natoms);
+  frame.coords.resize(3*natoms);
+  std::string sym;
+  for (unsigned a = 0; a < natoms; a++) {
+    if (cur == end())
+      ERROR("the xyz file " << fname << " ends after " << a << " of " << natoms << " atoms")
+    le = lineEnd();
+    p = cur;
+    skipSpaces(p, le);
+    auto symBegin = p;
+    while (p < le && !isSpace(*p))
+      p++;
+    sym.assign(symBegin, p);
+    if (sym.empty())
+      ERROR("no atom description found in line " << lineNo << " in the xyz file " << fname)
+    frame.elements[a] = Element(ptd.elementFromSymbol(sym));
+    // coordinates, followed by the optional gradient
+    double dummy;
+    unsigned nnums = 0;
+    for (; skipSpaces(p, le), p < le; nnums++)
+      if (!Util::parseDouble(p, le, nnums < 3 ? frame.coords[3*a + nnums] : dummy) || (p < le && !isSpace(*p)))
+        ERROR("bad number in line " << lineNo << " in the xyz file " << fname << ": " << std::string(cur, le))
+    if (nnums != 3 && nnums != 6)
+      ERROR("the atom descriptor can have either 4 or 7 elements, found " << nnums+1 << " elements in line " << lineNo << " in the xyz file " << fname)
+    nextLine(le);
+  }
+
+  return true;
+}
+
+const char* XyzFrameReader::lineEnd() const {
+  auto le = (const char*)std::memchr(cur, '\n', end() - cur);
+  return le ? le : end();
+}
+
+void XyzFrameReader::nextLine(const char *le) {
+  cur = le < end() ? le + 1 : end();
+  lineNo++;
+}
+
+bool XyzFrameReader::atEof() { // only whitespace remains
+  for (auto p = cur; p < end(); p++)
+    if (!isSpace(*p) && *p != '\n')
+      return false;
+  return true;
+}
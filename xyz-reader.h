@@ -0,0 +1,40 @@
+#pragma once
+
+#include "molecule.h"
+
+#include <string>
+#include <vector>
+
+//
+// XyzFrame: one record of a (possibly multi-frame) xyz file as plain arrays
+//
+
+struct XyzFrame {
+  std::string          descr;
+  std::vector<Element> elements;
+  std::vector<double>  coords;   // x,y,z triplets
+  unsigned numAtoms() const {return elements.size();}
+}; // XyzFrame
+
+//
+// XyzFrameReader: reads the frames of an xyz file one by one from the memory-mapped file,
+//                 the frame passed to next() is reused so that the memory use doesn't depend on the file size
+//
+
+class XyzFrameReader {
+  std::string fname;
+  const char *data;    // mapped file contents
+  size_t      size;
+  const char *cur;     // parse position
+  unsigned    lineNo;  // current line number, for error messages
+public: // constr/iface
+  XyzFrameReader(const std::string &newFname);
+  XyzFrameReader(const XyzFrameReader&) = delete;
+  ~XyzFrameReader();
+  bool next(XyzFrame &frame); // false when there are no more frames
+private: // internals
+  const char* end() const {return data + size;}
+  const char* lineEnd() const;
+  void nextLine(const char *le);
+  bool atEof();
+}; // XyzFrameReader